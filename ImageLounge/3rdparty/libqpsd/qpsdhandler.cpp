@@ -21,6 +21,17 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
 */
 
 #include "qpsdhandler.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QSemaphore>
+#include <QSharedPointer>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <functional>
 /* For debugging purposes ONLY
 #include <QDebug>
 #include <QElapsedTimer>
@@ -102,6 +113,131 @@ static QRgb labToRgb(qreal lightness, qreal a, qreal b, quint8 alpha = 255)
     return xyzToRgb(refX * varX, refY * varY, refZ * varZ, alpha / 255);
 }
 
+/* The helper threads of parallelFor. The pool is shared by all
+ * decodes so that concurrent decodes cannot oversubscribe the cores */
+static QThreadPool *rowPool()
+{
+    static QThreadPool pool;
+    static bool init = (pool.setMaxThreadCount(qMax(QThread::idealThreadCount() - 1, 1)), true);
+    Q_UNUSED(init);
+    return &pool;
+}
+
+/* The rows of one parallelFor call. Helpers that start after all rows
+ * were handed out just return - so they may outlive the call */
+struct QPsdRows
+{
+    QAtomicInt next;
+    QSemaphore done;
+    int count;
+    int blockSize;
+    std::function<void(int)> func;
+
+    void work()
+    {
+        for (int start = next.fetchAndAddRelaxed(blockSize); start < count;
+             start = next.fetchAndAddRelaxed(blockSize)) {
+            int end = qMin(start + blockSize, count);
+            for (int idx = start; idx < end; ++idx)
+                func(idx);
+            done.release(end - start);
+        }
+    }
+};
+
+/* Runs blocks of rows in parallelFor */
+class QPsdRowJob : public QRunnable
+{
+public:
+    QPsdRowJob(const QSharedPointer<QPsdRows> &rows) : m_rows(rows) {}
+    void run() { m_rows->work(); }
+
+private:
+    QSharedPointer<QPsdRows> m_rows;
+};
+
+/* Calls func(idx) for all idx in [0 count). If parallel is true, the
+ * shared row pool helps the calling thread. Rows are handed out in
+ * small blocks so that all threads keep busy even if some rows are
+ * compressed better than others */
+static void parallelFor(int count, const std::function<void(int)> &func, bool parallel = true)
+{
+    const int blockSize = 16;
+    int numThreads = qMin(rowPool()->maxThreadCount() + 1, (count + blockSize - 1) / blockSize);
+
+    if (!parallel || numThreads <= 1) {
+        for (int idx = 0; idx < count; ++idx)
+            func(idx);
+        return;
+    }
+
+    QSharedPointer<QPsdRows> rows(new QPsdRows);
+    rows->count = count;
+    rows->blockSize = blockSize;
+    rows->func = func;
+
+    for (int i = 1; i < numThreads; ++i)
+        rowPool()->start(new QPsdRowJob(rows));
+
+    /* the caller works too - so we finish even if the pool is busy */
+    rows->work();
+    rows->done.acquire(count);
+}
+
+/* Reads a row of one channel - either raw or PackBits compressed.
+ * Only every step-th byte is written to dst and written bytes are
+ * dstStride bytes apart. This allows for writing channels directly
+ * into the scanlines of a QImage and for skipping columns.
+ * Returns false if the data is corrupt */
+static bool readRow(const uchar *src, qint64 srcLength, bool packed,
+                    uchar *dst, int dstStride, int length, int step)
+{
+    if (!packed && step == 1 && dstStride == 1) {
+        if (srcLength < length)
+            return false;
+        memcpy(dst, src, length);
+        return true;
+    }
+
+    const uchar *end = src + srcLength;
+    int phase = 0;
+    int i = 0;
+
+    while (i < length) {
+        int count;
+        bool repeat = false;
+
+        if (!packed) {
+            count = length;
+        } else {
+            if (src >= end)
+                return false;
+            quint8 byte = *src++;
+            if (byte == 128) //no operation
+                continue;
+            repeat = byte > 128;
+            count = repeat ? 257 - byte : byte + 1;
+        }
+
+        if (src + (repeat ? 1 : count) > end)
+            return false;
+
+        count = qMin(count, length - i);
+        for (int j = 0; j < count; ++j) {
+            if (phase == 0) {
+                *dst = repeat ? *src : src[j];
+                dst += dstStride;
+            }
+            if (++phase == step)
+                phase = 0;
+        }
+        i += count;
+        src += repeat ? 1 : count;
+    }
+
+    return true;
+}
+
 QPsdHandler::QPsdHandler()
 {
 }
@@ -135,6 +271,19 @@ bool QPsdHandler::canRead(QIODevice *device)
 }
 
 bool QPsdHandler::read(QImage *image)
+{
+    if (!readImage(image))
+        return false;
+
+    /* the fast path just skips rows and columns - the other
+     * modes are decoded in full resolution */
+    if (m_scaledSize.isValid() && !m_scaledSize.isEmpty() && image->size() != m_scaledSize)
+        *image = image->scaled(m_scaledSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+    return true;
+}
+
+bool QPsdHandler::readImage(QImage *image)
 {
     QDataStream input(device());
     quint32 signature, height, width, colorModeDataLength, imageResourcesLength;
@@ -251,92 +400,166 @@ bool QPsdHandler::read(QImage *image)
 
     input >> compression;
 
+    if (compression > 1) //ZIP WITH/WITHOUT PREDICTION - UNIMPLEMENTED
+        return false;
+
     //QElapsedTimer timer;
     //timer.start();
-    QByteArray imageData;
-    quint64 totalBytesPerChannel = width * height * depth / 8;
+    const bool packed = compression == 1;
+    const int bytesPerRow = (quint64(width) * depth + 7) / 8;
+    quint64 totalBytesPerChannel = quint64(bytesPerRow) * height;
 
-    switch (compression) {
-    case 0: /*RAW IMAGE DATA*/
-    {
-        /* NOTE: This algorithm might be inaccurate and was based ONLY
-         * on a psd file I obtained (no references) */
-
-        /* This code is faster than the alternative below */
-        quint64 size = channels * totalBytesPerChannel;
-        imageData.resize(size);
-        input.readRawData(imageData.data(), size);
-        /* Alternative:
-        quint8 byte;
-        while (!input.atEnd()) {
-            input >> byte;
-            imageData.append(byte);
-        }*/
-    }
-        break;
-    case 1: /*RLE COMPRESSED DATA*/
-    {
-        /* The RLE-compressed data is proceeded by a 2-byte(psd) or 4-byte(psb)
-         * data count for each row in the data
-         */
-        if (format() == "psd")
-            input.skipRawData(height * channels * 2);
-        else if (format() == "psb")
-            input.skipRawData(height * channels * 4);
-
-        quint8 byte,count;
-
-        /* Code based on PackBits implementation which is primarily used by
-         * Photoshop for RLE encoding/decoding */
-        while (!input.atEnd()) {
-            input >> byte;
-            if (byte > 128) {
-                count = 256 - byte ;
-                input >>  byte;
-                /* This code is still faster than the
-                 * alternative below */
-                for (quint8 i = 0; i <= count; ++i) {
-                    imageData.append(byte);
-                }
-                /* Alternative:
-                ++count;
-                imageData.append(QByteArray(count, char(byte)));
-                */
-            } else if (byte < 128) {
-                count = byte + 1;
-                /* Alternative 1:
-                for(quint8 i=0; i<count; ++i) {
-                    input >> byte;
-                    imageData.append(byte);
-                }
-                */
-                /* Alternative 2:
-                char *temp = new char[count];
-                input.readRawData(temp, count);
-                imageData.append(temp, count);
-                delete [] temp;
-                */
-                /* This code is faster than the 2 alternatives above */
-                quint64 size = imageData.size();
-                imageData.resize(size + count);
-                input.readRawData(imageData.data() + size, count);
+    /* excess channels (e.g. spot colors) are never displayed
+     * so we neither read nor decode them */
+    const int usedChannels = qMin<int>(channels, 5);
+
+    /* The RLE-compressed data is proceeded by a 2-byte(psd) or 4-byte(psb)
+     * data count for each row in the data. We need it to find the rows
+     * so that they can be decoded in parallel */
+    QVector<QVector<qint64> > rowOffsets(usedChannels);
+    for (int c = 0; packed && c < channels; ++c) {
+        qint64 offset = 0;
+        if (c < usedChannels)
+            rowOffsets[c].resize(height + 1);
+
+        for (quint32 y = 0; y < height; ++y) {
+            quint32 count;
+            if (format() == "psd") {
+                quint16 count16;
+                input >> count16;
+                count = count16;
+            } else {
+                input >> count;
             }
+            if (c < usedChannels)
+                rowOffsets[c][y] = offset;
+            offset += count;
         }
+        if (c < usedChannels)
+            rowOffsets[c][height] = offset;
     }
-        break;
-    case 2:/*ZIP WITHOUT PREDICTION - UNIMPLEMENTED*/
-        return false;
-        break;
-    case 3:/*ZIP WITH PREDICTION - UNIMPLEMENTED*/
-        return false;
-        break;
+
+    /* read the channels (they are stored one after the other) */
+    QVector<QByteArray> channelData(usedChannels);
+    for (int c = 0; c < usedChannels; ++c) {
+        qint64 size = packed ? rowOffsets[c][height] : qint64(totalBytesPerChannel);
+        if (size > INT_MAX) //QByteArray limit
+            return false;
+        channelData[c].resize(size);
+        if (input.readRawData(channelData[c].data(), size) != size)
+            return false;
     }
-    //qDebug() << timer.nsecsElapsed();
 
     if (input.status() != QDataStream::Ok)
         return false;
 
-    if (imageData.size() != channels * totalBytesPerChannel)
+    /* reads channel c of row y with the options of readRow */
+    auto readChannelRow = [&](int c, quint32 y, uchar *dst, int dstStride, int step) -> bool {
+        const uchar *src = (const uchar *)channelData[c].constData();
+        qint64 srcLength;
+        if (packed) {
+            src += rowOffsets[c][y];
+            srcLength = rowOffsets[c][y + 1] - rowOffsets[c][y];
+        } else {
+            src += qint64(y) * bytesPerRow;
+            srcLength = bytesPerRow;
+        }
+        return readRow(src, srcLength, packed, dst, dstStride, bytesPerRow, step);
+    };
+
+    /* thumbnails are decoded in parallel anyway (one per thread) -
+     * helper threads would just oversubscribe the cores */
+    const bool parallel = !(m_scaledSize.isValid() && !m_scaledSize.isEmpty() &&
+            qMax(m_scaledSize.width(), m_scaledSize.height()) <= 512);
+
+    /* fast path: 8-bit gray & RGB channels are written straight into the
+     * scanlines. If a scaled size is requested, we skip rows and columns */
+    const bool direct = depth == 8 &&
+            ((colorMode == 1 && channels <= 2) ||
+             (colorMode == 8 && channels == 1) ||
+             (colorMode == 3 && channels >= 3));
+    if (direct) {
+        const int colorChannels = colorMode == 3 ? 3 : 1;
+        const bool hasAlpha = usedChannels > colorChannels;
+        const bool premultiplied = colorMode == 3; //fix for blending image with white
+
+        int step = 1;
+        if (m_scaledSize.isValid() && !m_scaledSize.isEmpty()) {
+            step = qMax(1, qMin<int>(width / m_scaledSize.width(), height / m_scaledSize.height()));
+        }
+        const int outWidth = (width + step - 1) / step;
+        const int outHeight = (height + step - 1) / step;
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        const int byteIdx[4] = {2, 1, 0, 3}; //red, green, blue, alpha in a QRgb
+#else
+        const int byteIdx[4] = {1, 2, 3, 0};
+#endif
+
+        QImage result(outWidth, outHeight, hasAlpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+        if (result.isNull())
+            return false;
+
+        QAtomicInt ok(1);
+        parallelFor(outHeight, [&](int oy) {
+            quint32 y = quint32(oy) * step;
+            QRgb *line = (QRgb *)result.scanLine(oy);
+            uchar *bytes = (uchar *)line;
+
+            if (!hasAlpha)
+                std::fill(line, line + outWidth, 0xffffffff);
+
+            for (int c = 0; c < colorChannels; ++c) {
+                if (!readChannelRow(c, y, bytes + byteIdx[c], 4, step))
+                    ok.storeRelease(0);
+            }
+            if (hasAlpha && !readChannelRow(colorChannels, y, bytes + byteIdx[3], 4, step))
+                ok.storeRelease(0);
+
+            for (QRgb *p = line, *end = line + outWidth; p < end; ++p) {
+                if (colorChannels == 1) {
+                    quint8 gray = qRed(*p);
+                    *p = qRgba(gray, gray, gray, qAlpha(*p));
+                } else if (hasAlpha && premultiplied && qAlpha(*p) != 0) {
+                    quint8 r = qRed(*p);
+                    quint8 g = qGreen(*p);
+                    quint8 b = qBlue(*p);
+                    quint8 a = qAlpha(*p);
+
+                    quint8 rFixed = (((r + a) - 255) * 255) / a;
+                    quint8 gFixed = (((g + a) - 255) * 255) / a;
+                    quint8 bFixed = (((b + a) - 255) * 255) / a;
+
+                    *p = qRgba(rFixed, gFixed, bFixed, a);
+                }
+            }
+        }, parallel);
+
+        if (!ok.loadAcquire())
+            return false;
+
+        *image = result;
+        return true;
+    }
+
+    /* all other modes: decode the rows of all channels in parallel */
+    QByteArray imageData;
+    quint64 size = usedChannels * totalBytesPerChannel;
+    if (size > INT_MAX) //QByteArray limit
+        return false;
+    imageData.resize(size);
+
+    QAtomicInt ok(1);
+    parallelFor(usedChannels * height, [&](int idx) {
+        int c = idx / height;
+        quint32 y = idx % height;
+        uchar *dst = (uchar *)imageData.data() + c * totalBytesPerChannel + quint64(y) * bytesPerRow;
+        if (!readChannelRow(c, y, dst, 1, 1))
+            ok.storeRelease(0);
+    }, parallel);
+    //qDebug() << timer.nsecsElapsed();
+
+    if (!ok.loadAcquire())
         return false;
 
     /* NOTE: this section was made for verification.
@@ -955,7 +1178,13 @@ bool QPsdHandler::read(QImage *image)
 
 bool QPsdHandler::supportsOption(ImageOption option) const
 {
-    return option == Size;
+    return option == Size || option == ScaledSize;
+}
+
+void QPsdHandler::setOption(ImageOption option, const QVariant &value)
+{
+    if (option == ScaledSize)
+        m_scaledSize = value.toSize();
 }
 
 QVariant QPsdHandler::option(ImageOption option) const
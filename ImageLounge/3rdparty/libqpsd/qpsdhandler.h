@@ -42,8 +42,13 @@ public:
     static bool canRead(QIODevice *device);
 
     QVariant option(ImageOption option) const;
-    //void setOption(ImageOption option, const QVariant &value);
+    void setOption(ImageOption option, const QVariant &value);
     bool supportsOption(ImageOption option) const;
+
+private:
+    bool readImage(QImage *image);
+
+    QSize m_scaledSize;
 };
 
 #endif // QPSDHANDLER_H
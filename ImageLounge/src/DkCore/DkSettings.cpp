@@ -41,6 +41,7 @@
 #include <QStyledItemDelegate>
 #include <QDir>
 #include <QApplication>
+#include <QThread>
 
 #ifdef Q_OS_WIN
 #include "Shobjidl.h"
@@ -158,6 +159,13 @@ void DkSettings::initFileFilters() {
 	app_p.rawFilters.append("Fujifilm Raw (*.raf)");
 
 	app_p.openFilters += app_p.rawFilters;
+
+	for (const QString& cFilter : app_p.rawFilters) {
+
+		QString s = cFilter.section(QRegExp("(\\(|\\))"), 1);
+		s = s.replace(")", "").replace("*.", "");
+		app_p.rawSuffixes += s.toLower().split(" ", QString::SkipEmptyParts);
+	}
 #endif
 
 	// stereo formats
@@ -421,9 +429,22 @@ void DkSettings::load() {
 	resources_p.waitForLastImg = settings.value("waitForLastImg", resources_p.waitForLastImg).toBool();
 	resources_p.filterRawImages = settings.value("filterRawImages", resources_p.filterRawImages).toBool();	
 	resources_p.loadRawThumb = settings.value("loadRawThumb", resources_p.loadRawThumb).toInt();	
+	resources_p.rawDecodeSize = settings.value("rawDecodeSize", resources_p.rawDecodeSize).toInt();
 	resources_p.filterDuplicats = settings.value("filterDuplicates", resources_p.filterDuplicats).toBool();
-	resources_p.preferredExtension = settings.value("preferredExtension", resources_p.preferredExtension).toString();	
+	resources_p.preferredExtensions = settings.value("preferredExtension", resources_p.preferredExtensions).toStringList();	
 	resources_p.gammaCorrection = settings.value("gammaCorrection", resources_p.gammaCorrection).toBool();
+	resources_p.cacheFolderIndex = settings.value("cacheFolderIndex", resources_p.cacheFolderIndex).toBool();
+	resources_p.maxThreads = settings.value("maxThreads", resources_p.maxThreads).toInt();
+	resources_p.maxThreadsImage = settings.value("maxThreadsImage", resources_p.maxThreadsImage).toInt();
+	resources_p.maxThreadsPrefetch = settings.value("maxThreadsPrefetch", resources_p.maxThreadsPrefetch).toInt();
+	resources_p.maxThreadsThumbs = settings.value("maxThreadsThumbs", resources_p.maxThreadsThumbs).toInt();
+	resources_p.maxThreadsOffscreenThumbs = settings.value("maxThreadsOffscreenThumbs", resources_p.maxThreadsOffscreenThumbs).toInt();
+	resources_p.maxThreadsBatch = settings.value("maxThreadsBatch", resources_p.maxThreadsBatch).toInt();
+	resources_p.mapFileBuffers = settings.value("mapFileBuffers", resources_p.mapFileBuffers).toBool();
+	resources_p.reducedJpgDecode = settings.value("reducedJpgDecode", resources_p.reducedJpgDecode).toBool();
+	resources_p.progressiveDisplay = settings.value("progressiveDisplay", resources_p.progressiveDisplay).toBool();
+	resources_p.maxDownloadSize = settings.value("maxDownloadSize", resources_p.maxDownloadSize).toInt();
+	resources_p.thumbCacheSize = settings.value("thumbCacheSize", resources_p.thumbCacheSize).toInt();
 
 	if (sync_p.switchModifier) {
 		global_p.altMod = Qt::ControlModifier;
@@ -671,12 +692,38 @@ void DkSettings::save(bool force) {
 		settings.setValue("filterRawImages", resources_p.filterRawImages);
 	if (!force && resources_p.loadRawThumb != resources_d.loadRawThumb)
 		settings.setValue("loadRawThumb", resources_p.loadRawThumb);
+	if (!force && resources_p.rawDecodeSize != resources_d.rawDecodeSize)
+		settings.setValue("rawDecodeSize", resources_p.rawDecodeSize);
 	if (!force && resources_p.filterDuplicats != resources_d.filterDuplicats)
 		settings.setValue("filterDuplicates", resources_p.filterDuplicats);
-	if (!force && resources_p.preferredExtension != resources_d.preferredExtension)
-		settings.setValue("preferredExtension", resources_p.preferredExtension);
+	if (!force && resources_p.preferredExtensions != resources_d.preferredExtensions)
+		settings.setValue("preferredExtension", resources_p.preferredExtensions);
 	if (!force && resources_p.gammaCorrection != resources_d.gammaCorrection)
 		settings.setValue("gammaCorrection", resources_p.gammaCorrection);
+	if (!force && resources_p.cacheFolderIndex != resources_d.cacheFolderIndex)
+		settings.setValue("cacheFolderIndex", resources_p.cacheFolderIndex);
+	if (!force && resources_p.maxThreads != resources_d.maxThreads)
+		settings.setValue("maxThreads", resources_p.maxThreads);
+	if (!force && resources_p.maxThreadsImage != resources_d.maxThreadsImage)
+		settings.setValue("maxThreadsImage", resources_p.maxThreadsImage);
+	if (!force && resources_p.maxThreadsPrefetch != resources_d.maxThreadsPrefetch)
+		settings.setValue("maxThreadsPrefetch", resources_p.maxThreadsPrefetch);
+	if (!force && resources_p.maxThreadsThumbs != resources_d.maxThreadsThumbs)
+		settings.setValue("maxThreadsThumbs", resources_p.maxThreadsThumbs);
+	if (!force && resources_p.maxThreadsOffscreenThumbs != resources_d.maxThreadsOffscreenThumbs)
+		settings.setValue("maxThreadsOffscreenThumbs", resources_p.maxThreadsOffscreenThumbs);
+	if (!force && resources_p.maxThreadsBatch != resources_d.maxThreadsBatch)
+		settings.setValue("maxThreadsBatch", resources_p.maxThreadsBatch);
+	if (!force && resources_p.mapFileBuffers != resources_d.mapFileBuffers)
+		settings.setValue("mapFileBuffers", resources_p.mapFileBuffers);
+	if (!force && resources_p.reducedJpgDecode != resources_d.reducedJpgDecode)
+		settings.setValue("reducedJpgDecode", resources_p.reducedJpgDecode);
+	if (!force && resources_p.progressiveDisplay != resources_d.progressiveDisplay)
+		settings.setValue("progressiveDisplay", resources_p.progressiveDisplay);
+	if (!force && resources_p.maxDownloadSize != resources_d.maxDownloadSize)
+		settings.setValue("maxDownloadSize", resources_p.maxDownloadSize);
+	if (!force && resources_p.thumbCacheSize != resources_d.thumbCacheSize)
+		settings.setValue("thumbCacheSize", resources_p.thumbCacheSize);
 	settings.endGroup();
 
 	// keep loaded settings in mind
@@ -801,12 +848,27 @@ void DkSettings::setToDefaultSettings() {
 	resources_p.maxImagesCached = 5;
 	resources_p.filterRawImages = true;
 	resources_p.loadRawThumb = raw_thumb_always;
+	resources_p.rawDecodeSize = raw_size_full;
 	resources_p.filterDuplicats = false;
-	resources_p.preferredExtension = "*.jpg";
+	resources_p.preferredExtensions = QStringList() << "*.jpg";
 	resources_p.numThumbsLoading = 0;
 	resources_p.maxThumbsLoading = 5;
 	resources_p.gammaCorrection = true;
 	resources_p.waitForLastImg = true;
+	resources_p.cacheFolderIndex = true;
+
+	int numCores = qMax(QThread::idealThreadCount(), 2);
+	resources_p.maxThreads = numCores;
+	resources_p.maxThreadsImage = 2;
+	resources_p.maxThreadsPrefetch = qMax(numCores/2, 1);
+	resources_p.maxThreadsThumbs = numCores;
+	resources_p.maxThreadsOffscreenThumbs = qMax(numCores/2, 1);
+	resources_p.maxThreadsBatch = numCores;
+	resources_p.mapFileBuffers = false;
+	resources_p.reducedJpgDecode = true;
+	resources_p.progressiveDisplay = true;
+	resources_p.maxDownloadSize = 512;
+	resources_p.thumbCacheSize = 256;
 
 	qDebug() << "ok... default settings are set";
 }
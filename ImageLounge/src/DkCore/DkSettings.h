@@ -111,6 +111,14 @@ public:
 		raw_thumb_end,
 	};
 
+	enum rawSize {
+		raw_size_full,
+		raw_size_half,		// 2x2 bayer binning
+		raw_size_quarter,	// 4x4 bayer binning
+
+		raw_size_end,
+	};
+
 	enum keepZoom {
 		zoom_always_keep,
 		zoom_keep_same_size,
@@ -158,6 +166,7 @@ public:
 		QStringList openFilters;	// for open dialog
 		QStringList saveFilters;	// for save dialog
 		QStringList rawFilters;
+		QStringList rawSuffixes;	// lower case, without "*."
 		QStringList containerFilters;
 		QString containerRawFilters;
 	};
@@ -254,10 +263,23 @@ public:
 		bool filterRawImages;
 		bool filterDuplicats;
 		int loadRawThumb;
-		QString preferredExtension;
+		int rawDecodeSize;				// binning if RAWs are just displayed (see rawSize)
+		QStringList preferredExtensions;	// priority list used if duplicates are filtered
 		int numThumbsLoading;
 		int maxThumbsLoading;
 		bool gammaCorrection;
+		bool cacheFolderIndex;
+		int maxThreads;					// loader threads (the visible image is not counted)
+		int maxThreadsImage;
+		int maxThreadsPrefetch;
+		int maxThreadsThumbs;
+		int maxThreadsOffscreenThumbs;
+		int maxThreadsBatch;
+		bool mapFileBuffers;			// map large local files instead of copying them (opt-in: truncating a mapped file raises SIGBUS)
+		bool reducedJpgDecode;			// decode jpgs at screen resolution until we zoom in
+		bool progressiveDisplay;		// show embedded previews while RAWs & large jpgs are decoded (or downloaded)
+		int maxDownloadSize;			// MB - larger downloads are canceled
+		int thumbCacheSize;				// MB - size of the persistent thumbnail cache (0 disables it)
 	};
 
 	//enums for checkboxes - divide in camera data and description
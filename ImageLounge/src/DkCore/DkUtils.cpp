@@ -214,6 +214,48 @@ bool DkUtils::naturalCompare(const QString &s1, const QString &s2, Qt::CaseSensi
 	return QString::compare(s1, s2, cs) < 0;
 }
 
+/**
+ * Returns a key that sorts naturally with a plain string compare.
+ * The key is lower case and all numbers are prefixed with their (zero-padded) length:
+ * img2.png -> img0012.png < img00210.png <- img10.png
+ * Numbers of any length are sorted by their magnitude - longer numbers are larger.
+ * Hence, the expensive natural compare is done once per file rather than once per comparison.
+ * @param str the string (e.g. a file name)
+ * @return QString the sort key
+ **/ 
+QString DkUtils::naturalSortKey(const QString& str) {
+
+	const int lenDigits = 3;	// file names have at most 255 characters
+
+	QString lStr = str.toLower();
+	QString key;
+	key.reserve(lStr.size() + 4*lenDigits);
+
+	for (int idx = 0; idx < lStr.size();) {
+
+		if (!lStr[idx].isDigit()) {
+			key.append(lStr[idx]);
+			idx++;
+			continue;
+		}
+
+		int end = idx;
+		while (end < lStr.size() && lStr[end].isDigit())
+			end++;
+
+		// skip leading zeros (but keep the last digit)
+		while (idx < end-1 && lStr[idx] == '0')
+			idx++;
+
+		int len = end - idx;
+		key.append(QString("%1").arg(len, lenDigits, 10, QChar('0')));
+		key.append(lStr.midRef(idx, len));
+		idx = end;
+	}
+
+	return key;
+}
+
 QString DkUtils::getLongestNumber(const QString& str, int startIdx) {
 
 	int idx;
@@ -257,11 +299,6 @@ bool DkUtils::compFilenameInv(const QFileInfo& lhf, const QFileInfo& rhf) {
 	return !compFilename(lhf, rhf);
 }
 
-bool DkUtils::compRandom(const QFileInfo&, const QFileInfo&) {
-
-	return qrand() % 2 != 0;
-}
-
 void DkUtils::addLanguages(QComboBox* langCombo, QStringList& languages) {
 
 	QDir qmDir = qApp->applicationDirPath();
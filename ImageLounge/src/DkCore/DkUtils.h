@@ -125,10 +125,10 @@ public:
 
 	static bool compDateModifiedInv(const QFileInfo& lhf, const QFileInfo& rhf);
 
-	static bool compRandom(const QFileInfo& lhf, const QFileInfo& rhf);
-
 	static bool naturalCompare(const QString& s1, const QString& s2, Qt::CaseSensitivity cs = Qt::CaseSensitive);
 
+	static QString naturalSortKey(const QString& str);
+
 	static QString getLongestNumber(const QString& str, int startIdx = 0);
 
 	static void addLanguages(QComboBox* langCombo, QStringList& languages);
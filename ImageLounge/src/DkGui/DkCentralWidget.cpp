@@ -725,7 +725,7 @@ void DkCentralWidget::showViewPort(bool show /* = true */) {
 
 	if (show) {
 		if (getCurrentImage())
-			mViewport->setImage(getCurrentImage()->image());
+			mViewport->setImage(getCurrentImage()->displayImage());
 		switchWidget(mWidgets[viewport_widget]);
 	}
 	else 
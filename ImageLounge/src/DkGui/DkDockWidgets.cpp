@@ -34,6 +34,12 @@
 #pragma warning(push, 0)	// no warnings from includes
 #include <QVBoxLayout>
 #include <QListWidget>
+#include <QLabel>
+#include <QPushButton>
+#include <QScrollArea>
+#include <QTimer>
+#include <QFileDialog>
+#include <QDateTime>
 #pragma warning(pop)
 
 namespace nmc {
@@ -99,4 +105,84 @@ void DkHistoryDock::on_historyList_itemClicked(QListWidgetItem* item) {
 
 }
 
-}
\ No newline at end of file
+// DkLoaderStatsDock --------------------------------------------------------------------
+DkLoaderStatsDock::DkLoaderStatsDock(const QString& title, QWidget* parent) : DkDockWidget(title, parent) {
+
+	setObjectName("statsDock");
+	
+	mUpdateTimer = new QTimer(this);
+	mUpdateTimer->setInterval(1000);
+	connect(mUpdateTimer, SIGNAL(timeout()), this, SLOT(updateStats()));
+	connect(this, SIGNAL(visibleSignal(bool)), this, SLOT(setUpdating(bool)));
+	
+	createLayout();
+	QMetaObject::connectSlotsByName(this);
+}
+
+void DkLoaderStatsDock::createLayout() {
+
+	mStatsLabel = new QLabel(this);
+	mStatsLabel->setFont(QFont("Courier"));
+	mStatsLabel->setAlignment(Qt::AlignTop | Qt::AlignLeft);
+	mStatsLabel->setTextInteractionFlags(Qt::TextSelectableByMouse);
+
+	QScrollArea* scrollArea = new QScrollArea(this);
+	scrollArea->setWidgetResizable(true);
+	scrollArea->setWidget(mStatsLabel);
+
+	QPushButton* resetButton = new QPushButton(tr("&Reset"), this);
+	resetButton->setObjectName("resetButton");
+
+	QPushButton* saveButton = new QPushButton(tr("&Save JSON..."), this);
+	saveButton->setObjectName("saveButton");
+
+	QWidget* buttonWidget = new QWidget(this);
+	QHBoxLayout* bLayout = new QHBoxLayout(buttonWidget);
+	bLayout->setContentsMargins(0, 0, 0, 0);
+	bLayout->addStretch();
+	bLayout->addWidget(resetButton);
+	bLayout->addWidget(saveButton);
+
+	QWidget* contentWidget = new QWidget(this);
+	QVBoxLayout* layout = new QVBoxLayout(contentWidget);
+	layout->addWidget(scrollArea);
+	layout->addWidget(buttonWidget);
+
+	setWidget(contentWidget);
+}
+
+void DkLoaderStatsDock::updateStats() {
+
+	mStatsLabel->setText(DkLoaderStats::instance().toString());
+}
+
+void DkLoaderStatsDock::on_resetButton_clicked() {
+
+	DkLoaderStats::instance().reset();
+	updateStats();
+}
+
+void DkLoaderStatsDock::on_saveButton_clicked() {
+
+	QString defaultName = "nomacs-loader-stats-" + QDateTime::currentDateTime().toString("yyyy-MM-dd-hhmmss") + ".json";
+	QString filePath = QFileDialog::getSaveFileName(this, tr("Save Loader Statistics"), 
+		QFileInfo(Settings::param().global().lastDir, defaultName).absoluteFilePath(), 
+		tr("JSON (*.json)"));
+
+	if (filePath.isEmpty())
+		return;
+
+	DkLoaderStats::instance().saveJson(filePath);
+}
+
+void DkLoaderStatsDock::setUpdating(bool updating) {
+
+	if (updating) {
+		updateStats();
+		mUpdateTimer->start();
+	}
+	else
+		mUpdateTimer->stop();
+}
+
+}
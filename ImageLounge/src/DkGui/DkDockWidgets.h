@@ -47,6 +47,8 @@
 // Qt defines
 class QListWidget;
 class QListWidgetItem;
+class QLabel;
+class QTimer;
 
 namespace nmc {
 
@@ -70,4 +72,27 @@ protected:
 
 };
 
+/**
+ * Shows the loader statistics (cache hits, read & decode times).
+ * The statistics are refreshed every second while the dock is visible.
+ **/ 
+class DllGuiExport DkLoaderStatsDock : public DkDockWidget {
+	Q_OBJECT
+
+public:
+	DkLoaderStatsDock(const QString& title = "", QWidget* parent = 0);
+
+public slots:
+	void updateStats();
+	void on_resetButton_clicked();
+	void on_saveButton_clicked();
+	void setUpdating(bool updating);
+
+protected:
+	void createLayout();
+
+	QLabel* mStatsLabel = 0;
+	QTimer* mUpdateTimer = 0;
+};
+
 }
\ No newline at end of file
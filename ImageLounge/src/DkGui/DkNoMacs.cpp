@@ -419,6 +419,7 @@ void DkNoMacs::createActions() {
 	connect(am.action(DkActionManager::menu_panel_explorer), SIGNAL(toggled(bool)), this, SLOT(showExplorer(bool)));
 	connect(am.action(DkActionManager::menu_panel_metadata_dock), SIGNAL(toggled(bool)), this, SLOT(showMetaDataDock(bool)));
 	connect(am.action(DkActionManager::menu_panel_history), SIGNAL(toggled(bool)), this, SLOT(showHistoryDock(bool)));
+	connect(am.action(DkActionManager::menu_panel_loader_stats), SIGNAL(toggled(bool)), this, SLOT(showLoaderStatsDock(bool)));
 	connect(am.action(DkActionManager::menu_panel_preview), SIGNAL(toggled(bool)), this, SLOT(showThumbsDock(bool)));
 
 	connect(am.action(DkActionManager::menu_view_fit_frame), SIGNAL(triggered()), this, SLOT(fitFrame()));
@@ -795,6 +796,9 @@ void DkNoMacs::flipImageHorizontal() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
+	if (!vp->requestFullResolution([this]() { flipImageHorizontal(); }))
+		return;
+
 	QImage img = vp->getImage();
 	img = img.mirrored(true, false);
 
@@ -813,6 +817,9 @@ void DkNoMacs::flipImageVertical() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
+	if (!vp->requestFullResolution([this]() { flipImageVertical(); }))
+		return;
+
 	QImage img = vp->getImage();
 	img = img.mirrored(false, true);
 
@@ -832,6 +839,9 @@ void DkNoMacs::invertImage() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
+	if (!vp->requestFullResolution([this]() { invertImage(); }))
+		return;
+
 	QImage img = vp->getImage();
 	img.invertPixels();
 
@@ -851,6 +861,9 @@ void DkNoMacs::convert2gray() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
+	if (!vp->requestFullResolution([this]() { convert2gray(); }))
+		return;
+
 	QImage img = vp->getImage();
 
 	QVector<QRgb> table(256);
@@ -874,6 +887,9 @@ void DkNoMacs::normalizeImage() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
+	if (!vp->requestFullResolution([this]() { normalizeImage(); }))
+		return;
+
 	QImage img = vp->getImage();
 	
 	bool normalized = DkImage::normImage(img);
@@ -893,6 +909,9 @@ void DkNoMacs::autoAdjustImage() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
+	if (!vp->requestFullResolution([this]() { autoAdjustImage(); }))
+		return;
+
 	QImage img = vp->getImage();
 
 	bool normalized = DkImage::autoAdjustImage(img);
@@ -907,6 +926,9 @@ void DkNoMacs::unsharpMask() {
 #ifdef WITH_OPENCV
 	viewport()->getController()->applyPluginChanges(true);
 
+	if (!viewport()->requestFullResolution([this]() { unsharpMask(); }))
+		return;
+
 	DkUnsharpDialog* unsharpDialog = new DkUnsharpDialog(this);
 	unsharpDialog->setImage(viewport()->getImage());
 	int answer = unsharpDialog->exec();
@@ -925,6 +947,9 @@ void DkNoMacs::tinyPlanet() {
 	
 	viewport()->getController()->applyPluginChanges(true);
 
+	if (!viewport()->requestFullResolution([this]() { tinyPlanet(); }))
+		return;
+
 	DkTinyPlanetDialog* tinyPlanetDialog = new DkTinyPlanetDialog(this);
 	tinyPlanetDialog->setImage(viewport()->getImage());
 	
@@ -1340,6 +1365,18 @@ void DkNoMacs::showHistoryDock(bool show, bool saveSettings) {
 		mHistoryDock->updateImage(getTabWidget()->getCurrentImage());
 }
 
+void DkNoMacs::showLoaderStatsDock(bool show) {
+
+	if (!mLoaderStatsDock) {
+
+		mLoaderStatsDock = new DkLoaderStatsDock(tr("Loader Statistics"), this);
+		mLoaderStatsDock->registerAction(DkActionManager::instance().action(DkActionManager::menu_panel_loader_stats));
+		addDockWidget(mLoaderStatsDock->getDockLocationSettings(Qt::RightDockWidgetArea), mLoaderStatsDock);
+	}
+
+	mLoaderStatsDock->setVisible(show, false);
+}
+
 void DkNoMacs::showThumbsDock(bool show) {
 
 	
@@ -1680,6 +1717,9 @@ void DkNoMacs::saveFileAs(bool silent) {
 	
 	qDebug() << "saving...";
 
+	if (!getTabWidget()->getViewPort()->requestFullResolution([this, silent]() { saveFileAs(silent); }))
+		return;
+
 	// TODO: move to current image loader
 	if (getTabWidget()->getCurrentImageLoader())
 		getTabWidget()->getCurrentImageLoader()->saveUserFileAs(getTabWidget()->getViewPort()->getImage(), silent);
@@ -1687,6 +1727,9 @@ void DkNoMacs::saveFileAs(bool silent) {
 
 void DkNoMacs::saveFileWeb() {
 
+	if (!getTabWidget()->getViewPort()->requestFullResolution([this]() { saveFileWeb(); }))
+		return;
+
 	// TODO: move to current image loader
 	if (getTabWidget()->getCurrentImageLoader())
 		getTabWidget()->getCurrentImageLoader()->saveFileWeb(getTabWidget()->getViewPort()->getImage());
@@ -1699,6 +1742,9 @@ void DkNoMacs::resizeImage() {
 
 	viewport()->getController()->applyPluginChanges(true);
 
+	if (!viewport()->requestFullResolution([this]() { resizeImage(); }))
+		return;
+
 	if (!mResizeDialog)
 		mResizeDialog = new DkResizeDialog(this);
 
@@ -1813,6 +1859,9 @@ void DkNoMacs::openImgManipulationDialog() {
 	if (!viewport() || viewport()->getImage().isNull())
 		return;
 
+	if (!viewport()->requestFullResolution([this]() { openImgManipulationDialog(); }))
+		return;
+
 	if (!mImgManipulationDialog)
 		mImgManipulationDialog = new DkImageManipulationDialog(this);
 	else 
@@ -1876,6 +1925,9 @@ void DkNoMacs::printDialog() {
 	if (imgC)
 		res = imgC->getMetaData()->getResolution();
 
+	if (!viewport()->requestFullResolution([this]() { printDialog(); }))
+		return;
+
 	//QPrintPreviewDialog* previewDialog = new QPrintPreviewDialog();
 	QImage img = viewport()->getImage();
 	if (!mPrintPreviewDialog)
@@ -2256,7 +2308,7 @@ void DkNoMacs::setWindowTitle(QSharedPointer<DkImageContainerT> imgC) {
 		return;
 	}
 
-	setWindowTitle(imgC->filePath(), imgC->image().size(), imgC->isEdited(), imgC->getTitleAttribute());
+	setWindowTitle(imgC->filePath(), imgC->imageSize(), imgC->isEdited(), imgC->getTitleAttribute());
 }
 
 void DkNoMacs::setWindowTitle(const QString& filePath, const QSize& size, bool edited, const QString& attr) {
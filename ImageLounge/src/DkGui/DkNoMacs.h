@@ -75,6 +75,7 @@ class DkArchiveExtractionDialog;
 class DkExplorer;
 class DkMetaDataDock;
 class DkHistoryDock;
+class DkLoaderStatsDock;
 class DkExportTiffDialog;
 class DkImageManipulationDialog;
 class DkUpdater;
@@ -172,6 +173,7 @@ public slots:
 	void showExplorer(bool show, bool saveSettings = true);
 	void showMetaDataDock(bool show, bool saveSettings = true);
 	void showHistoryDock(bool show, bool saveSettings = true);
+	void showLoaderStatsDock(bool show);
 	void showThumbsDock(bool show);
 	void thumbsDockAreaChanged();
 	void showRecentFiles(bool show = true);
@@ -314,6 +316,7 @@ protected:
 	DkExplorer* mExplorer = 0;
 	DkMetaDataDock* mMetaDataDock = 0;
 	DkHistoryDock* mHistoryDock = 0;
+	DkLoaderStatsDock* mLoaderStatsDock = 0;
 	DkDockWidget* mThumbsDock = 0;
 	DkExportTiffDialog* mExportTiffDialog = 0;
 	DkThumbsSaver* mThumbSaver = 0;
@@ -1045,6 +1045,24 @@ void DkAdvancedPreference::createLayout() {
 	loadRawButtonGroup->addButton(loadRawButtons[DkSettings::raw_thumb_if_large], DkSettings::raw_thumb_if_large);
 	loadRawButtonGroup->addButton(loadRawButtons[DkSettings::raw_thumb_never], DkSettings::raw_thumb_never);
 
+	// RAW decode size radio buttons
+	QVector<QRadioButton*> rawSizeButtons;
+	rawSizeButtons.resize(DkSettings::raw_size_end);
+	rawSizeButtons[DkSettings::raw_size_full] = new QRadioButton(tr("Decode RAW Data at Full Size"), this);
+	rawSizeButtons[DkSettings::raw_size_half] = new QRadioButton(tr("Decode RAW Data at Half Size until Zoomed"), this);
+	rawSizeButtons[DkSettings::raw_size_quarter] = new QRadioButton(tr("Decode RAW Data at Quarter Size until Zoomed"), this);
+	rawSizeButtons[DkSettings::raw_size_half]->setToolTip(tr("Fast culling: pixels are binned instead of demosaiced if the screen is smaller than the image"));
+	rawSizeButtons[DkSettings::raw_size_quarter]->setToolTip(rawSizeButtons[DkSettings::raw_size_half]->toolTip());
+
+	// check wrt the current settings
+	rawSizeButtons[Settings::param().resources().rawDecodeSize]->setChecked(true);
+
+	QButtonGroup* rawSizeButtonGroup = new QButtonGroup(this);
+	rawSizeButtonGroup->setObjectName("rawSize");
+	rawSizeButtonGroup->addButton(rawSizeButtons[DkSettings::raw_size_full], DkSettings::raw_size_full);
+	rawSizeButtonGroup->addButton(rawSizeButtons[DkSettings::raw_size_half], DkSettings::raw_size_half);
+	rawSizeButtonGroup->addButton(rawSizeButtons[DkSettings::raw_size_quarter], DkSettings::raw_size_quarter);
+
 	QCheckBox* cbFilterRaw = new QCheckBox(tr("Apply Noise Filtering to RAW Images"), this);
 	cbFilterRaw->setObjectName("filterRaw");
 	cbFilterRaw->setToolTip(tr("If checked, a noise filter is applied which reduced color noise"));
@@ -1055,6 +1073,10 @@ void DkAdvancedPreference::createLayout() {
 	loadRawGroup->addWidget(loadRawButtons[DkSettings::raw_thumb_if_large]);
 	loadRawGroup->addWidget(loadRawButtons[DkSettings::raw_thumb_never]);
 	loadRawGroup->addSpace();
+	loadRawGroup->addWidget(rawSizeButtons[DkSettings::raw_size_full]);
+	loadRawGroup->addWidget(rawSizeButtons[DkSettings::raw_size_half]);
+	loadRawGroup->addWidget(rawSizeButtons[DkSettings::raw_size_quarter]);
+	loadRawGroup->addSpace();
 	loadRawGroup->addWidget(cbFilterRaw);
 
 	// file loading
@@ -1090,6 +1112,12 @@ void DkAdvancedPreference::on_loadRaw_buttonClicked(int buttonId) const {
 		Settings::param().resources().loadRawThumb = buttonId;
 }
 
+void DkAdvancedPreference::on_rawSize_buttonClicked(int buttonId) const {
+
+	if (Settings::param().resources().rawDecodeSize != buttonId)
+		Settings::param().resources().rawDecodeSize = buttonId;
+}
+
 void DkAdvancedPreference::on_filterRaw_toggled(bool checked) const {
 
 	if (Settings::param().resources().filterRawImages != checked)
@@ -251,6 +251,7 @@ public:
 
 public slots:
 	void on_loadRaw_buttonClicked(int buttonId) const;
+	void on_rawSize_buttonClicked(int buttonId) const;
 	void on_filterRaw_toggled(bool checked) const;
 	void on_saveDeleted_toggled(bool checked) const;
 	void on_ignoreExif_toggled(bool checked) const;
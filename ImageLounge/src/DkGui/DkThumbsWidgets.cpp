@@ -30,6 +30,7 @@
 #include "DkTimer.h"
 #include "DkImageContainer.h"
 #include "DkImageStorage.h"
+#include "DkBasicLoader.h"
 #include "DkSettings.h"
 #include "DkImageLoader.h"
 #include "DkActionManager.h"
@@ -56,6 +57,8 @@
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QMimeData>
+#include <QSet>
+#include <algorithm>
 #pragma warning(pop)		// no warnings from includes - end
 
 namespace nmc {
@@ -292,7 +295,7 @@ void DkFilePreview::drawThumbs(QPainter* painter) {
 		
 		// if the image is loaded draw that (it might be edited)
 		if (mThumbs.at(idx)->hasImage()) {
-			img = mThumbs.at(idx)->image();
+			img = mThumbs.at(idx)->displayImage();
 		}
 		else {
 
@@ -302,7 +305,7 @@ void DkFilePreview::drawThumbs(QPainter* painter) {
 			}
 
 			if (thumb->hasImage() == DkThumbNail::loaded)
-				img = thumb->getImage();
+				img = thumb->getImage(orientation == Qt::Horizontal ? height()-yOffset : width()-yOffset);
 		}
 
 		QPointF anchor = orientation == Qt::Horizontal ? bufferDim.topRight() : bufferDim.bottomLeft();
@@ -568,7 +571,7 @@ void DkFilePreview::mouseMoveEvent(QMouseEvent *event) {
 			if (worldMatrix.mapRect(thumbRects.at(idx)).contains(event->pos())) {
 				selected = idx;
 
-				if (selected <= mThumbs.size() && selected >= 0) {
+				if (selected <= mThumbs.size() && selected >= 0 && selected != oldSelection) {
 					QSharedPointer<DkThumbNailT> thumb = mThumbs.at(selected)->getThumb();
 					//selectedImg = DkImage::colorizePixmap(QPixmap::fromImage(thumb->getImage()), Settings::param().display().highlightColor, 0.3f);
 
@@ -579,6 +582,11 @@ void DkFilePreview::mouseMoveEvent(QMouseEvent *event) {
 					QString toolTipInfo = tr("Name: ") + fileInfo.fileName() + 
 						"\n" + tr("Size: ") + DkUtils::readableByte((float)fileInfo.size()) + 
 						"\n" + tr("Created: ") + fileInfo.created().toString(Qt::SystemLocaleDate);
+
+					QSize s = DkImageHeader::read(thumb->getFilePath()).orientedSize();
+					if (!s.isEmpty())
+						toolTipInfo += "\n" + tr("Dimension: ") + QString("%1 x %2").arg(s.width()).arg(s.height());
+
 					setToolTip(toolTipInfo);
 					setStatusTip(fileInfo.fileName());
 				}
@@ -864,7 +872,6 @@ void DkFilePreview::setVisible(bool visible) {
 DkThumbLabel::DkThumbLabel(QSharedPointer<DkThumbNailT> thumb, QGraphicsItem* parent) : QGraphicsObject(parent), mText(this) {
 
 	mThumbInitialized = false;
-	mFetchingThumb = false;
 	mIsHovered = false;
 
 	//imgLabel = new QLabel(this);
@@ -873,8 +880,8 @@ DkThumbLabel::DkThumbLabel(QSharedPointer<DkThumbNailT> thumb, QGraphicsItem* pa
 	//imgLabel->setScaledContents(true);
 	//imgLabel->setFixedSize(10,10);
 	//setStyleSheet("QLabel{background: transparent;}");
+	// the scene handles selections (labels are recycled)
 	setThumb(thumb);
-	setFlag(ItemIsSelectable, true);
 	//setFlag(ItemIsMovable, true);	// uncomment this - it's fun : )
 
 	//setFlag(QGraphicsItem::ItemIsSelectable, false);
@@ -888,9 +895,23 @@ DkThumbLabel::DkThumbLabel(QSharedPointer<DkThumbNailT> thumb, QGraphicsItem* pa
 
 DkThumbLabel::~DkThumbLabel() {}
 
-void DkThumbLabel::setThumb(QSharedPointer<DkThumbNailT> thumb) {
+/**
+ * Assigns a thumbnail to the label.
+ * Labels are recycled by the scene, so all states of the former thumbnail are reset.
+ * @param thumb the thumbnail.
+ * @param thumbIdx the thumbnail's index in the scene.
+ **/ 
+void DkThumbLabel::setThumb(QSharedPointer<DkThumbNailT> thumb, int thumbIdx) {
+
+	if (mThumb)
+		disconnect(mThumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(updateLabel()));
 
-	this->mThumb = thumb;
+	mThumb = thumb;
+	mThumbIdx = thumbIdx;
+	mThumbInitialized = false;
+	mIsHovered = false;
+	mMipSize = 0;
+	mIcon.setPixmap(QPixmap());
 
 	if (thumb.isNull())
 		return;
@@ -903,6 +924,7 @@ void DkThumbLabel::setThumb(QSharedPointer<DkThumbNailT> thumb) {
 		"\n" + tr("Created: ") + fileInfo.created().toString(Qt::SystemLocaleDate);
 
 	setToolTip(toolTipInfo);
+	mToolTipComplete = false;
 
 	// style dummy
 	mNoImagePen.setColor(QColor(150,150,150));
@@ -913,6 +935,25 @@ void DkThumbLabel::setThumb(QSharedPointer<DkThumbNailT> thumb) {
 	mSelectBrush = col;
 	mSelectPen.setColor(Settings::param().display().highlightColor);
 	//selectPen.setWidth(2);
+
+	// do not wait for paint() if the thumb is loaded already
+	if (thumb->hasImage() == DkThumbNail::loaded || thumb->hasImage() == DkThumbNail::exists_not) {
+		updateLabel();
+		mThumbInitialized = true;
+	}
+}
+
+void DkThumbLabel::setThumbSelected(bool selected) {
+
+	if (mSelected != selected) {
+		mSelected = selected;
+		update();
+	}
+}
+
+bool DkThumbLabel::isThumbSelected() const {
+
+	return mSelected;
 }
 
 QPixmap DkThumbLabel::pixmap() const {
@@ -939,10 +980,12 @@ void DkThumbLabel::updateLabel() {
 		return;
 
 	QPixmap pm;
+	QImage img = mThumb->getImage(Settings::param().display().thumbPreviewSize);
+	mMipSize = qMax(img.width(), img.height());
 
-	if (!mThumb->getImage().isNull()) {
+	if (!img.isNull()) {
 
-		pm = QPixmap::fromImage(mThumb->getImage());
+		pm = QPixmap::fromImage(img);
 
 		if (Settings::param().display().displaySquaredThumbs) {
 			QRect r(QPoint(), pm.size());
@@ -965,11 +1008,7 @@ void DkThumbLabel::updateLabel() {
 	if (!pm.isNull()) {
 		mIcon.setTransformationMode(Qt::SmoothTransformation);
 		mIcon.setPixmap(pm);
-		mIcon.setFlag(ItemIsSelectable, true);
-		//QFlags<enum> f;
 	}
-	if (pm.isNull())
-		setFlag(ItemIsSelectable, false);	// if we cannot load it -> disable selection
 
 	// update label
 	mText.setPos(0, pm.height());
@@ -991,11 +1030,28 @@ void DkThumbLabel::updateSize() {
 	if (mIcon.pixmap().isNull())
 		return;
 
+	int ps = Settings::param().display().thumbPreviewSize;
+
+	QImage img = mThumb->getImage(ps);
+
+	// the thumbnail would be upscaled -> load the large mip level (once)
+	// fully decoded thumbnails have it already - so just EXIF thumbnails are read again
+	if (qMax(img.width(), img.height()) < ps && mThumb->getMaxThumbSize() < DkThumbNail::mip_large && mThumb->hasImage() == DkThumbNail::loaded) {
+		mThumb->setMaxThumbSize(DkThumbNail::mip_large);
+		mThumb->setMinThumbSize(qMin(ps, (int)DkThumbNail::mip_large));
+		mThumb->fetchThumb();
+	}
+
+	// another mip level fits better
+	if (qMax(img.width(), img.height()) != mMipSize) {
+		updateLabel();
+		return;
+	}
+
 	prepareGeometryChange();
 
 	// resize pixmap label
 	int maxSize = qMax(mIcon.pixmap().width(), mIcon.pixmap().height());
-	int ps = Settings::param().display().thumbPreviewSize;
 
 	if ((float)ps/maxSize != mIcon.scale()) {
 		mIcon.setScale(1.0f);
@@ -1033,6 +1089,15 @@ void DkThumbLabel::hoverEnterEvent(QGraphicsSceneHoverEvent*) {
 
 	mIsHovered = true;
 	emit showFileSignal(mThumb->getFilePath());
+
+	// reading the header of all thumbs would be too slow
+	if (!mToolTipComplete) {
+		QSize s = DkImageHeader::read(mThumb->getFilePath()).orientedSize();
+		if (!s.isEmpty())
+			setToolTip(toolTip() + "\n" + tr("Dimension: ") + QString("%1 x %2").arg(s.width()).arg(s.height()));
+		mToolTipComplete = true;
+	}
+
 	update();
 }
 
@@ -1051,12 +1116,8 @@ void DkThumbLabel::setVisible(bool visible) {
 
 void DkThumbLabel::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) {
 	
-	if (!mFetchingThumb && mThumb->hasImage() == DkThumbNail::not_loaded && 
-		Settings::param().resources().numThumbsLoading < Settings::param().resources().maxThumbsLoading*2) {
-			mThumb->fetchThumb();
-			mFetchingThumb = true;
-	}
-	else if (!mThumbInitialized && (mThumb->hasImage() == DkThumbNail::loaded || mThumb->hasImage() == DkThumbNail::exists_not)) {
+	// thumbs are requested by the view (see DkThumbsView::fetchThumbs)
+	if (!mThumbInitialized && (mThumb->hasImage() == DkThumbNail::loaded || mThumb->hasImage() == DkThumbNail::exists_not)) {
 		updateLabel();
 		mThumbInitialized = true;
 		return;		// exit - otherwise we get paint errors
@@ -1126,7 +1187,7 @@ void DkThumbLabel::paint(QPainter* painter, const QStyleOptionGraphicsItem* opti
 	}
 
 	// render selected
-	if (isSelected()) {
+	if (mSelected) {
 		painter->setBrush(mSelectBrush);
 		painter->setPen(mSelectPen);
 		painter->drawRect(boundingRect());
@@ -1141,9 +1202,14 @@ DkThumbScene::DkThumbScene(QWidget* parent /* = 0 */) : QGraphicsScene(parent) {
 
 }
 
+/**
+ * Computes the grid.
+ * The layout is computed arithmetically - labels exist for the visible thumbnails only
+ * (see updateVisibleLabels).
+ **/ 
 void DkThumbScene::updateLayout() {
 
-	if (mThumbLabels.empty())
+	if (mThumbs.empty())
 		return;
 
 	QSize pSize;
@@ -1153,68 +1219,100 @@ void DkThumbScene::updateLayout() {
 
 	mXOffset = qCeil(Settings::param().display().thumbPreviewSize*0.1f);
 	mNumCols = qMax(qFloor(((float)pSize.width()-mXOffset)/(Settings::param().display().thumbPreviewSize + mXOffset)), 1);
-	mNumCols = qMin(mThumbLabels.size(), mNumCols);
-	mNumRows = qCeil((float)mThumbLabels.size()/mNumCols);
+	mNumCols = qMin(mThumbs.size(), mNumCols);
+	mNumRows = qCeil((float)mThumbs.size()/mNumCols);
 
 	qDebug() << "num rows x num cols: " << mNumCols*mNumRows;
-	qDebug() << " thumb labels size: " << mThumbLabels.size();
 
 	int tso = Settings::param().display().thumbPreviewSize+mXOffset;
 	setSceneRect(0, 0, mNumCols*tso+mXOffset, mNumRows*tso+mXOffset);
-	//int fileIdx = thumbPool->getCurrentFileIdx();
 
 	DkTimer dt;
-	int cYOffset = mXOffset;
 
-	for (int rIdx = 0; rIdx < mNumRows; rIdx++) {
+	for (auto it = mThumbLabels.begin(); it != mThumbLabels.end(); it++) {
+		it.value()->setPos(thumbRect(it.key()).topLeft());
+		it.value()->updateSize();
+	}
 
-		int cXOffset = mXOffset;
+	qDebug() << "moving takes: " << dt.getTotal();
 
-		for (int cIdx = 0; cIdx < mNumCols; cIdx++) {
+	// show the (last) selected thumb
+	for (int idx = mSelection.size()-1; idx >= 0; idx--) {
 
-			int tIdx = rIdx*mNumCols+cIdx;
+		if (mSelection.testBit(idx)) {
+			ensureVisible(idx);
+			break;
+		}
+	}
 
-			if (tIdx < 0 || tIdx >= mThumbLabels.size())
-				break;
+	updateVisibleLabels();
+
+	mFirstLayout = false;
+}
 
-			DkThumbLabel* cLabel = mThumbLabels.at(tIdx);
-			cLabel->setPos(cXOffset, cYOffset);
-			cLabel->updateSize();
+/**
+ * Creates labels for the visible thumbnails (plus a margin of two rows)
+ * and recycles the labels of thumbnails that were scrolled out of view.
+ **/ 
+void DkThumbScene::updateVisibleLabels() {
 
-			//if (tIdx == fileIdx)
-			//	cLabel->ensureVisible();
+	if (views().empty() || mNumCols <= 0)
+		return;
 
-			//cLabel->show();
+	QGraphicsView* view = views().first();
+	int tso = Settings::param().display().thumbPreviewSize+mXOffset;
+	QRectF vr = view->mapToScene(view->viewport()->rect()).boundingRect();
+	vr.adjust(0, -2*tso, 0, 2*tso);
 
-			cXOffset += Settings::param().display().thumbPreviewSize + mXOffset;
-		}
+	QVector<int> indices = thumbIndices(vr);
+
+	QSet<int> visible;
+	for (int idx : indices)
+		visible.insert(idx);
 
-		// update ypos
-		cYOffset += Settings::param().display().thumbPreviewSize + mXOffset;	// 20 for label 
+	// recycle
+	for (auto it = mThumbLabels.begin(); it != mThumbLabels.end();) {
+
+		if (!visible.contains(it.key())) {
+			it.value()->hide();
+			it.value()->setThumb(QSharedPointer<DkThumbNailT>());
+			mFreeLabels << it.value();
+			it = mThumbLabels.erase(it);
+		}
+		else
+			it++;
 	}
 
-	qDebug() << "moving takes: " << dt.getTotal();
+	for (int idx : indices) {
 
-	for (int idx = 0; idx < mThumbLabels.size(); idx++) {
+		if (mThumbLabels.contains(idx))
+			continue;
 
-		//if (thumbs.at(idx)->isSelected()) {
-		//	thumbLabels.at(idx)->ensureVisible();
-		//	thumbLabels.at(idx)->setSelected(true);	// not working here?!
-		//}
-		if (mThumbLabels.at(idx)->isSelected())
-			mThumbLabels.at(idx)->ensureVisible();
+		DkThumbLabel* label = mFreeLabels.empty() ? createLabel() : mFreeLabels.takeLast();
+		label->setThumb(mThumbs.at(idx)->getThumb(), idx);
+		label->setThumbSelected(mSelection.testBit(idx));
+		label->setPos(thumbRect(idx).topLeft());
+		label->updateSize();
+		label->show();
+		mThumbLabels.insert(idx, label);
 	}
+}
 
-	//update();
+DkThumbLabel* DkThumbScene::createLabel() {
 
-	//if (verticalScrollBar()->isVisible())
-	//	verticalScrollBar()->update();
+	DkThumbLabel* label = new DkThumbLabel();
+	connect(label, SIGNAL(loadFileSignal(const QString&)), this, SLOT(loadFile(const QString&)));
+	connect(label, SIGNAL(showFileSignal(const QString&)), this, SLOT(showFile(const QString&)));
+	addItem(label);
 
-	mFirstLayout = false;
+	return label;
 }
 
 void DkThumbScene::updateThumbs(QVector<QSharedPointer<DkImageContainerT> > thumbs) {
 
+	for (QSharedPointer<DkImageContainerT> imgC : mThumbs)
+		disconnect(imgC.data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()));
+
 	this->mThumbs = thumbs;
 	updateThumbLabels();
 }
@@ -1229,27 +1327,18 @@ void DkThumbScene::updateThumbLabels() {
 	clear();	// deletes the thumbLabels
 	blockSignals(false);
 
-	qDebug() << "clearing mViewport: " << dt.getTotal();
 	mThumbLabels.clear();
+	mFreeLabels.clear();
+	mSelection = QBitArray(mThumbs.size());
 
-	qDebug() << "clearing labels takes: " << dt.getTotal();
+	// offscreen thumbs are fetched too - labels just exist for the visible ones
+	for (QSharedPointer<DkImageContainerT> imgC : mThumbs)
+		connect(imgC.data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()), Qt::UniqueConnection);
 
-	for (int idx = 0; idx < mThumbs.size(); idx++) {
-		DkThumbLabel* thumb = new DkThumbLabel(mThumbs.at(idx)->getThumb());
-		connect(thumb, SIGNAL(loadFileSignal(const QString&)), this, SLOT(loadFile(const QString&)));
-		connect(thumb, SIGNAL(showFileSignal(const QString&)), this, SLOT(showFile(const QString&)));
-		connect(mThumbs.at(idx).data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()));
-
-		//thumb->show();
-		addItem(thumb);
-		mThumbLabels.append(thumb);
-		//thumbsNotLoaded.append(thumb);
-	}
+	qDebug() << "clearing labels takes: " << dt.getTotal();
 
 	showFile();
 
-	qDebug() << "creating labels takes: " << dt.getTotal();
-
 	if (!mThumbs.empty())
 		updateLayout();
 
@@ -1281,11 +1370,94 @@ void DkThumbScene::connectLoader(QSharedPointer<DkImageLoader> loader, bool conn
 void DkThumbScene::showFile(const QString& filePath) {
 
 	if (filePath == QDir::currentPath() || filePath.isEmpty())
-		DkStatusBarManager::instance().setMessage(tr("").arg(QString::number(mThumbLabels.size())));
+		DkStatusBarManager::instance().setMessage(tr("").arg(QString::number(mThumbs.size())));
 	else
 		DkStatusBarManager::instance().setMessage(QFileInfo(filePath).fileName());
 
-	DkStatusBarManager::instance().setMessage(tr("%1 Images").arg(QString::number(mThumbLabels.size())), DkStatusBar::status_filenumber_info);
+	DkStatusBarManager::instance().setMessage(tr("%1 Images").arg(QString::number(mThumbs.size())), DkStatusBar::status_filenumber_info);
+}
+
+int DkThumbScene::numThumbs() const {
+
+	return mThumbs.size();
+}
+
+QSharedPointer<DkThumbNailT> DkThumbScene::thumb(int idx) const {
+
+	if (idx < 0 || idx >= mThumbs.size())
+		return QSharedPointer<DkThumbNailT>();
+
+	return mThumbs.at(idx)->getThumb();
+}
+
+/**
+ * Returns the indices of all thumbnails that intersect rect.
+ * The indices are computed from the grid - no items are queried.
+ * @param rect a rectangle in scene coordinates.
+ * @return QVector<int> the indices in reading order.
+ **/ 
+QVector<int> DkThumbScene::thumbIndices(const QRectF& rect) const {
+
+	QVector<int> indices;
+	int tso = Settings::param().display().thumbPreviewSize + mXOffset;
+
+	if (mNumCols <= 0 || tso <= 0 || rect.isEmpty())
+		return indices;
+
+	int firstRow = qMax(qFloor((rect.top() - mXOffset) / tso), 0);
+	int lastRow = qMin(qFloor((rect.bottom() - mXOffset) / tso), mNumRows-1);
+	int firstCol = qMax(qFloor((rect.left() - mXOffset) / tso), 0);
+	int lastCol = qMin(qFloor((rect.right() - mXOffset) / tso), mNumCols-1);
+
+	for (int rIdx = firstRow; rIdx <= lastRow; rIdx++) {
+		for (int cIdx = firstCol; cIdx <= lastCol; cIdx++) {
+
+			int tIdx = rIdx*mNumCols + cIdx;
+
+			if (tIdx < mThumbs.size())
+				indices << tIdx;
+		}
+	}
+
+	return indices;
+}
+
+/**
+ * Returns the index of the thumbnail at pos.
+ * @param pos a position in scene coordinates.
+ * @return int the index or -1 if there is no thumbnail.
+ **/ 
+int DkThumbScene::thumbIndexAt(const QPointF& pos) const {
+
+	int tso = Settings::param().display().thumbPreviewSize + mXOffset;
+
+	if (mNumCols <= 0 || tso <= 0)
+		return -1;
+
+	int cIdx = qFloor((pos.x() - mXOffset) / tso);
+	int rIdx = qFloor((pos.y() - mXOffset) / tso);
+
+	if (cIdx < 0 || cIdx >= mNumCols || rIdx < 0)
+		return -1;
+
+	int tIdx = rIdx*mNumCols + cIdx;
+
+	// the gap between thumbnails
+	if (tIdx >= mThumbs.size() || !thumbRect(tIdx).contains(pos))
+		return -1;
+
+	return tIdx;
+}
+
+QRectF DkThumbScene::thumbRect(int idx) const {
+
+	if (mNumCols <= 0)
+		return QRectF();
+
+	int ps = Settings::param().display().thumbPreviewSize;
+	int tso = ps + mXOffset;
+
+	return QRectF(mXOffset + (idx % mNumCols)*tso, mXOffset + (idx / mNumCols)*tso, ps, ps);
 }
 
 void DkThumbScene::ensureVisible(QSharedPointer<DkImageContainerT> img) const {
@@ -1293,22 +1465,30 @@ void DkThumbScene::ensureVisible(QSharedPointer<DkImageContainerT> img) const {
 	if (!img)
 		return;
 
-	for (DkThumbLabel* label : mThumbLabels) {
+	for (int idx = 0; idx < mThumbs.size(); idx++) {
 
-		if (label->getThumb()->getFilePath() == img->filePath()) {
-			label->ensureVisible();
+		if (mThumbs.at(idx)->filePath() == img->filePath()) {
+			ensureVisible(idx);
 			break;
 		}
 	}
 
 }
 
+void DkThumbScene::ensureVisible(int idx) const {
+
+	QRectF r = thumbRect(idx);
+
+	for (QGraphicsView* view : views())
+		view->ensureVisible(r);
+}
+
 void DkThumbScene::toggleThumbLabels(bool show) {
 
 	Settings::param().display().showThumbLabel = show;
 
-	for (int idx = 0; idx < mThumbLabels.size(); idx++)
-		mThumbLabels.at(idx)->updateLabel();
+	for (DkThumbLabel* label : mThumbLabels)
+		label->updateLabel();
 
 	//// well, that's not too beautiful
 	//if (Settings::param().display().displaySquaredThumbs)
@@ -1319,8 +1499,8 @@ void DkThumbScene::toggleSquaredThumbs(bool squares) {
 
 	Settings::param().display().displaySquaredThumbs = squares;
 
-	for (int idx = 0; idx < mThumbLabels.size(); idx++)
-		mThumbLabels.at(idx)->updateLabel();
+	for (DkThumbLabel* label : mThumbLabels)
+		label->updateLabel();
 
 	// well, that's not too beautiful
 	if (Settings::param().display().displaySquaredThumbs)
@@ -1346,7 +1526,7 @@ void DkThumbScene::resizeThumbs(float dx) {
 	qDebug() << "delta: " << dx;
 	qDebug() << "newsize: " << newSize;
 
-	if (newSize > 6 && newSize <= 160) {
+	if (newSize > 6 && newSize <= DkThumbNail::mip_large) {
 		Settings::param().display().thumbPreviewSize = newSize;
 		updateLayout();
 	}
@@ -1362,13 +1542,18 @@ void DkThumbScene::selectAllThumbs(bool selected) {
 	selectThumbs(selected);
 }
 
+void DkThumbScene::selectThumb(int idx, bool selected /* = true */) {
+
+	selectThumbs(selected, idx, idx);
+}
+
 void DkThumbScene::selectThumbs(bool selected /* = true */, int from /* = 0 */, int to /* = -1 */) {
 
-	if (mThumbLabels.empty())
+	if (mThumbs.empty())
 		return;
 
 	if (to == -1)
-		to = mThumbLabels.size()-1;
+		to = mThumbs.size()-1;
 
 	if (from > to) {
 		int tmp = to;
@@ -1376,14 +1561,27 @@ void DkThumbScene::selectThumbs(bool selected /* = true */, int from /* = 0 */,
 		from = tmp;
 	}
 
-	blockSignals(true);
-	for (int idx = from; idx <= to && idx < mThumbLabels.size(); idx++) {
-		mThumbLabels.at(idx)->setSelected(selected);
+	from = qMax(from, 0);
+	to = qMin(to, mSelection.size()-1);
+
+	if (from > to)
+		return;
+
+	mSelection.fill(selected, from, to+1);
+
+	for (auto it = mThumbLabels.begin(); it != mThumbLabels.end(); it++) {
+		if (it.key() >= from && it.key() <= to)
+			it.value()->setThumbSelected(selected);
 	}
-	blockSignals(false);
+
 	emit selectionChanged();
 }
 
+bool DkThumbScene::isThumbSelected(int idx) const {
+
+	return idx >= 0 && idx < mSelection.size() && mSelection.testBit(idx);
+}
+
 void DkThumbScene::copySelected() const {
 
 	QStringList fileList = getSelectedFiles();
@@ -1530,37 +1728,18 @@ QStringList DkThumbScene::getSelectedFiles() const {
 
 	QStringList fileList;
 
-	for (int idx = 0; idx < mThumbLabels.size(); idx++) {
+	for (int idx = 0; idx < mSelection.size() && idx < mThumbs.size(); idx++) {
 
-		if (mThumbLabels.at(idx) && mThumbLabels.at(idx)->isSelected()) {
-			fileList.append(mThumbLabels.at(idx)->getThumb()->getFilePath());
-		}
+		if (mSelection.testBit(idx))
+			fileList.append(mThumbs.at(idx)->filePath());
 	}
 
 	return fileList;
 }
 
-int DkThumbScene::findThumb(DkThumbLabel* thumb) const {
-
-	int thumbIdx = -1;
-
-	for (int idx = 0; idx < mThumbLabels.size(); idx++) {
-		if (thumb == mThumbLabels.at(idx)) {
-			thumbIdx = idx;
-			break;
-		}
-	}
-
-	return thumbIdx;
-}
-
 bool DkThumbScene::allThumbsSelected() const {
 
-	for (DkThumbLabel* label : mThumbLabels)
-		if (label->flags() & QGraphicsItem::ItemIsSelectable && !label->isSelected())
-			return false;
-
-	return true;
+	return mSelection.count(true) == mSelection.size();
 }
 
 // DkThumbView --------------------------------------------------------------------
@@ -1568,7 +1747,16 @@ DkThumbsView::DkThumbsView(DkThumbScene* scene, QWidget* parent /* = 0 */) : QGr
 
 	setObjectName("DkThumbsView");
 	this->scene = scene;
-	connect(scene, SIGNAL(thumbLoadedSignal()), this, SLOT(fetchThumbs()));
+
+	// coalesce scroll events - rows that pass by quickly are not loaded
+	mFetchTimer.setSingleShot(true);
+	mFetchTimer.setInterval(30);
+	connect(&mFetchTimer, SIGNAL(timeout()), this, SLOT(fetchThumbs()));
+
+	connect(scene, SIGNAL(thumbLoadedSignal()), this, SLOT(updateQueueInfo()));
+	connect(scene, SIGNAL(sceneRectChanged(const QRectF&)), this, SLOT(scheduleFetch()));
+	connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(scheduleFetch()));
+	connect(verticalScrollBar(), SIGNAL(valueChanged(int)), scene, SLOT(updateVisibleLabels()));
 
 	//setDragMode(QGraphicsView::RubberBandDrag);
 
@@ -1604,17 +1792,31 @@ void DkThumbsView::mousePressEvent(QMouseEvent *event) {
 
 	qDebug() << "mouse pressed";
 
-#if QT_VERSION < 0x050000
-	DkThumbLabel* itemClicked = static_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos())));
-#else
-	DkThumbLabel* itemClicked = static_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos()), QTransform()));
-#endif
+	int idx = scene->thumbIndexAt(mapToScene(event->pos()));
+	mClickedIdx = -1;
 
-	// this is a bit of a hack
-	// what we want to achieve: if the user is selecting with e.g. shift or ctrl 
-	// and he clicks (unintentionally) into the background - the selection would be lost
-	// otherwise so we just don't propagate this event
-	if (itemClicked || event->modifiers() == Qt::NoModifier)	
+	// the selection is kept by the scene (labels only exist for visible thumbnails)
+	// if the user is selecting with e.g. shift or ctrl and he clicks (unintentionally)
+	// into the background - the selection is not lost
+	if (event->button() == Qt::LeftButton) {
+
+		if (idx == -1 && event->modifiers() == Qt::NoModifier)
+			scene->selectThumbs(false);
+		else if (idx != -1 && event->modifiers() & Qt::ControlModifier)
+			scene->selectThumb(idx, !scene->isThumbSelected(idx));
+		else if (idx != -1 && event->modifiers() == Qt::NoModifier) {
+
+			// keep the selection for dragging - it is reduced to this thumb on release
+			if (scene->isThumbSelected(idx))
+				mClickedIdx = idx;
+			else {
+				scene->selectThumbs(false);
+				scene->selectThumb(idx);
+			}
+		}
+	}
+
+	if (idx != -1 || event->modifiers() == Qt::NoModifier)
 		QGraphicsView::mousePressEvent(event);
 }
 
@@ -1626,6 +1828,7 @@ void DkThumbsView::mouseMoveEvent(QMouseEvent *event) {
 
 		if (dist > QApplication::startDragDistance()) {
 
+			mClickedIdx = -1;
 			QStringList fileList = scene->getSelectedFiles();
 
 			QMimeData* mimeData = new QMimeData;
@@ -1651,23 +1854,28 @@ void DkThumbsView::mouseReleaseEvent(QMouseEvent *event) {
 	
 	QGraphicsView::mouseReleaseEvent(event);
 	
-#if QT_VERSION < 0x050000
-	DkThumbLabel* itemClicked = static_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos())));
-#else
-	DkThumbLabel* itemClicked = static_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos()), QTransform()));
-#endif
+	int idx = scene->thumbIndexAt(mapToScene(event->pos()));
 
-	if (lastShiftIdx != -1 && event->modifiers() & Qt::ShiftModifier && itemClicked != 0) {
-		scene->selectThumbs(true, lastShiftIdx, scene->findThumb(itemClicked));
-		qDebug() << "selecting... with SHIFT from: " << lastShiftIdx << " to: " << scene->findThumb(itemClicked);
+	if (lastShiftIdx != -1 && event->modifiers() & Qt::ShiftModifier && idx != -1) {
+		scene->selectThumbs(true, lastShiftIdx, idx);
+		qDebug() << "selecting... with SHIFT from: " << lastShiftIdx << " to: " << idx;
 	}
-	else if (itemClicked != 0) {
-		lastShiftIdx = scene->findThumb(itemClicked);
+	else if (idx != -1) {
+		
+		// a click (no drag) into the selection
+		if (mClickedIdx == idx && event->modifiers() == Qt::NoModifier) {
+			scene->selectThumbs(false);
+			scene->selectThumb(idx);
+		}
+
+		lastShiftIdx = idx;
 		qDebug() << "starting shift: " << lastShiftIdx;
 	}
 	else
 		lastShiftIdx = -1;
 
+	mClickedIdx = -1;
+
 }
 
 void DkThumbsView::dragEnterEvent(QDragEnterEvent *event) {
@@ -1796,44 +2004,103 @@ void DkThumbsView::dropEvent(QDropEvent *event) {
 	qDebug() << "drop event...";
 }
 
-void DkThumbsView::fetchThumbs() {
+void DkThumbsView::resizeEvent(QResizeEvent *event) {
+
+	QGraphicsView::resizeEvent(event);
+	scene->updateVisibleLabels();
+	scheduleFetch();
+}
+
+void DkThumbsView::showEvent(QShowEvent *event) {
+
+	QGraphicsView::showEvent(event);
+	scheduleFetch();
+}
+
+void DkThumbsView::scheduleFetch() {
 
-	int maxThreads = Settings::param().resources().maxThumbsLoading*2;
+	if (!mFetchTimer.isActive())
+		mFetchTimer.start();
+}
+
+/**
+ * Schedules the thumbnails that should be loaded.
+ * The visible thumbnails are requested first (DkThreadPool::priority_thumb).
+ * One screen ahead in the scroll direction is prefetched with a lower priority -
+ * the nearest rows first. Requests that are scrolled out of view are dropped.
+ **/ 
+void DkThumbsView::fetchThumbs() {
 
-	// don't do anything if it is loading anyway
-	if (Settings::param().resources().numThumbsLoading/* > maxThreads*/) {
-		//qDebug() << "rejected because num thumbs loading: " << 
+	if (!isVisible())
 		return;
-	}
 
-	qDebug() << "currently loading: " << Settings::param().resources().numThumbsLoading << " thumbs";
+	int value = verticalScrollBar()->value();
 
-	//bool firstReached = false;
+	if (value != mLastScrollValue)
+		mScrollDir = value > mLastScrollValue ? 1 : -1;
+	mLastScrollValue = value;
 
-	QList<QGraphicsItem*> items = scene->items(mapToScene(viewport()->rect()).boundingRect(), Qt::IntersectsItemShape);
+	QRectF vr = mapToScene(viewport()->rect()).boundingRect();
+	QVector<int> visible = scene->thumbIndices(vr);
+	QVector<int> ahead = scene->thumbIndices(vr.translated(0, mScrollDir*vr.height()));
 
-	//qDebug() << mapToScene(mViewport()->rect()).boundingRect() << " number of items: " << items.size();
+	if (mScrollDir < 0)
+		std::reverse(ahead.begin(), ahead.end());
 
-	for (int idx = 0; idx < items.size(); idx++) {
+	QVector<QSharedPointer<DkThumbNailT> > requested = mRequested;
+	mRequested.clear();
 
-		if (!maxThreads)
-			break;
+	QSet<int> visibleSet;
+	for (int idx : visible) {
+		requestThumb(scene->thumb(idx), DkThreadPool::priority_thumb);
+		visibleSet.insert(idx);
+	}
 
-		DkThumbLabel* th = dynamic_cast<DkThumbLabel*>(items.at(idx));
+	for (int idx : ahead) {
+		if (!visibleSet.contains(idx))
+			requestThumb(scene->thumb(idx), DkThreadPool::priority_thumb_offscreen);
+	}
 
-		if (!th) {
-			qDebug() << "not a thumb label...";
-			continue;
-		}
+	// drop everything that is out of view
+	QSet<DkThumbNailT*> current;
+	for (const QSharedPointer<DkThumbNailT>& t : mRequested)
+		current.insert(t.data());
 
-		if (th->pixmap().isNull()) {
-			th->update();
-			maxThreads--;
-		}
-		//else if (!thumbLabels.at(idx)->pixmap().isNull())
-		//	firstReached = true;
+	for (const QSharedPointer<DkThumbNailT>& t : requested) {
+		if (!current.contains(t.data()))
+			t->cancel();
 	}
 
+	updateQueueInfo();
+}
+
+/**
+ * Requests a thumbnail or moves its request to another priority class.
+ * @param thumb the thumbnail.
+ * @param priority the priority class.
+ * @return bool true if we wait for the thumbnail.
+ **/ 
+bool DkThumbsView::requestThumb(QSharedPointer<DkThumbNailT> thumb, DkThreadPool::Priority priority) {
+
+	if (!thumb)
+		return false;
+
+	if (thumb->isFetching())
+		thumb->setPriority(priority);
+	else if (!thumb->fetchThumb(DkThumbNail::do_not_force, QSharedPointer<QByteArray>(), priority))
+		return false;	// loaded already
+
+	mRequested << thumb;
+
+	return true;
+}
+
+void DkThumbsView::updateQueueInfo() const {
+
+	DkThreadPool& pool = DkThreadPool::instance();
+	int numQueued = pool.numQueued(DkThreadPool::priority_thumb) + pool.numQueued(DkThreadPool::priority_thumb_offscreen);
+
+	DkStatusBarManager::instance().setMessage(numQueued > 0 ? tr("%1 thumbnails queued").arg(numQueued) : QString(), DkStatusBar::status_thumb_queue_info);
 }
 
 // DkThumbScrollWidget --------------------------------------------------------------------
@@ -36,6 +36,9 @@
 #include <QPen>
 #include <QGraphicsScene>
 #include <QGraphicsView>
+#include <QTimer>
+#include <QHash>
+#include <QBitArray>
 #pragma warning(pop)		// no warnings from includes - end
 
 #include "DkBaseWidgets.h"
@@ -179,8 +182,11 @@ public:
 	DkThumbLabel(QSharedPointer<DkThumbNailT> thumb = QSharedPointer<DkThumbNailT>(), QGraphicsItem* parent = 0);
 	~DkThumbLabel();
 
-	void setThumb(QSharedPointer<DkThumbNailT> thumb);
+	void setThumb(QSharedPointer<DkThumbNailT> thumb, int thumbIdx = -1);
 	QSharedPointer<DkThumbNailT> getThumb() {return mThumb;};
+	int thumbIdx() const {return mThumbIdx;};
+	void setThumbSelected(bool selected);
+	bool isThumbSelected() const;
 	QRectF boundingRect() const;
 	QPainterPath shape() const;
 	void updateSize();
@@ -201,15 +207,18 @@ protected:
 	void hoverLeaveEvent(QGraphicsSceneHoverEvent *event);
 
 	QSharedPointer<DkThumbNailT> mThumb;
+	int mThumbIdx = -1;		// the index in the scene
+	bool mSelected = false;
 	QGraphicsPixmapItem mIcon;
 	QGraphicsTextItem mText;
 	bool mThumbInitialized = false;
-	bool mFetchingThumb = false;
+	int mMipSize = 0;		// the longest side of the mip level displayed
 	QPen mNoImagePen;
 	QBrush mNoImageBrush;
 	QPen mSelectPen;
 	QBrush mSelectBrush;
 	bool mIsHovered = false;
+	bool mToolTipComplete = false;	// the dimension is added on hover
 	QPointF mLastMove;
 };
 
@@ -223,9 +232,14 @@ public:
 	QStringList getSelectedFiles() const;
 	void setImageLoader(QSharedPointer<DkImageLoader> loader);
 	void copyImages(const QMimeData* mimeData) const;
-	int findThumb(DkThumbLabel* thumb) const;
 	bool allThumbsSelected() const;
+	bool isThumbSelected(int idx) const;
 	void ensureVisible(QSharedPointer<DkImageContainerT> img) const;
+	int numThumbs() const;
+	QSharedPointer<DkThumbNailT> thumb(int idx) const;
+	QVector<int> thumbIndices(const QRectF& rect) const;
+	int thumbIndexAt(const QPointF& pos) const;
+	QRectF thumbRect(int idx) const;
 
 public slots:
 	void updateThumbLabels();
@@ -236,8 +250,10 @@ public slots:
 	void toggleThumbLabels(bool show);
 	void resizeThumbs(float dx);
 	void showFile(const QString& filePath = QString());
+	void selectThumb(int idx, bool select = true);
 	void selectThumbs(bool select = true, int from = 0, int to = -1);
 	void selectAllThumbs(bool select = true);
+	void updateVisibleLabels();
 	void updateThumbs(QVector<QSharedPointer<DkImageContainerT> > thumbs);
 	void deleteSelected() const;
 	void copySelected() const;
@@ -251,13 +267,17 @@ signals:
 
 protected:
 	void connectLoader(QSharedPointer<DkImageLoader> loader, bool connectSignals = true);
+	DkThumbLabel* createLabel();
+	void ensureVisible(int idx) const;
 	
 	int mXOffset = 0;
 	int mNumRows = 0;
 	int mNumCols = 0;
 	bool mFirstLayout = true;
 
-	QVector<DkThumbLabel* > mThumbLabels;
+	QHash<int, DkThumbLabel*> mThumbLabels;		// labels of the visible thumbs (index -> label)
+	QVector<DkThumbLabel*> mFreeLabels;			// labels that can be recycled
+	QBitArray mSelection;
 	QSharedPointer<DkImageLoader> mLoader;
 	QVector<QSharedPointer<DkImageContainerT> > mThumbs;
 };
@@ -273,9 +293,15 @@ signals:
 
 public slots:
 	void fetchThumbs();
+	void scheduleFetch();
+
+protected slots:
+	void updateQueueInfo() const;
 
 protected:
 	void wheelEvent(QWheelEvent *event);
+	void resizeEvent(QResizeEvent *event);
+	void showEvent(QShowEvent *event);
 	void dragEnterEvent(QDragEnterEvent *event);
 	void dropEvent(QDropEvent *event);
 	void dragMoveEvent(QDragMoveEvent *event);
@@ -283,10 +309,17 @@ protected:
 	void mouseMoveEvent(QMouseEvent *event);
 	void mouseReleaseEvent(QMouseEvent *event);
 
+	bool requestThumb(QSharedPointer<DkThumbNailT> thumb, DkThreadPool::Priority priority);
+
 	DkThumbScene* scene;
 	QPointF mousePos;
 	int lastShiftIdx;
+	int mClickedIdx = -1;	// a selected thumb that was clicked (resolved on release)
 
+	QTimer mFetchTimer;
+	QVector<QSharedPointer<DkThumbNailT> > mRequested;	// thumbs we are waiting for
+	int mLastScrollValue = 0;
+	int mScrollDir = 1;	// 1 down, -1 up
 };
 
 class DkThumbScrollWidget : public DkWidget {
@@ -70,6 +70,7 @@ DkViewPort::DkViewPort(QWidget *parent, Qt::WindowFlags flags) : DkBaseViewPort(
 
 	mRepeatZoomTimer = new QTimer(this);
 	mFadeTimer = new QTimer(this);
+	mRegionTimer = new QTimer(this);
 
 	// try loading a custom file
 	mImgBg.load(QFileInfo(QApplication::applicationDirPath(), "bg.png").absoluteFilePath());
@@ -82,6 +83,11 @@ DkViewPort::DkViewPort(QWidget *parent, Qt::WindowFlags flags) : DkBaseViewPort(
 	mFadeTimer->setInterval(5);
 	connect(mFadeTimer, SIGNAL(timeout()), this, SLOT(animateFade()));
 
+	// don't develop RAW regions while the user is still panning
+	mRegionTimer->setSingleShot(true);
+	mRegionTimer->setInterval(150);
+	connect(mRegionTimer, SIGNAL(timeout()), this, SLOT(loadRegion()));
+
 	//no border
 	setMouseTracking (true);//receive mouse event everytime
 	
@@ -214,10 +220,56 @@ void DkViewPort::updateImage(QSharedPointer<DkImageContainerT> image, bool loade
 		return;
 
 	if (mLoader->hasImage()) {
-		setImage(mLoader->getImage());
+
+		QSharedPointer<DkImageContainerT> imgC = mLoader->getCurrentImage();
+
+		// the full resolution of the image we are showing arrived
+		bool fullResolution = !mReducedFilePath.isEmpty() && imgC->filePath() == mReducedFilePath && !imgC->isReduced();
+		mReducedFilePath = imgC->isReduced() ? imgC->filePath() : QString();
+
+		// the decoded image replaces its preview - keep the view if the geometry matches
+		bool replacesPreview = !mPreviewFilePath.isEmpty() && imgC->filePath() == mPreviewFilePath;
+		if (replacesPreview) {
+			
+			QSize s = imgC->displayImage().size();
+			QSizeF ps = mImgRect.size();
+			fullResolution = !s.isEmpty() && !ps.isEmpty() && qAbs((double)s.width()/s.height() - ps.width()/ps.height()) < 0.01;
+		}
+		mPreviewFilePath = QString();
+
+		if (fullResolution)
+			setFullResolutionImage(imgC->displayImage());
+		else
+			setImage(imgC->displayImage());
+
+		// run the edit that waited for the full resolution
+		if (mPendingEdit && imgC->filePath() == mPendingEditFilePath && !imgC->isReduced()) {
+			QTimer::singleShot(0, this, mPendingEdit);
+			mPendingEdit = std::function<void()>();
+		}
+		else if (mPendingEdit && imgC->filePath() == mPendingEditFilePath && replacesPreview)
+			imgC->loadFullResolutionThreaded();	// the edit waited for the preview - but the image is reduced too
+		else if (imgC->filePath() != mPendingEditFilePath)
+			mPendingEdit = std::function<void()>();
 	}
 }
 
+/**
+ * Shows the embedded preview of an image that is still being decoded.
+ * It is replaced by the image in updateImage().
+ * @param image the image whose preview is ready.
+ **/ 
+void DkViewPort::updatePreview(QSharedPointer<DkImageContainerT> image) {
+
+	if (!mLoader || !image || image != mLoader->getCurrentImage() || image->previewImage().isNull())
+		return;
+
+	// small previews are already scaled to the viewport (see DkBasicLoader::loadPreview)
+	mPreviewFilePath = image->filePath();
+	mReducedFilePath = QString();
+	setImage(image->previewImage());
+}
+
 void DkViewPort::loadImage(const QImage& newImg) {
 
 	// delete current information
@@ -242,7 +294,8 @@ void DkViewPort::loadImage(QSharedPointer<DkImageContainerT> img) {
 
 		if (img->hasImage()) {
 			mLoader->setCurrentImage(img);
-			setImage(img->image());
+			mReducedFilePath = img->isReduced() ? img->filePath() : QString();
+			setImage(img->displayImage());
 		}
 		mLoader->load(img);
 	}
@@ -261,6 +314,10 @@ void DkViewPort::setImage(QImage newImg) {
 	mController->getOverview()->setImage(QImage());	// clear overview
 
 	mImgStorage.setImage(newImg);
+	mRegionImage = QImage();
+	mRegionRect = QRect();
+	mRequestedRegion = QRect();
+	mRequestedScale = 0.0;
 
 	if (mLoader->hasMovie() && !mLoader->isEdited())
 		loadMovie();
@@ -316,6 +373,88 @@ void DkViewPort::setImage(QImage newImg) {
 	DkStatusBarManager::instance().setMessage(DkUtils::formatToString(newImg.format()), DkStatusBar::status_format_info);
 }
 
+/**
+ * Replaces the reduced image with its full resolution.
+ * Both images fill the same view rect, so the current view is kept.
+ * @param img the image at full resolution.
+ **/ 
+void DkViewPort::setFullResolutionImage(QImage img) {
+
+	QTransform worldMatrix = mWorldMatrix;
+
+	mImgStorage.setImage(img);
+	mRegionImage = QImage();
+	mRegionRect = QRect();
+	mRequestedRegion = QRect();
+	mRequestedScale = 0.0;
+	mImgRect = QRectF(QPoint(), getImageSize());
+	mOldImgRect = mImgRect;
+
+	updateImageMatrix();
+	mWorldMatrix = worldMatrix;
+
+	mController->getOverview()->setImage(img);
+	update();
+
+	if (mController->getHistogram()) mController->getHistogram()->drawHistogram(img);
+
+	emit newImageSignal(&img);
+	emit zoomSignal((float)(mWorldMatrix.m11()*mImgMatrix.m11()*100));
+	DkStatusBarManager::instance().setMessage(QString::number(qRound((float)(mWorldMatrix.m11()*mImgMatrix.m11() * 100))) + "%", DkStatusBar::status_zoom_info);
+}
+
+/**
+ * Returns the image displayed.
+ * It might be reduced - edits & saving need to call requestFullResolution() first.
+ * @return QImage the current image.
+ **/ 
+QImage DkViewPort::getImage() const {
+
+	return DkBaseViewPort::getImage();
+}
+
+/**
+ * Checks if the image displayed has all pixels (e.g. before it is edited or saved).
+ * Reduced images are replaced by their full resolution in the background
+ * and retry is called once it is displayed. Embedded previews wait for the decoded image.
+ * Overviews of huge TIFFs cannot be edited at all.
+ * @param retry the edit that needs the full resolution.
+ * @return bool true if the image can be edited now.
+ **/ 
+bool DkViewPort::requestFullResolution(std::function<void()> retry) {
+
+	mPendingEdit = std::function<void()>();
+
+	QSharedPointer<DkImageContainerT> imgC = mLoader ? mLoader->getCurrentImage() : QSharedPointer<DkImageContainerT>();
+
+	if (!imgC)
+		return true;
+
+	if (!mPreviewFilePath.isEmpty() && imgC->filePath() == mPreviewFilePath) {
+		mPendingEdit = retry;
+		mPendingEditFilePath = imgC->filePath();
+		mController->setInfo(tr("Loading the image..."));
+		return false;
+	}
+
+	// huge tiffs are never loaded at once
+	if (imgC->isOverview()) {
+		mController->setInfo(tr("Sorry, this image is too large to be edited or saved."));
+		return false;
+	}
+
+	if (!imgC->isReduced())
+		return true;
+
+	imgC->loadFullResolutionThreaded();
+
+	mPendingEdit = retry;
+	mPendingEditFilePath = imgC->filePath();
+	mController->setInfo(tr("Loading the full resolution..."));
+
+	return false;
+}
+
 void DkViewPort::setThumbImage(QImage newImg) {
 	
 	DkTimer dt;
@@ -440,6 +579,107 @@ void DkViewPort::zoom(float factor, QPointF center) {
 
 	emit zoomSignal((float)(mWorldMatrix.m11()*mImgMatrix.m11()*100));
 	DkStatusBarManager::instance().setMessage(QString::number(qRound((float)(mWorldMatrix.m11()*mImgMatrix.m11() * 100))) + "%", DkStatusBar::status_zoom_info);
+
+	updateResolution();
+}
+
+/**
+ * Loads more pixels if we zoomed to (or beyond) the decoded resolution.
+ * Reduced JPGs are replaced by their full resolution, binned
+ * RAWs and huge TIFFs just load the visible region.
+ **/ 
+void DkViewPort::updateResolution() {
+
+	if (mWorldMatrix.m11()*mImgMatrix.m11() <= 0.999 || !mLoader)
+		return;
+
+	QSharedPointer<DkImageContainerT> imgC = mLoader->getCurrentImage();
+
+	if (!imgC || !imgC->isReduced() || !mPreviewFilePath.isEmpty())
+		return;
+
+	if (imgC->hasRegions()) {
+		if (!mRequestedRegion.contains(visibleRegion()) || regionScale() > mRequestedScale*1.01)
+			mRegionTimer->start();
+	}
+	else
+		imgC->loadFullResolutionThreaded();
+}
+
+/**
+ * Returns the part of the image that is currently visible.
+ * @return QRect the visible region in full resolution image coordinates.
+ **/ 
+QRect DkViewPort::visibleRegion() const {
+
+	if (!mLoader || !mLoader->getCurrentImage() || mImgRect.isEmpty())
+		return QRect();
+
+	QSize fs = mLoader->getCurrentImage()->imageSize();
+	QRectF r = (mImgMatrix * mWorldMatrix).inverted().mapRect(QRectF(QPointF(), size())).intersected(mImgRect);
+
+	double sx = fs.width() / mImgRect.width();
+	double sy = fs.height() / mImgRect.height();
+
+	return QRectF(r.x()*sx, r.y()*sy, r.width()*sx, r.height()*sy).toAlignedRect().intersected(QRect(QPoint(), fs));
+}
+
+/**
+ * Returns the scale (w.r.t. the full resolution) needed to display the current zoom level.
+ * @return double the scale <= 1.
+ **/ 
+double DkViewPort::regionScale() const {
+
+	if (!mLoader || !mLoader->getCurrentImage() || mImgRect.isEmpty())
+		return 1.0;
+
+	QSharedPointer<DkImageContainerT> imgC = mLoader->getCurrentImage();
+
+	// RAW regions are always developed at full resolution
+	if (imgC->getLoader()->binning() > 1)
+		return 1.0;
+
+	double scale = mWorldMatrix.m11()*mImgMatrix.m11() * mImgRect.width() / imgC->imageSize().width();
+	return qMin(scale, 1.0);
+}
+
+/**
+ * Loads the visible region of a binned RAW or huge TIFF (with a border for panning).
+ **/ 
+void DkViewPort::loadRegion() {
+
+	if (!mLoader || !mLoader->getCurrentImage() || !mLoader->getCurrentImage()->hasRegions())
+		return;
+
+	QSharedPointer<DkImageContainerT> imgC = mLoader->getCurrentImage();
+	QRect vr = visibleRegion();
+	double scale = regionScale();
+
+	if (vr.isEmpty() || (mRequestedRegion.contains(vr) && scale <= mRequestedScale*1.01))
+		return;
+
+	int bx = vr.width() / 4;
+	int by = vr.height() / 4;
+
+	mRequestedRegion = vr.adjusted(-bx, -by, bx, by).intersected(QRect(QPoint(), imgC->imageSize()));
+	mRequestedScale = scale;
+	imgC->loadRegionThreaded(mRequestedRegion, scale);
+}
+
+void DkViewPort::updateRegion(QSharedPointer<DkImageContainerT> image) {
+
+	if (!mLoader || !image || image != mLoader->getCurrentImage() || !image->isReduced())
+		return;
+
+	mRegionImage = image->regionImage();
+	mRegionRect = image->region();
+	update();
+}
+
+void DkViewPort::moveView(const QPointF& delta) {
+
+	DkBaseViewPort::moveView(delta);
+	updateResolution();
 }
 
 void DkViewPort::zoomTo(float zoomLevel, const QPoint&) {
@@ -641,6 +881,9 @@ void DkViewPort::applyPlugin(DkPluginContainer* plugin, const QString& key) {
 	if (!plugin)
 		return;
 
+	if (!requestFullResolution([this, plugin, key]() { applyPlugin(plugin, key); }))
+		return;
+
 	QSharedPointer<DkImageContainerT> result = DkImageContainerT::fromImageContainer(plugin->plugin()->runPlugin(key, imageContainer()));
 	if (result) 
 		setEditedImage(result);
@@ -673,6 +916,17 @@ void DkViewPort::paintEvent(QPaintEvent* event) {
 		// TODO: if fading is active we interpolate with background instead of the other image
 		draw(&painter, 1.0f-mFadeOpacity);
 
+		// the developed region of a binned RAW
+		if (!mRegionImage.isNull() && mLoader && mLoader->getCurrentImage()) {
+
+			QSize fs = mLoader->getCurrentImage()->imageSize();
+			double sx = mImgRect.width() / fs.width();
+			double sy = mImgRect.height() / fs.height();
+			QRectF r(mRegionRect.x()*sx, mRegionRect.y()*sy, mRegionRect.width()*sx, mRegionRect.height()*sy);
+
+			painter.drawImage(mImgMatrix.mapRect(r), mRegionImage);
+		}
+
 		if (/*mFadeTimer->isActive() && */!mFadeBuffer.isNull()) {
 			float oldOp = (float)painter.opacity();
 			painter.setOpacity(mFadeOpacity);
@@ -823,6 +1077,9 @@ void DkViewPort::resizeEvent(QResizeEvent *event) {
 
 	mViewportRect = QRect(0, 0, width(), height());
 
+	if (mLoader)
+		mLoader->setTargetSize(size());
+
 	// >DIR: diem - bug if zoom factor is large and window becomes small
 	updateImageMatrix();
 	centerImage();
@@ -1242,7 +1499,7 @@ void DkViewPort::togglePattern(bool show) {
 // edit image --------------------------------------------------------------------
 void DkViewPort::rotateCW() {
 
-	if (!mController->applyPluginChanges(true))
+	if (!mController->applyPluginChanges(true) || !requestFullResolution([this]() { rotateCW(); }))
 		return;
 
 
@@ -1253,7 +1510,7 @@ void DkViewPort::rotateCW() {
 
 void DkViewPort::rotateCCW() {
 
-	if (!mController->applyPluginChanges(true))
+	if (!mController->applyPluginChanges(true) || !requestFullResolution([this]() { rotateCCW(); }))
 		return;
 
 	if (mLoader != 0)
@@ -1263,7 +1520,7 @@ void DkViewPort::rotateCCW() {
 
 void DkViewPort::rotate180() {
 
-	if (!mController->applyPluginChanges(true))
+	if (!mController->applyPluginChanges(true) || !requestFullResolution([this]() { rotate180(); }))
 		return;
 
 	if (mLoader != 0)
@@ -1602,8 +1859,10 @@ void DkViewPort::setImageLoader(QSharedPointer<DkImageLoader> newLoader) {
 	mLoader = newLoader;
 	connectLoader(newLoader);
 
-	if (mLoader)
+	if (mLoader) {
+		mLoader->setTargetSize(size());
 		mLoader->activate();
+	}
 }
 
 void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connectSignals) {
@@ -1614,6 +1873,8 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
 	if (connectSignals) {
 		//connect(mLoader.data(), SIGNAL(imageLoadedSignal(QSharedPointer<DkImageContainerT>, bool)), this, SLOT(updateImage(QSharedPointer<DkImageContainerT>, bool)), Qt::UniqueConnection);
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), this, SLOT(updateImage(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
+		connect(loader.data(), SIGNAL(previewLoadedSignal(QSharedPointer<DkImageContainerT>)), this, SLOT(updatePreview(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
+		connect(loader.data(), SIGNAL(regionLoadedSignal(QSharedPointer<DkImageContainerT>)), this, SLOT(updateRegion(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
 
 		connect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), mController->getFilePreview(), SLOT(updateThumbs(QVector<QSharedPointer<DkImageContainerT> >)), Qt::UniqueConnection);
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getFilePreview(), SLOT(setFileInfo(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
@@ -1634,6 +1895,8 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
 	else {
 		//connect(mLoader.data(), SIGNAL(imageLoadedSignal(QSharedPointer<DkImageContainerT>, bool)), this, SLOT(updateImage(QSharedPointer<DkImageContainerT>, bool)), Qt::UniqueConnection);
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), this, SLOT(updateImage(QSharedPointer<DkImageContainerT>)));
+		disconnect(loader.data(), SIGNAL(previewLoadedSignal(QSharedPointer<DkImageContainerT>)), this, SLOT(updatePreview(QSharedPointer<DkImageContainerT>)));
+		disconnect(loader.data(), SIGNAL(regionLoadedSignal(QSharedPointer<DkImageContainerT>)), this, SLOT(updateRegion(QSharedPointer<DkImageContainerT>)));
 
 		disconnect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), mController->getFilePreview(), SLOT(updateThumbs(QVector<QSharedPointer<DkImageContainerT> >)));
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getFilePreview(), SLOT(setFileInfo(QSharedPointer<DkImageContainerT>)));
@@ -1671,6 +1934,20 @@ void DkViewPort::cropImage(const DkRotatingRect& rect, const QColor& bgCol) {
 		return;
 	}
 
+	// the rect is relative to the reduced image - scale it to the full resolution
+	QSize reducedSize = getImageSize();
+	auto cropFullResolution = [this, rect, bgCol, reducedSize]() {
+		
+		QSize fs = getImageSize();
+		QPolygonF poly = QTransform::fromScale((double)fs.width()/reducedSize.width(), (double)fs.height()/reducedSize.height()).map(rect.getPoly());
+		DkRotatingRect fullRect;
+		fullRect.setPoly(poly);
+		cropImage(fullRect, bgCol);
+	};
+
+	if (!requestFullResolution(cropFullResolution))
+		return;
+
 	qDebug() << cImgSize;
 
 	double angle = DkMath::normAngleRad(rect.getAngle(), 0, CV_PI*0.5);
@@ -2412,7 +2689,7 @@ QImage DkViewPortContrast::getImage() const {
 	if (mDrawFalseColorImg)
 		return mFalseColorImg;
 	else
-		return mImgStorage.getImageConst();
+		return DkViewPort::getImage();
 
 }
 
@@ -33,6 +33,7 @@
 
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QTimer>	// needed to construct mTimers
+#include <functional>
 #pragma warning(pop)		// no warnings from includes - end
 
 #ifndef DllGuiExport
@@ -106,6 +107,8 @@ public:
 	
 	QString getCurrentPixelHexValue();
 	QPoint mapToImage(const QPoint& windowPos) const;
+	QImage getImage() const override;
+	bool requestFullResolution(std::function<void()> retry);
 	
 	void connectLoader(QSharedPointer<DkImageLoader> loader, bool connectSignals = true);
 
@@ -133,6 +136,7 @@ public slots:
 	void resizeEvent(QResizeEvent* event);
 	void toggleResetMatrix();
 	void zoomTo(float zoomLevel, const QPoint& pos = QPoint(-1, -1));
+	void moveView(const QPointF& delta) override;
 	
 	// tcp actions
 	void tcpSetTransforms(QTransform worldMatrix, QTransform imgMatrix, QPointF canvasSize);
@@ -169,6 +173,9 @@ public slots:
 	void copyImage();
 
 	virtual void updateImage(QSharedPointer<DkImageContainerT> image, bool loaded = true);
+	void updatePreview(QSharedPointer<DkImageContainerT> image);
+	void updateRegion(QSharedPointer<DkImageContainerT> image);
+	void loadRegion();
 	virtual void loadImage(const QImage& newImg);
 	virtual void loadImage(QSharedPointer<DkImageContainerT> img);
 	virtual void setEditedImage(const QImage& newImg, const QString& editName);
@@ -201,6 +208,15 @@ protected:
 	bool mGestureStarted = false;
 
 	QRectF mOldImgRect;
+	QString mReducedFilePath;	// the image displayed was decoded at a reduced resolution
+	QString mPreviewFilePath;	// the image displayed is the embedded preview
+	std::function<void()> mPendingEdit;	// an edit that waits for the full resolution
+	QString mPendingEditFilePath;
+	QImage mRegionImage;		// full resolution region of a binned RAW
+	QRect mRegionRect;			// its location in image coordinates
+	QRect mRequestedRegion;
+	double mRequestedScale = 0.0;
+	QTimer* mRegionTimer;
 
 	QTimer* mRepeatZoomTimer;// = new QTimer(this);
 	
@@ -236,6 +252,10 @@ protected:
 	void drawPolygon(QPainter *painter, QPolygon *polygon);
 	virtual void drawBackground(QPainter *painter);
 	virtual void updateImageMatrix();
+	void setFullResolutionImage(QImage img);
+	void updateResolution();
+	QRect visibleRegion() const;
+	double regionScale() const;
 	void showZoom();
 	void toggleLena(bool fullscreen);
 	void getPixelInfo(const QPoint& pos);
@@ -338,7 +338,7 @@ void DkThumbsSaver::loadNext() {
 	for (int idx = mCLoadIdx; idx < mImages.size() && idx < numLoading; idx++) {
 		mCLoadIdx++;
 		connect(mImages.at(idx)->getThumb().data(), SIGNAL(thumbLoadedSignal(bool)), this, SLOT(thumbLoaded(bool)));
-		mImages.at(idx)->getThumb()->fetchThumb(force);
+		mImages.at(idx)->getThumb()->fetchThumb(force, QSharedPointer<QByteArray>(), DkThreadPool::priority_thumb_offscreen);
 	}
 }
 
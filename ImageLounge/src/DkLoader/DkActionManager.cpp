@@ -538,6 +538,10 @@ QMenu* DkActionManager::createPanelMenu(QWidget* parent) {
 	mPanelMenu->addAction(mPanelActions[menu_panel_histogram]);
 	mPanelMenu->addAction(mPanelActions[menu_panel_comment]);
 
+	mPanelMenu->addSeparator();
+
+	mPanelMenu->addAction(mPanelActions[menu_panel_loader_stats]);
+
 	return mPanelMenu;
 }
 
@@ -1262,6 +1266,10 @@ void DkActionManager::createActions(QWidget* parent) {
 	mPanelActions[menu_panel_history]->setShortcut(QKeySequence(shortcut_show_history));
 	mPanelActions[menu_panel_history]->setCheckable(true);
 
+	mPanelActions[menu_panel_loader_stats] = new QAction(QObject::tr("Loader &Statistics"), parent);
+	mPanelActions[menu_panel_loader_stats]->setStatusTip(QObject::tr("Shows cache hits and loading times"));
+	mPanelActions[menu_panel_loader_stats]->setCheckable(true);
+
 	// view actions
 	mViewActions.resize(menu_view_end);
 	mViewActions[menu_view_fit_frame] = new QAction(QObject::tr("&Fit Window"), parent);
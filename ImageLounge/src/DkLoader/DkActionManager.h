@@ -199,6 +199,7 @@ public:
 		menu_panel_metadata_dock,
 		menu_panel_comment,
 		menu_panel_history,
+		menu_panel_loader_stats,
 
 		menu_panel_end,
 	};
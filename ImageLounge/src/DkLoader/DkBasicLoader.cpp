@@ -46,8 +46,18 @@
 #include <QPixmap>
 #include <QIcon>
 #include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QSet>
+#if QT_VERSION >= 0x050400
+#include <QStorageInfo>
+#endif
 
 #include <qmath.h>
+#include <climits>
+#include <algorithm>
+#include <vector>
 
 // quazip
 #ifdef WITH_QUAZIP
@@ -138,6 +148,7 @@ DkBasicLoader::DkBasicLoader(int mode) {
 	mLoader = no_loader;
 
 	mMetaData = QSharedPointer<DkMetaDataT>(new DkMetaDataT());
+	mPageCache.setMaxCost(4);	// pages
 }
 
 bool DkBasicLoader::loadGeneral(const QString& filePath, bool loadMetaData, bool fast) {
@@ -200,6 +211,9 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 		qDebug() << "metaData is NULL!";
 	}
 
+	if (isCanceled())
+		return false;
+
 	qDebug() << "ba size: " << ba;
 
 	QList<QByteArray> qtFormats = QImageReader::supportedImageFormats();
@@ -207,6 +221,15 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 
 	QImage img;
 
+	// jpgs that are just displayed do not need all pixels
+	if (!imgLoaded && !mTargetSize.isEmpty() && Settings::param().resources().reducedJpgDecode && (suf == "jpg" || suf == "jpeg" || suf == "jpe")) {
+		
+		imgLoaded = loadReducedJpgFile(mFile, ba, img);
+
+		if (imgLoaded)
+			mLoader = qt_loader;
+	}
+
 	if (!imgLoaded && !fInfo.exists() && ba && !ba->isEmpty()) {
 		imgLoaded = img.loadFromData(*ba.data());
 
@@ -214,6 +237,30 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 			mLoader = qt_loader;
 	}
 
+	// huge tiffs are not decoded at once - just an overview that fits the screen
+	if (!imgLoaded && (suf == "tif" || suf == "tiff") && fInfo.exists()) {
+
+		QSharedPointer<DkTiledTiff> tiff(new DkTiledTiff(mFile));
+
+		if (tiff->isValid() && tiff->isLarge()) {
+
+			int tl = qMax(mTargetSize.width(), mTargetSize.height());
+			if (tl <= 0)
+				tl = 4096;
+
+			QSize s = tiff->size();
+			img = tiff->region(QRect(QPoint(), s), qMin(1.0, (double)tl / qMax(s.width(), s.height())));
+			imgLoaded = !img.isNull();
+
+			if (imgLoaded) {
+				mTiledTiff = tiff;
+				mFullSize = s;
+				mLoader = tiled_tiff_loader;
+				qDebug() << "[DkBasicLoader] huge tiff" << s << "- overview:" << img.size() << "levels:" << tiff->numLevels();
+			}
+		}
+	}
+
 	// load large icons
 	if (!imgLoaded && suf == "ico") {
 
@@ -225,6 +272,13 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 		}
 	}
 
+	// our psd loader is preferred since it can decode psds at screen resolution
+	if (!imgLoaded && (suf == "psd" || suf == "psb")) {
+
+		imgLoaded = loadPSDFile(mFile, ba);
+		if (imgLoaded) mLoader = psd_loader;
+	}
+
 	// default Qt loader
 	// here we just try those formats that are officially supported
 	if (!imgLoaded && qtFormats.contains(suf.toStdString().c_str())) {
@@ -238,6 +292,9 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 		if (imgLoaded) mLoader = qt_loader;
 	}
 
+	if (isCanceled())
+		return false;
+
 	// PSD loader
 	if (!imgLoaded) {
 
@@ -263,6 +320,9 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 		if (imgLoaded) mLoader = raw_loader;
 	}
 
+	if (isCanceled())
+		return false;
+
 	// default Qt loader
 	if (!imgLoaded && !newSuffix.contains(QRegExp("(roh)", Qt::CaseInsensitive))) {
 
@@ -304,14 +364,22 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 		indexPages(mFile);
 	mPageIdxDirty = false;
 
+	if (isCanceled())
+		return false;
+
 	if (imgLoaded && loadMetaData && mMetaData) {
 		
 		try {
 			mMetaData->setQtValues(img);
 		
-			if (orientation != -1 && !mMetaData->isTiff() && !Settings::param().metaData().ignoreExifOrientation)
+			if (orientation != -1 && !mMetaData->isTiff() && !Settings::param().metaData().ignoreExifOrientation) {
 				img = rotate(img, orientation);
 
+				// RAW loaders set the image themselves & it is not rotated
+				if (!img.isNull() && !mFullSize.isEmpty() && (qAbs(orientation) == 90 || qAbs(orientation) == 270))
+					mFullSize.transpose();
+			}
+
 		} catch(...) {}	// ignore if we cannot read the metadata
 	}
 	else if (!mMetaData) {
@@ -326,6 +394,117 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 	return imgLoaded;
 }
 
+/**
+ * Decodes a jpg at a reduced resolution.
+ * libjpeg can scale by 1/2, 1/4 and 1/8 while decoding (DCT scaling)
+ * which is way faster than decoding all pixels and downsampling them afterwards.
+ * The largest factor is chosen such that the image still fills the target size.
+ * The size is checked for both orientations since the image might be rotated afterwards.
+ * @param filePath the jpg file.
+ * @param ba the file buffer (might be empty).
+ * @param img the decoded image.
+ * @return bool false if the image was not decoded (e.g. it is too small to be reduced).
+ **/ 
+bool DkBasicLoader::loadReducedJpgFile(const QString& filePath, QSharedPointer<QByteArray> ba, QImage& img) {
+
+	QBuffer buffer;
+	QImageReader reader;
+
+	if (ba && !ba->isEmpty()) {
+		buffer.setData(*ba);
+		buffer.open(QIODevice::ReadOnly);
+		reader.setDevice(&buffer);
+	}
+	else
+		reader.setFileName(filePath);
+
+	if (reader.format() != "jpeg" && reader.format() != "jpg")
+		return false;
+
+	QSize fullSize = reader.size();
+	int tl = qMax(mTargetSize.width(), mTargetSize.height());
+
+	if (fullSize.isEmpty() || tl <= 0)
+		return false;
+
+	QSize fitSize = fullSize.scaled(QSize(tl, tl), Qt::KeepAspectRatio);
+	
+	int scale = 1;
+	for (int s = 8; s > 1; s /= 2) {
+		
+		if (fullSize.width()/s >= fitSize.width() && fullSize.height()/s >= fitSize.height()) {
+			scale = s;
+			break;
+		}
+	}
+
+	if (scale == 1)
+		return false;
+
+	// libjpeg rounds up - so no additional scaling is needed
+	reader.setScaledSize(QSize((fullSize.width()+scale-1)/scale, (fullSize.height()+scale-1)/scale));
+
+	if (!reader.read(&img))
+		return false;
+
+	mFullSize = fullSize;
+	qDebug() << "[DkBasicLoader] jpg decoded at 1 /" << scale << "->" << img.size();
+
+	return true;
+}
+
+/**
+ * Returns the bayer binning factor for a RAW image of the given size.
+ * RAWs are binned (2x2 or 4x4) if they are just displayed and
+ * the binned image still fills the target size (see DkSettings::rawSize).
+ * @param width the sensor width.
+ * @param height the sensor height.
+ * @return int the binning factor (1 if the image should be demosaiced).
+ **/ 
+int DkBasicLoader::rawBinning(int width, int height) const {
+
+	int tl = qMax(mTargetSize.width(), mTargetSize.height());
+
+	if (tl <= 0 || width <= 0 || height <= 0)
+		return 1;
+
+	int factor = 1;
+	switch (Settings::param().resources().rawDecodeSize) {
+	case DkSettings::raw_size_half:		factor = 2; break;
+	case DkSettings::raw_size_quarter:	factor = 4; break;
+	default:							break;
+	}
+
+	QSize fitSize = QSize(width, height).scaled(QSize(tl, tl), Qt::KeepAspectRatio);
+
+	while (factor > 1 && (width/factor < fitSize.width() || height/factor < fitSize.height()))
+		factor /= 2;
+
+	return factor;
+}
+
+/**
+ * Returns true if the image was decoded at a reduced resolution.
+ * The image is not reduced anymore once it is edited.
+ * @return bool true if the original image is reduced.
+ **/ 
+bool DkBasicLoader::isReduced() const {
+
+	return !mFullSize.isEmpty() && mImages.size() == 1;
+}
+
+/**
+ * Returns the size of the image in the file.
+ * @return QSize the full resolution size.
+ **/ 
+QSize DkBasicLoader::fullSize() const {
+
+	if (isReduced())
+		return mFullSize;
+
+	return image().size();
+}
+
 /**
  * Loads special RAW files that are generated by the Hamamatsu camera.
  * @param fileName the filename of the file to be loaded.
@@ -394,6 +573,212 @@ bool DkBasicLoader::loadRohFile(const QString& filePath, QSharedPointer<QByteArr
 	return imgLoaded;
 }
 
+#ifdef WITH_LIBRAW
+/**
+ * LibRaw's progress callback.
+ * @return int != 0 if LibRaw should stop (the loader was canceled).
+ **/ 
+static int rawProgressCallback(void* data, enum LibRaw_progress, int, int) {
+
+	const DkBasicLoader* loader = static_cast<const DkBasicLoader*>(data);
+	return loader->isCanceled() ? 1 : 0;
+}
+
+/**
+ * Returns the 16 bit -> 8 bit gamma table of the RAW pipeline.
+ * The table only depends on LibRaw's gamma curve, so it is
+ * computed once and shared by all loaders.
+ * This function is thread-safe.
+ * @param gamma the gamma exponent (LibRaw gamm[0]).
+ * @param slope the slope of the linear part (LibRaw gamm[1]).
+ * @return QVector<uchar> the table with 65536 entries.
+ **/ 
+static QVector<uchar> rawGammaTable(double gamma, double slope) {
+
+	static QMutex mutex;
+	static QVector<uchar> table;
+	static double tableGamma = -1.0;
+	static double tableSlope = -1.0;
+
+	QMutexLocker lock(&mutex);
+
+	if (table.size() == 65536 && tableGamma == gamma && tableSlope == slope)
+		return table;
+
+	QVector<uchar> t(65536);
+
+	for (int i = 0; i < t.size(); i++) {
+
+		int v = (i <= 0.018f * 65535.0f) ? 
+			(int)(i * (float)slope / 257.0f) : 
+			(int)((1.099f*pow((float)i / 65535.0f, (float)gamma) - 0.099f) * 255);
+
+		t[i] = (uchar)qBound(0, v, 255);
+	}
+
+	table = t;
+	tableGamma = gamma;
+	tableSlope = slope;
+
+	return table;
+}
+
+/**
+ * Normalizes the RAW data according to the black point and the dynamic range.
+ * Bayer data results in a 16 bit single channel image, other data in a 16 bit RGB image.
+ * Only the region roi of the sensor is normalized (dst has its size).
+ * Each call processes a band of rows.
+ **/ 
+class DkRawNormalizeBody : public cv::ParallelLoopBody {
+
+public:
+	DkRawNormalizeBody(LibRaw& processor, const cv::Rect& roi, cv::Mat& dst, const DkBasicLoader* loader) : 
+		mProcessor(processor), mRoi(roi), mDst(dst), mLoader(loader) {}
+
+	void operator()(const cv::Range& rows) const override {
+
+		const libraw_data_t& d = mProcessor.imgdata;
+		int cols = d.sizes.width;
+		float black = (float)d.color.black;
+		float scale = 65535.0f / (float)(d.color.maximum - d.color.black);	// dynamic range -> 16U
+
+		for (int row = rows.start; row < rows.end; row++) {
+
+			if ((row & 63) == 0 && mLoader->isCanceled())
+				return;
+
+			int sRow = row + mRoi.y;
+			const ushort (*src)[4] = d.image + cols*sRow + mRoi.x;
+			ushort* dst = mDst.ptr<ushort>(row);
+
+			if (d.idata.filters) {
+				for (int col = 0; col < mRoi.width; col++)
+					dst[col] = cv::saturate_cast<ushort>((src[col][mProcessor.COLOR(sRow, col + mRoi.x)] - black) * scale);
+			}
+			else {
+				for (int col = 0; col < mRoi.width; col++) {
+					dst[3*col]   = cv::saturate_cast<ushort>((src[col][0] - black) * scale);
+					dst[3*col+1] = cv::saturate_cast<ushort>((src[col][1] - black) * scale);
+					dst[3*col+2] = cv::saturate_cast<ushort>((src[col][2] - black) * scale);
+				}
+			}
+		}
+	}
+
+protected:
+	LibRaw& mProcessor;
+	cv::Rect mRoi;
+	cv::Mat& mDst;
+	const DkBasicLoader* mLoader;
+};
+
+/**
+ * Bins the bayer mosaic into a (normalized) 16 bit RGB image.
+ * Each output pixel averages the colors of a factor x factor block of sensor pixels.
+ * No demosaicing is needed, so this is way faster than developing the full image.
+ * Each call processes a band of output rows.
+ **/ 
+class DkRawBinningBody : public cv::ParallelLoopBody {
+
+public:
+	DkRawBinningBody(LibRaw& processor, int factor, cv::Mat& dst, const DkBasicLoader* loader) : 
+		mProcessor(processor), mFactor(factor), mDst(dst), mLoader(loader) {}
+
+	void operator()(const cv::Range& rows) const override {
+
+		const libraw_data_t& d = mProcessor.imgdata;
+		int cols = d.sizes.width;
+		float black = (float)d.color.black;
+		float scale = 65535.0f / (float)(d.color.maximum - d.color.black);	// dynamic range -> 16U
+
+		for (int row = rows.start; row < rows.end; row++) {
+
+			if ((row & 15) == 0 && mLoader->isCanceled())
+				return;
+
+			ushort* dst = mDst.ptr<ushort>(row);
+
+			for (int col = 0; col < mDst.cols; col++) {
+
+				float sum[4] = {0, 0, 0, 0};
+				int cnt[4] = {0, 0, 0, 0};
+
+				for (int sRow = row*mFactor; sRow < (row+1)*mFactor; sRow++) {
+					
+					const ushort (*src)[4] = d.image + cols*sRow;
+					
+					for (int sCol = col*mFactor; sCol < (col+1)*mFactor; sCol++) {
+						int c = mProcessor.COLOR(sRow, sCol);
+						sum[c] += src[sCol][c];
+						cnt[c]++;
+					}
+				}
+
+				// RGBG: both greens are averaged
+				float g = (cnt[1] + cnt[3]) ? (sum[1] + sum[3]) / (cnt[1] + cnt[3]) : 0.0f;
+
+				dst[3*col]   = cv::saturate_cast<ushort>(((cnt[0] ? sum[0] / cnt[0] : 0.0f) - black) * scale);
+				dst[3*col+1] = cv::saturate_cast<ushort>((g - black) * scale);
+				dst[3*col+2] = cv::saturate_cast<ushort>(((cnt[2] ? sum[2] / cnt[2] : 0.0f) - black) * scale);
+			}
+		}
+	}
+
+protected:
+	LibRaw& mProcessor;
+	int mFactor;
+	cv::Mat& mDst;
+	const DkBasicLoader* mLoader;
+};
+
+/**
+ * Develops a band of rows of the demosaiced RAW image.
+ * White balance and color correction are fused into a single 3x3 matrix,
+ * the gamma correction is a table lookup that converts to 8 bit.
+ **/ 
+class DkRawDevelopBody : public cv::ParallelLoopBody {
+
+public:
+	DkRawDevelopBody(const cv::Mat& src, cv::Mat& dst, const float (&mat)[3][3], const QVector<uchar>& gammaTable, const DkBasicLoader* loader) : 
+		mSrc(src), mDst(dst), mGammaTable(gammaTable), mLoader(loader) {
+
+		for (int i = 0; i < 3; i++) for (int j = 0; j < 3; j++) mMat[i][j] = mat[i][j];
+	}
+
+	void operator()(const cv::Range& rows) const override {
+
+		const uchar* lut = mGammaTable.constData();
+		const float (&m)[3][3] = mMat;
+
+		for (int row = rows.start; row < rows.end; row++) {
+
+			if ((row & 63) == 0 && mLoader->isCanceled())
+				return;
+
+			const ushort* src = mSrc.ptr<ushort>(row);
+			uchar* dst = mDst.ptr<uchar>(row);
+
+			for (int col = 0; col < mSrc.cols*3; col += 3) {
+
+				float r = src[col], g = src[col+1], b = src[col+2];
+
+				// clip to 16 bit - the lut does the rest
+				dst[col]   = lut[(int)(qBound(0.0f, m[0][0]*r + m[0][1]*g + m[0][2]*b, 65535.0f) + 0.5f)];
+				dst[col+1] = lut[(int)(qBound(0.0f, m[1][0]*r + m[1][1]*g + m[1][2]*b, 65535.0f) + 0.5f)];
+				dst[col+2] = lut[(int)(qBound(0.0f, m[2][0]*r + m[2][1]*g + m[2][2]*b, 65535.0f) + 0.5f)];
+			}
+		}
+	}
+
+protected:
+	const cv::Mat& mSrc;
+	cv::Mat& mDst;
+	float mMat[3][3];
+	QVector<uchar> mGammaTable;
+	const DkBasicLoader* mLoader;
+};
+#endif
+
 /**
  * Loads the RAW file specified.
  * Note: nomacs needs to be compiled with OpenCV and LibRaw in
@@ -410,8 +795,8 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QSharedPointer<QByteArr
 
 	try {
 
-		// try to get preview image from exiv2
-		if (mMetaData) {
+		// try to get preview image from exiv2 (regions need the RAW data)
+		if (mMetaData && mRegion.isEmpty()) {
 			if (fast || Settings::param().resources().loadRawThumb == DkSettings::raw_thumb_always ||
 				Settings::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large) {
 
@@ -436,6 +821,7 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QSharedPointer<QByteArr
 #ifdef WITH_LIBRAW
 
 		LibRaw iProcessor;
+		iProcessor.set_progress_handler(rawProgressCallback, this);
 		QImage image;
 
 		int error = LIBRAW_DATA_ERROR;
@@ -473,8 +859,8 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QSharedPointer<QByteArr
 		// TODO: check actual screen resolution
 		qDebug() << "max thumb size: " << tM;
 
-		if (fast || Settings::param().resources().loadRawThumb == DkSettings::raw_thumb_always ||
-			(Settings::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large && tM >= 1920)) {
+		if (mRegion.isEmpty() && (fast || Settings::param().resources().loadRawThumb == DkSettings::raw_thumb_always ||
+			(Settings::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large && tM >= 1920))) {
 
 			// crashes here if image is broken
 			int err = iProcessor.unpack_thumb();
@@ -498,6 +884,9 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QSharedPointer<QByteArr
 				qDebug() << "error unpacking the thumb...";
 		}
 
+		if (isCanceled())
+			return false;
+
 		qDebug() << "[RAW] loading full raw file";
 
 
@@ -558,36 +947,52 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QSharedPointer<QByteArr
 		}
 
 		// 1. read raw image and normalize it according to dynamic range and black point
+		// the stages run in bands of rows on all cores
+		bool bayer = iProcessor.imgdata.idata.filters != 0;
+		unsigned long type = (unsigned long)iProcessor.imgdata.idata.filters & 255;
 
-		//dynamic range is defined by maximum - black
-		float dynamicRange = (float)(iProcessor.imgdata.color.maximum - iProcessor.imgdata.color.black);	// iProcessor.imgdata.color.channel_maximum[0]-iProcessor.imgdata.color.black;	// dynamic range
-
-		if (iProcessor.imgdata.idata.filters) {
+		// check the bayer pattern before doing any work
+		if (bayer && type != 180 && type != 30 && type != 225 && type != 75) {
+			qWarning() << "Wrong Bayer Pattern (not BG, RG, GB, GR)\n";
+			return false;
+		}
 
-			rawMat = cv::Mat(rows, cols, CV_32FC1);
+		// regions & binning need square pixels
+		bool squarePixels = iProcessor.imgdata.sizes.pixel_aspect == 1.0f;
+		int binning = squarePixels && bayer && mRegion.isEmpty() ? rawBinning(cols, rows) : 1;
 
-			for (uint row = 0; row < rows; row++) {
-				float *ptrRaw = rawMat.ptr<float>(row);
+		// develop the region (with a margin for demosaicing) - the bayer pattern has to start at the same phase
+		cv::Rect roi(0, 0, cols, rows);
+		QRect region = mRegion.intersected(QRect(0, 0, cols, rows));
 
-				for (uint col = 0; col < cols; col++) {
+		if (squarePixels && !region.isEmpty()) {
 
-					int colorIdx = iProcessor.COLOR(row, col);
-					ptrRaw[col] = (float)(iProcessor.imgdata.image[cols*(row)+col][colorIdx]);
+			int x0 = qMax(region.left() - 4, 0) & ~1;
+			int y0 = qMax(region.top() - 4, 0) & ~7;
+			int x1 = qMin(region.right() + 5, (int)cols);
+			int y1 = qMin(region.bottom() + 5, (int)rows);
+			roi = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+		}
+		else
+			region = QRect();
 
-					//correct the image values according the black point defined by the camera
-					ptrRaw[col] -= iProcessor.imgdata.color.black;
-					//normalize according the dynamic range
-					ptrRaw[col] /= dynamicRange;
-					ptrRaw[col] *= 65535;  // for conversion to 16U
-				}
-			}
+		if (binning > 1) {
+			rgbImg = cv::Mat(rows / binning, cols / binning, CV_16UC3);
+			cv::parallel_for_(cv::Range(0, rgbImg.rows), DkRawBinningBody(iProcessor, binning, rgbImg, this));
+		}
+		else {
+			rawMat = cv::Mat(roi.height, roi.width, bayer ? CV_16UC1 : CV_16UC3);
+			cv::parallel_for_(cv::Range(0, roi.height), DkRawNormalizeBody(iProcessor, roi, rawMat, this));
+		}
 
-			// 2. demosaic raw image
-			rawMat.convertTo(rawMat, CV_16U);
+		if (isCanceled())
+			return false;
 
-			//cvtColor(rawMat, rgbImg, CV_BayerBG2RGB);
-			unsigned long type = (unsigned long)iProcessor.imgdata.idata.filters;
-			type = type & 255;
+		// 2. demosaic raw image
+		if (binning > 1) {
+			// binned images are RGB already
+		}
+		else if (bayer) {
 
 			//define bayer pattern
 			if (type == 180) cvtColor(rawMat, rgbImg, CV_BayerBG2RGB);      //bitmask  10 11 01 00  -> 3(G) 2(B) 1(G) 0(R) -> RG RG RG
@@ -595,54 +1000,16 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QSharedPointer<QByteArr
 			else if (type == 30) cvtColor(rawMat, rgbImg, CV_BayerRG2RGB);		//bitmask  00 01 11 10	-> 0 1 3 2
 			else if (type == 225) cvtColor(rawMat, rgbImg, CV_BayerGB2RGB);		//bitmask  11 10 00 01
 			else if (type == 75) cvtColor(rawMat, rgbImg, CV_BayerGR2RGB);		//bitmask  01 00 10 11
-			else {
-				qWarning() << "Wrong Bayer Pattern (not BG, RG, GB, GR)\n";
-				return false;
-			}
-		}
-		else {
-
-			rawMat = cv::Mat(rows, cols, CV_32FC3);
-			rawMat.setTo(0);
-			std::vector<cv::Mat> rawCh;
-			split(rawMat, rawCh);
-
-			for (unsigned int row = 0; row < rows; row++) {
-				float *ptrR = rawCh[0].ptr<float>(row);
-				float *ptrG = rawCh[1].ptr<float>(row);
-				float *ptrB = rawCh[2].ptr<float>(row);
-				//float *ptrE = rawCh[3].ptr<float>(row);
-
-				for (unsigned int col = 0; col < cols; col++) {
-
-					ptrR[col] = (float)(iProcessor.imgdata.image[cols*(row)+col][0]);
-					ptrR[col] -= iProcessor.imgdata.color.black;
-					ptrR[col] /= dynamicRange;
-					ptrR[col] *= 65535;  // for conversion to 16U
-
-					ptrG[col] = (float)(iProcessor.imgdata.image[cols*(row)+col][1]);
-					ptrG[col] -= iProcessor.imgdata.color.black;
-					ptrG[col] /= dynamicRange;
-					ptrG[col] *= 65535;  // for conversion to 16U
-
-					ptrB[col] = (float)(iProcessor.imgdata.image[cols*(row)+col][2]);
-					ptrB[col] -= iProcessor.imgdata.color.black;
-					ptrB[col] /= dynamicRange;
-					ptrB[col] *= 65535;  // for conversion to 16U
-
-				}
-			}
-			merge(rawCh, rgbImg);
-			rgbImg.convertTo(rgbImg, CV_16U);
 		}
+		else
+			rgbImg = rawMat;
 
 		rawMat.release();
 
-		// 3.. 4., 5.: apply white balance, color correction and gamma 
+		if (isCanceled())
+			return false;
 
-		// get color correction matrix
-		float colorCorrMat[3][4] = {};
-		for (int i = 0; i < 3; i++) for (int j = 0; j < 4; j++) colorCorrMat[i][j] = iProcessor.imgdata.color.rgb_cam[i][j];
+		// 3.. 4., 5.: apply white balance, color correction and gamma 
 
 		// get camera white balance multipliers
 		float mulWhite[4];
@@ -651,13 +1018,6 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QSharedPointer<QByteArr
 		mulWhite[2] = iProcessor.imgdata.color.cam_mul[2];
 		mulWhite[3] = iProcessor.imgdata.color.cam_mul[3];
 
-		//read gamma value and create gamma table
-		float gamma = (float)iProcessor.imgdata.params.gamm[0];///(float)iProcessor.imgdata.params.gamm[1];
-		float gammaTable[65536];
-		for (int i = 0; i < 65536; i++) {
-			gammaTable[i] = (float)(1.099f*pow((float)i / 65535.0f, gamma) - 0.099f);
-		}
-
 		// normalize white balance multipliers
 		float w = (mulWhite[0] + mulWhite[1] + mulWhite[2] + mulWhite[3]) / 4.0f;
 		float maxW = 1.0f;//mulWhite[0];
@@ -680,50 +1040,22 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QSharedPointer<QByteArr
 		if (mulWhite[3] == 0)
 			mulWhite[3] = mulWhite[1];
 
-		//apply corrections
-		std::vector<cv::Mat> corrCh;
-		split(rgbImg, corrCh);
-
-		for (uint row = 0; row < rows; row++)
-		{
-			unsigned short *ptrR = corrCh[0].ptr<unsigned short>(row);
-			unsigned short *ptrG = corrCh[1].ptr<unsigned short>(row);
-			unsigned short *ptrB = corrCh[2].ptr<unsigned short>(row);
-
-			for (uint col = 0; col < cols; col++)
-			{
-				//apply white balance correction
-				int tempR = qRound(ptrR[col] * mulWhite[0]);
-				int tempG = qRound(ptrG[col] * mulWhite[1]);
-				int tempB = qRound(ptrB[col] * mulWhite[2]);
-
-				//apply color correction					
-				int corrR = qRound(colorCorrMat[0][0] * tempR + colorCorrMat[0][1] * tempG + colorCorrMat[0][2] * tempB);
-				int corrG = qRound(colorCorrMat[1][0] * tempR + colorCorrMat[1][1] * tempG + colorCorrMat[1][2] * tempB);
-				int corrB = qRound(colorCorrMat[2][0] * tempR + colorCorrMat[2][1] * tempG + colorCorrMat[2][2] * tempB);
-				// without color correction: change above three lines to the bottom ones
-				//int corrR = tempR;
-				//int corrG = tempG;
-				//int corrB = tempB;
-
-				//clipping
-				ptrR[col] = (corrR > 65535) ? 65535 : (corrR < 0) ? 0 : (unsigned short)corrR;
-				ptrG[col] = (corrG > 65535) ? 65535 : (corrG < 0) ? 0 : (unsigned short)corrG;
-				ptrB[col] = (corrB > 65535) ? 65535 : (corrB < 0) ? 0 : (unsigned short)corrB;
-
-				//apply gamma correction
-				ptrR[col] = ptrR[col] <= 0.018f * 65535.0f ? (unsigned short)(ptrR[col] * (float)iProcessor.imgdata.params.gamm[1] / 257.0f) :
-					(unsigned short)(gammaTable[ptrR[col]] * 255);
-				//									(1.099f*(float)(pow((float)ptrRaw[col], gamma))-0.099f);
-				ptrG[col] = ptrG[col] <= 0.018f * 65535.0f ? (unsigned short)(ptrG[col] * (float)iProcessor.imgdata.params.gamm[1] / 257.0f) :
-					(unsigned short)(gammaTable[ptrG[col]] * 255);
-				ptrB[col] = ptrB[col] <= 0.018f * 65535.0f ? (unsigned short)(ptrB[col] * (float)iProcessor.imgdata.params.gamm[1] / 257.0f) :
-					(unsigned short)(gammaTable[ptrB[col]] * 255);
-			}
-		}
+		// fuse white balance & color correction matrix
+		float corrMat[3][3];
+		for (int i = 0; i < 3; i++) for (int j = 0; j < 3; j++) corrMat[i][j] = iProcessor.imgdata.color.rgb_cam[i][j] * mulWhite[j];
+
+		QVector<uchar> gammaTable = rawGammaTable(iProcessor.imgdata.params.gamm[0], iProcessor.imgdata.params.gamm[1]);
+
+		cv::Mat devImg(rgbImg.rows, rgbImg.cols, CV_8UC3);
+		cv::parallel_for_(cv::Range(0, rgbImg.rows), DkRawDevelopBody(rgbImg, devImg, corrMat, gammaTable, this));
+		rgbImg = devImg;
+
+		// remove the margin
+		if (!region.isEmpty())
+			rgbImg = rgbImg(cv::Rect(region.x() - roi.x, region.y() - roi.y, region.width(), region.height()));
 
-		merge(corrCh, rgbImg);
-		rgbImg.convertTo(rgbImg, CV_8U);
+		if (isCanceled())
+			return false;
 
 		// filter color noise withe a median filter
 		if (Settings::param().resources().filterRawImages) {
@@ -741,6 +1073,7 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QSharedPointer<QByteArr
 
 				DkTimer dMed;
 
+				std::vector<cv::Mat> corrCh;
 				cvtColor(rgbImg, rgbImg, CV_RGB2YCrCb);
 				split(rgbImg, corrCh);
 
@@ -768,6 +1101,11 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QSharedPointer<QByteArr
 		img = image.copy();
 		imgLoaded = true;
 
+		// the image is smaller than the sensor
+		if (binning > 1 || !region.isEmpty())
+			mFullSize = QSize(cols, rows);
+		mBinning = binning;
+
 		iProcessor.recycle();
 
 #else
@@ -791,42 +1129,53 @@ bool DkBasicLoader::loadPSDFile(const QString&, QSharedPointer<QByteArray>) {
 #else
 bool DkBasicLoader::loadPSDFile(const QString& filePath, QSharedPointer<QByteArray> ba) {
 
+	QFile file(filePath);
+	QBuffer buffer;
+	QIODevice* device = &file;
+
 	// load from file?
-	if (!ba || ba->isEmpty()) {
-		QFile file(filePath);
+	if (!ba || ba->isEmpty())
 		file.open(QIODevice::ReadOnly);
-
-		QPsdHandler psdHandler;
-		psdHandler.setDevice(&file);	// QFile is an IODevice
-		//psdHandler.setFormat(fileInfo.suffix().toLocal8Bit());
-
-		if (psdHandler.canRead(&file)) {
-			QImage img;
-			bool success = psdHandler.read(&img);
-			setEditImage(img, tr("Original Image"));
-			
-			return success;
-		}
-	}
 	else {
-	
-		QBuffer buffer;
 		buffer.setData(*ba.data());
 		buffer.open(QIODevice::ReadOnly);
+		device = &buffer;
+	}
 
-		QPsdHandler psdHandler;
-		psdHandler.setDevice(&buffer);	// QFile is an IODevice
-		//psdHandler.setFormat(file.suffix().toLocal8Bit());
+	QPsdHandler psdHandler;
+	psdHandler.setDevice(device);	// QFile is an IODevice
 
-		if (psdHandler.canRead(&buffer)) {
-			QImage img;
-			bool success = psdHandler.read(&img);
-			setEditImage(img, tr("Original Image"));
+	if (!psdHandler.canRead(device) || isCanceled())
+		return false;
 
-			return success;
-		}
+	// psds that are just displayed do not need all pixels
+	// the handler skips rows & columns then
+	QSize fullSize = psdHandler.option(QImageIOHandler::Size).toSize();
+	int tl = qMax(mTargetSize.width(), mTargetSize.height());
+	int scale = 1;
+
+	if (tl > 0 && !fullSize.isEmpty()) {
+		QSize fitSize = fullSize.scaled(QSize(tl, tl), Qt::KeepAspectRatio);
+		
+		if (!fitSize.isEmpty())
+			scale = qMin(fullSize.width() / fitSize.width(), fullSize.height() / fitSize.height());
+	}
+
+	if (scale > 1)
+		psdHandler.setOption(QImageIOHandler::ScaledSize, QSize((fullSize.width()+scale-1)/scale, (fullSize.height()+scale-1)/scale));
+
+	QImage img;
+	bool success = psdHandler.read(&img) && !isCanceled();
+
+	if (success && scale > 1) {
+		mFullSize = fullSize;
+		qDebug() << "[DkBasicLoader] psd decoded at 1 /" << scale << "->" << img.size();
 	}
 
+	setEditImage(img, tr("Original Image"));
+
+	return success;
+
 #endif // !Q_OS_WIN
 	return false;
 }
@@ -906,10 +1255,7 @@ void DkBasicLoader::loadFileToBuffer(const QString& fileInfo, QByteArray& ba) co
 		DkZipContainer::extractImage(DkZipContainer::decodeZipFile(fileInfo), DkZipContainer::decodeImageFile(fileInfo), ba);
 #endif
 	
-	QFile file(fileInfo);
-	file.open(QIODevice::ReadOnly);
-
-	ba = file.readAll();
+	readFile(fileInfo, ba);
 }
 
 QSharedPointer<QByteArray> DkBasicLoader::loadFileToBuffer(const QString& fileInfo) const {
@@ -919,77 +1265,257 @@ QSharedPointer<QByteArray> DkBasicLoader::loadFileToBuffer(const QString& fileIn
 		return DkZipContainer::extractImage(DkZipContainer::decodeZipFile(fileInfo), DkZipContainer::decodeImageFile(fileInfo));
 #endif
 
-	QFile file(fileInfo);
-	file.open(QIODevice::ReadOnly);
+	QSharedPointer<QByteArray> ba = mapFile(fileInfo);
+	
+	if (ba)
+		return ba;
 
-	QSharedPointer<QByteArray> ba(new QByteArray(file.readAll()));
-	file.close();
+	ba = QSharedPointer<QByteArray>(new QByteArray());
+	readFile(fileInfo, *ba);
 
 	return ba;
 }
 
-bool DkBasicLoader::writeBufferToFile(const QString& fileInfo, const QSharedPointer<QByteArray> ba) const {
+// data pointers of all mapped file buffers
+static QMutex mappedBuffersMutex;
+static QSet<const char*> mappedBuffers;
 
-	if (!ba || ba->isEmpty())
-		return false;
+/**
+ * Maps the file into memory.
+ * The buffer does not own its data, the pages belong to the page cache.
+ * Modifying the buffer detaches it (deep copy) so the file is never written.
+ * The file is unmapped once the last reference to the buffer is released.
+ * @param filePath the file to be mapped.
+ * @return QSharedPointer<QByteArray> the mapped file or a null pointer if it should not be mapped.
+ **/ 
+QSharedPointer<QByteArray> DkBasicLoader::mapFile(const QString& filePath) {
 
-	QFile file(fileInfo);
-	file.open(QIODevice::WriteOnly);
-	qint64 bytesWritten = file.write(*ba.data(), ba->size());
-	file.close();
-	qDebug() << "[DkBasicLoader] buffer saved, bytes written: " << bytesWritten;
+	if (!Settings::param().resources().mapFileBuffers)
+		return QSharedPointer<QByteArray>();
 
-	if (!bytesWritten || bytesWritten == -1)
-		return false;
+#ifdef Q_OS_WIN
+	// mapped files cannot be deleted or renamed on Windows
+	Q_UNUSED(filePath);
+	return QSharedPointer<QByteArray>();
+#else
+	QFileInfo fInfo(filePath);
 
-	return true;
-}
+	// small files are cheaper to copy
+	if (!fInfo.isFile() || fInfo.size() < 512*1024 || fInfo.size() >= INT_MAX)
+		return QSharedPointer<QByteArray>();
 
-void DkBasicLoader::indexPages(const QString& filePath) {
+#if QT_VERSION >= 0x050400
+	// files on network drives might vanish while they are mapped
+	QString fsType = QStorageInfo(fInfo.absolutePath()).fileSystemType().toLower();
+	if (fsType.startsWith("nfs") || fsType.contains("cifs") || fsType.contains("smb") || fsType.startsWith("fuse"))
+		return QSharedPointer<QByteArray>();
+#endif
 
-	// reset counters
-	mNumPages = 1;
-	mPageIdx = 1;
+	QFile* file = new QFile(fInfo.absoluteFilePath());
+	uchar* data = 0;
 
-#ifdef WITH_LIBTIFF
+	if (file->open(QIODevice::ReadOnly))
+		data = file->map(0, file->size());
 
-	QFileInfo fInfo(filePath);
+	if (!data) {
+		delete file;
+		return QSharedPointer<QByteArray>();
+	}
 
-	// for now we just support tiff's
-	if (!fInfo.suffix().contains(QRegExp("(tif|tiff)", Qt::CaseInsensitive)))
-		return;
+	mappedBuffersMutex.lock();
+	mappedBuffers.insert((const char*)data);
+	mappedBuffersMutex.unlock();
 
-	// first turn off nasty warning/error dialogs - (we do the GUI : )
-	TIFFErrorHandler oldErrorHandler, oldWarningHandler;
-	oldWarningHandler = TIFFSetWarningHandler(NULL);
-	oldErrorHandler = TIFFSetErrorHandler(NULL); 
+	QByteArray* ba = new QByteArray(QByteArray::fromRawData((const char*)data, (int)file->size()));
 
-	DkTimer dt;
-	TIFF* tiff = TIFFOpen(filePath.toLatin1(), "r");	// this->mFile was here before - not sure why
+	return QSharedPointer<QByteArray>(ba, [file, data](QByteArray* ba) {
+		
+		delete ba;
+
+		mappedBuffersMutex.lock();
+		mappedBuffers.remove((const char*)data);
+		mappedBuffersMutex.unlock();
+		
+		delete file;	// unmaps the file
+	});
+#endif
+}
+
+/**
+ * Returns true if the buffer is a mapped file.
+ * Mapped buffers are not counted as private memory.
+ * @param ba the buffer.
+ * @return bool true if ba's data is mapped.
+ **/ 
+bool DkBasicLoader::isMapped(const QSharedPointer<QByteArray> ba) {
 
-	if (!tiff) 
+	if (!ba || ba->isEmpty())
+		return false;
+
+	QMutexLocker lock(&mappedBuffersMutex);
+	return mappedBuffers.contains(ba->constData());
+}
+
+/**
+ * Reads the file in chunks so that a canceled request stops early.
+ * @param filePath the file to be read.
+ * @param ba the file's content (empty if the read was canceled).
+ * @return bool true if the file was read completely.
+ **/ 
+bool DkBasicLoader::readFile(const QString& filePath, QByteArray& ba) const {
+
+	QFile file(filePath);
+	
+	if (!file.open(QIODevice::ReadOnly)) {
+		ba.clear();
+		return false;
+	}
+
+	qint64 size = file.size();
+
+	// sequential devices do not know their size
+	if (size <= 0) {
+		ba = file.readAll();
+		return true;
+	}
+
+	const qint64 chunkSize = 4*1024*1024;
+	qint64 pos = 0;
+	ba.resize(size);
+
+	while (pos < size) {
+
+		if (isCanceled()) {
+			ba.clear();
+			return false;
+		}
+
+		qint64 numRead = file.read(ba.data()+pos, qMin(chunkSize, size-pos));
+
+		if (numRead <= 0)
+			break;
+
+		pos += numRead;
+	}
+
+	ba.resize(pos);
+
+	return pos == size;
+}
+
+bool DkBasicLoader::writeBufferToFile(const QString& fileInfo, const QSharedPointer<QByteArray> ba) const {
+
+	if (!ba || ba->isEmpty())
+		return false;
+
+	// we might overwrite the file that is mapped - so copy it first
+	QByteArray data = *ba;
+	if (isMapped(ba))
+		data = QByteArray(ba->constData(), ba->size());
+
+	QFile file(fileInfo);
+	file.open(QIODevice::WriteOnly);
+	qint64 bytesWritten = file.write(data);
+	file.close();
+	qDebug() << "[DkBasicLoader] buffer saved, bytes written: " << bytesWritten;
+
+	if (!bytesWritten || bytesWritten == -1)
+		return false;
+
+	return true;
+}
+
+void DkBasicLoader::indexPages(const QString& filePath) {
+
+	// reset counters
+	mNumPages = 1;
+	mPageIdx = 1;
+
+#ifdef WITH_LIBTIFF
+
+	QFileInfo fInfo(filePath);
+
+	// for now we just support tiff's
+	if (!fInfo.suffix().contains(QRegExp("(tif|tiff)", Qt::CaseInsensitive)))
 		return;
 
-	// libtiff example
-	int dircount = 0;
+	DkTimer dt;
+	QMutexLocker lock(&mPageMutex);
 
-	do {
-		dircount++;
+	// the file might have changed - index it again
+	closePages();
 
-	} while (TIFFReadDirectory(tiff));
+	if (!openPages(filePath))
+		return;
 
-	mNumPages = dircount;
+	mNumPages = mPageOffsets.size();
 
 	if (mNumPages > 1)
 		mPageIdx = 1;
+	else
+		closePages();	// no need to keep single page files open
+
+	qDebug() << mNumPages << " TIFF directories... " << dt.getTotal();
+#endif
+
+}
+
+/**
+ * Records the directory offset of each page.
+ * Pages can then be read without walking all previous directories.
+ * Only the offsets are cached - the file is not kept open since
+ * every page read opens its own handle (see readPage).
+ * The caller has to lock mPageMutex.
+ * @param filePath the tiff file.
+ * @return bool true if the page offsets of filePath are known.
+ **/ 
+bool DkBasicLoader::openPages(const QString& filePath) {
+
+#ifdef WITH_LIBTIFF
+	if (!mPageFile.isEmpty() && mPageFile == filePath)
+		return true;
+
+	closePages();
+
+	// first turn off nasty warning/error dialogs - (we do the GUI : )
+	TIFFErrorHandler oldErrorHandler, oldWarningHandler;
+	oldWarningHandler = TIFFSetWarningHandler(NULL);
+	oldErrorHandler = TIFFSetErrorHandler(NULL); 
+
+	TIFF* tiff = TIFFOpen(filePath.toLatin1(), "r");	// this->mFile was here before - not sure why
+
+	if (tiff) {
 
-	qDebug() << dircount << " TIFF directories... " << dt.getTotal();
-	TIFFClose(tiff);
+		mPageFile = filePath;
+
+		do {
+			mPageOffsets << (quint64)TIFFCurrentDirOffset(tiff);
+		} while (!isCanceled() && TIFFReadDirectory(tiff));
+
+		TIFFClose(tiff);
+	}
 
 	TIFFSetWarningHandler(oldWarningHandler);
-	TIFFSetWarningHandler(oldErrorHandler);
+	TIFFSetErrorHandler(oldErrorHandler);
+
+	if (isCanceled())
+		closePages();
+#else
+	Q_UNUSED(filePath);
 #endif
 
+	return !mPageFile.isEmpty();
+}
+
+/**
+ * Forgets the page offsets and drops all prefetched pages.
+ * The caller has to lock mPageMutex.
+ **/ 
+void DkBasicLoader::closePages() {
+
+	mPageFile = QString();
+	mPageOffsets.clear();
+	mPageCache.clear();
 }
 
 bool DkBasicLoader::loadPage(int skipIdx) {
@@ -1007,101 +1533,853 @@ bool DkBasicLoader::loadPage(int skipIdx) {
 
 bool DkBasicLoader::loadPageAt(int pageIdx) {
 
-	bool imgLoaded = false;
+	// <= 1 since first page is loaded using qt
+	if (pageIdx > mNumPages || pageIdx < 1)
+		return false;
+
+	DkTimer dt;
+	QImage img = readPage(mFile, pageIdx);
+
+	if (img.isNull())
+		return false;
+
+	qDebug() << "[DkBasicLoader] page" << pageIdx << "loaded in" << dt.getTotal();
+	setEditImage(img, tr("Original Image"));
+
+	return true;
+}
+
+/**
+ * Reads a page of a multi-page tiff.
+ * Prefetched pages are taken from the cache.
+ * The page is decoded with its own handle (jumping to the cached
+ * directory offset) so that mPageMutex is not locked while decoding.
+ * This function is thread-safe.
+ * @param filePath the tiff file.
+ * @param pageIdx the page (1 is the first page).
+ * @param open if false, the page is only read if the file is open already.
+ * @return QImage the page or a null image.
+ **/ 
+QImage DkBasicLoader::readPage(const QString& filePath, int pageIdx, bool open) {
+
+	QImage img;
 
 #ifdef WITH_LIBTIFF
 
-	// <= 1 since first page is loaded using qt
-	if (pageIdx > mNumPages || pageIdx < 1)
-		return imgLoaded;
+	quint64 offset = 0;
+
+	{
+		QMutexLocker lock(&mPageMutex);
+
+		if (!open && (mPageFile.isEmpty() || mPageFile != filePath))
+			return img;
+
+		if (!openPages(filePath) || pageIdx < 1 || pageIdx > mPageOffsets.size())
+			return img;
+
+		if (QImage* cached = mPageCache.object(pageIdx))
+			return *cached;
+
+		offset = mPageOffsets[pageIdx-1];
+	}
 
 	// first turn off nasty warning/error dialogs - (we do the GUI : )
 	TIFFErrorHandler oldErrorHandler, oldWarningHandler;
 	oldWarningHandler = TIFFSetWarningHandler(NULL);
 	oldErrorHandler = TIFFSetErrorHandler(NULL); 
 
-	DkTimer dt;
-	TIFF* tiff = TIFFOpen(mFile.toLatin1(), "r");
-	
+	TIFF* tiff = TIFFOpen(filePath.toLatin1(), "r");
 
-	if (!tiff)
-		return imgLoaded;
+	// jump to the page's directory
+	if (tiff && TIFFSetSubDirectory(tiff, offset)) {
+
+		uint32 width = 0;
+		uint32 height = 0;
+
+		TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+		TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+
+		// init the qImage
+		img = QImage(width, height, QImage::Format_ARGB32);
+
+		const int stopOnError = 1;
+		bool imgLoaded = !img.isNull() && !isCanceled() && TIFFReadRGBAImageOriented(tiff, width, height, reinterpret_cast<uint32 *>(img.bits()), ORIENTATION_TOPLEFT, stopOnError) != 0;
+
+		if (imgLoaded) {
+			for (uint32 y=0; y<height; ++y)
+				convert32BitOrder(img.scanLine(y), width);
+		}
+		else
+			img = QImage();
+	}
+
+	if (tiff)
+		TIFFClose(tiff);
+
+	TIFFSetWarningHandler(oldWarningHandler);
+	TIFFSetErrorHandler(oldErrorHandler);
+
+#else
+	Q_UNUSED(filePath);
+	Q_UNUSED(pageIdx);
+	Q_UNUSED(open);
+#endif
+
+	return img;
+}
+
+/**
+ * Decodes the pages next to pageIdx so that paging is instant.
+ * This function is thread-safe.
+ * @param filePath the tiff file.
+ * @param pageIdx the current page.
+ **/ 
+void DkBasicLoader::prefetchPages(const QString& filePath, int pageIdx) {
 
-	uint32 width = 0;
-	uint32 height = 0;
+	// the first page is loaded using qt
+	for (int idx : {pageIdx+1, pageIdx-1}) {
 
-	// go to current directory
-	for (int idx = 1; idx < pageIdx; idx++) {
+		if (idx < 2 || idx > mNumPages || isCanceled())
+			continue;
+
+		// the file was closed if the user moved on
+		QImage img = readPage(filePath, idx, false);
+
+		QMutexLocker lock(&mPageMutex);
+		if (!img.isNull() && mPageFile == filePath && !mPageCache.contains(idx))
+			mPageCache.insert(idx, new QImage(img));
+	}
+}
+
+bool DkBasicLoader::setPageIdx(int skipIdx) {
+
+	// do nothing if we don't have tiff pages
+	if (mNumPages <= 1)
+		return false;
+
+	mPageIdxDirty = false;
+
+	int newPageIdx = mPageIdx + skipIdx;
+
+	if (newPageIdx > 0 && newPageIdx <= mNumPages) {
+		mPageIdxDirty = true;
+		mPageIdx = newPageIdx;
+	}
+
+	return mPageIdxDirty;
+}
+
+void DkBasicLoader::resetPageIdx() {
+
+	mPageIdxDirty = false;
+	mPageIdx = 1;
+
+	// the file is not displayed anymore
+	QMutexLocker lock(&mPageMutex);
+	closePages();
+}
+
+/**
+ * Returns the memory of the prefetched pages.
+ * This function is thread-safe.
+ * @return float the memory in MB.
+ **/ 
+float DkBasicLoader::pagesMemory() const {
+
+	QMutexLocker lock(&mPageMutex);
+
+	float mem = 0;
+	for (int idx : mPageCache.keys()) {
+		
+		if (const QImage* page = mPageCache.object(idx))
+			mem += DkImage::getBufferSizeFloat(page->size(), page->depth());
+	}
+
+	return mem;
+}
+
+void DkBasicLoader::convert32BitOrder(void *buffer, int width) {
+
+#ifdef WITH_LIBTIFF
+	// code from Qt QTiffHandler
+	uint32 *target = reinterpret_cast<uint32 *>(buffer);
+	for (int32 x=0; x<width; ++x) {
+		uint32 p = target[x];
+		// convert between ARGB and ABGR
+		target[x] = (p & 0xff000000)
+			| ((p & 0x00ff0000) >> 16)
+			| (p & 0x0000ff00)
+			| ((p & 0x000000ff) << 16);
+	}
+#endif
+}
+
+// DkImageHeader --------------------------------------------------------------------
+static quint32 headerUInt(const QByteArray& ba, int pos, int bytes, bool bigEndian) {
+
+	quint32 v = 0;
+
+	for (int idx = 0; idx < bytes; idx++) {
+		quint32 b = (uchar)ba.at(pos + (bigEndian ? idx : bytes-1-idx));
+		v = (v << 8) | b;
+	}
+
+	return v;
+}
+
+DkImageHeader::DkImageHeader() {
+}
+
+/**
+ * Reads the header of an image.
+ * The file is not touched if the file buffer is available.
+ * @param filePath the image's file path.
+ * @param ba the file buffer (can be empty).
+ * @return DkImageHeader the header - invalid if the format is not supported.
+ **/ 
+DkImageHeader DkImageHeader::read(const QString& filePath, QSharedPointer<QByteArray> ba) {
+
+	if (ba && !ba->isEmpty())
+		return read(*ba);
+
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::ReadOnly))
+		return DkImageHeader();
+
+	return read(&file);
+}
+
+DkImageHeader DkImageHeader::read(const QByteArray& ba) {
+
+	QBuffer buffer;
+	buffer.setData(ba);
+
+	if (!buffer.open(QIODevice::ReadOnly))
+		return DkImageHeader();
+
+	return read(&buffer);
+}
+
+DkImageHeader DkImageHeader::read(QIODevice* device) {
+
+	DkImageHeader header;
+
+	if (!device || !device->isReadable() || device->isSequential())
+		return header;
+
+	QByteArray magic = device->peek(12);
+	bool ok = false;
+
+	if (magic.startsWith("\xFF\xD8"))
+		ok = header.readJpg(device);
+	else if (magic.startsWith("\x89PNG\r\n\x1A\n"))
+		ok = header.readPng(device);
+	else if (magic.startsWith(QByteArray("II*\0", 4)) || magic.startsWith(QByteArray("MM\0*", 4)))
+		ok = header.readTiff(device);
+	else if (magic.startsWith("RIFF") && magic.mid(8, 4) == "WEBP")
+		ok = header.readWebP(device);
+
+	if (!ok)
+		return DkImageHeader();
+
+	return header;
+}
+
+bool DkImageHeader::isValid() const {
+
+	return !mSize.isEmpty();
+}
+
+QSize DkImageHeader::size() const {
+
+	return mSize;
+}
 
-		if (!TIFFReadDirectory(tiff))
+/**
+ * Returns the size of the image as it is displayed.
+ * @return QSize the size with the EXIF orientation applied.
+ **/ 
+QSize DkImageHeader::orientedSize() const {
+
+	if (qAbs(mOrientation) == 90)
+		return mSize.transposed();
+
+	return mSize;
+}
+
+int DkImageHeader::orientation() const {
+
+	return mOrientation;
+}
+
+QByteArray DkImageHeader::format() const {
+
+	return mFormat;
+}
+
+/**
+ * Walks the JPEG markers until the first frame header (SOF).
+ * Segments are skipped, just the EXIF segment is parsed for the orientation.
+ **/ 
+bool DkImageHeader::readJpg(QIODevice* device) {
+
+	if (!device->seek(2))
+		return false;
+
+	char c = 0;
+
+	while (!device->atEnd()) {
+
+		// find the marker - 0xFF might be repeated (fill bytes)
+		do {
+			if (!device->getChar(&c))
+				return false;
+		} while ((uchar)c != 0xFF);
+
+		do {
+			if (!device->getChar(&c))
+				return false;
+		} while ((uchar)c == 0xFF);
+
+		uchar marker = (uchar)c;
+
+		// end of image or start of scan without a frame header
+		if (marker == 0xD9 || marker == 0xDA)
+			return false;
+
+		// markers without a segment
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+			continue;
+
+		QByteArray lb = device->read(2);
+		if (lb.size() != 2)
+			return false;
+
+		int len = headerUInt(lb, 0, 2, true);
+		if (len < 2)
+			return false;
+
+		qint64 next = device->pos() + len - 2;
+
+		// APP1 - EXIF
+		if (marker == 0xE1 && mOrientation == 0) {
+
+			QByteArray seg = device->read(len - 2);
+
+			if (seg.startsWith(QByteArray("Exif\0\0", 6))) {
+				QBuffer exif;
+				exif.setData(seg.mid(6));
+				exif.open(QIODevice::ReadOnly);
+				readTiff(&exif, true);
+			}
+		}
+		// SOF (0xC4, 0xC8 and 0xCC are no frame headers)
+		else if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+
+			QByteArray sof = device->read(5);
+			if (sof.size() != 5)
+				return false;
+
+			mSize = QSize(headerUInt(sof, 3, 2, true), headerUInt(sof, 1, 2, true));
+			mFormat = "jpg";
+
+			return !mSize.isEmpty();
+		}
+
+		if (!device->seek(next))
 			return false;
 	}
 
-	TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
-	TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+	return false;
+}
 
-	// init the qImage
-	QImage img = QImage(width, height, QImage::Format_ARGB32);
+bool DkImageHeader::readPng(QIODevice* device) {
 
-	const int stopOnError = 1;
-	imgLoaded = TIFFReadRGBAImageOriented(tiff, width, height, reinterpret_cast<uint32 *>(img.bits()), ORIENTATION_TOPLEFT, stopOnError) != 0;
+	QByteArray h = device->read(24);
 
-	if (imgLoaded) {
-		for (uint32 y=0; y<height; ++y)
-			convert32BitOrder(img.scanLine(y), width);
+	if (h.size() != 24 || h.mid(12, 4) != "IHDR")
+		return false;
+
+	mSize = QSize(headerUInt(h, 16, 4, true), headerUInt(h, 20, 4, true));
+	mFormat = "png";
+
+	return !mSize.isEmpty();
+}
+
+/**
+ * Parses the first IFD of a TIFF (or the TIFF structure of an EXIF segment).
+ * @param device the device - its current position is the TIFF's start.
+ * @param exifOnly if true, just the orientation is read.
+ * @return bool true if the size (or orientation) was found.
+ **/ 
+bool DkImageHeader::readTiff(QIODevice* device, bool exifOnly) {
+
+	qint64 base = device->pos();
+	QByteArray h = device->read(8);
+
+	if (h.size() != 8)
+		return false;
+
+	bool be = false;
+
+	if (h.startsWith("MM"))
+		be = true;
+	else if (!h.startsWith("II"))
+		return false;
+
+	// 43 would be a BigTIFF
+	if (headerUInt(h, 2, 2, be) != 42)
+		return false;
+
+	if (!device->seek(base + headerUInt(h, 4, 4, be)))
+		return false;
+
+	QByteArray cb = device->read(2);
+	if (cb.size() != 2)
+		return false;
+
+	int numEntries = headerUInt(cb, 0, 2, be);
+	if (numEntries <= 0 || numEntries > 1000)
+		return false;
+
+	QByteArray entries = device->read(numEntries*12);
+	if (entries.size() != numEntries*12)
+		return false;
+
+	int width = 0;
+	int height = 0;
+	int orientation = 1;
+	bool reduced = false;
+
+	for (int idx = 0; idx < numEntries; idx++) {
+
+		int pos = idx*12;
+		int tag = headerUInt(entries, pos, 2, be);
+		int type = headerUInt(entries, pos+2, 2, be);
+
+		// SHORTs are left-justified in the value field
+		int value = 0;
+		if (type == 3)
+			value = headerUInt(entries, pos+8, 2, be);
+		else if (type == 4)
+			value = headerUInt(entries, pos+8, 4, be);
+		else
+			continue;
+
+		switch (tag) {
+		case 254: reduced = (value & 1) != 0; break;	// NewSubfileType (e.g. the thumbnail of a RAW)
+		case 256: width = value; break;
+		case 257: height = value; break;
+		case 274: orientation = value; break;
+		default: break;
+		}
+	}
+
+	switch (orientation) {
+	case 3: 
+	case 4: mOrientation = 180; break;
+	case 6:
+	case 7: mOrientation = 90; break;
+	case 5:
+	case 8: mOrientation = -90; break;
+	default: mOrientation = 0; break;
+	}
+
+	if (exifOnly)
+		return true;
+
+	if (reduced || width <= 0 || height <= 0)
+		return false;
+
+	mSize = QSize(width, height);
+	mFormat = "tif";
+
+	return true;
+}
+
+/**
+ * Reads the canvas size of extended (VP8X), lossy (VP8) and lossless (VP8L) WebPs.
+ **/ 
+bool DkImageHeader::readWebP(QIODevice* device) {
+
+	QByteArray h = device->read(30);
+
+	if (h.size() != 30)
+		return false;
+
+	QByteArray chunk = h.mid(12, 4);
+
+	if (chunk == "VP8X") {
+		mSize = QSize(headerUInt(h, 24, 3, false) + 1, headerUInt(h, 27, 3, false) + 1);
 	}
+	else if (chunk == "VP8 ") {
+		
+		// key frame start code
+		if (h.mid(23, 3) != QByteArray("\x9D\x01\x2A", 3))
+			return false;
+
+		mSize = QSize(headerUInt(h, 26, 2, false) & 0x3FFF, headerUInt(h, 28, 2, false) & 0x3FFF);
+	}
+	else if (chunk == "VP8L") {
+
+		if ((uchar)h.at(20) != 0x2F)
+			return false;
+
+		quint32 bits = headerUInt(h, 21, 4, false);
+		mSize = QSize((bits & 0x3FFF) + 1, ((bits >> 14) & 0x3FFF) + 1);
+	}
+
+	mFormat = "webp";
+
+	return !mSize.isEmpty();
+}
+
+// DkTiledTiff --------------------------------------------------------------------
+DkTiledTiff::DkTiledTiff(const QString& filePath) {
+
+	mFilePath = filePath;
+	mUnits.setMaxCost(256*1024);	// KB
+
+	QMutexLocker lock(&mMutex);
+	open();
+}
+
+DkTiledTiff::~DkTiledTiff() {
+
+	QMutexLocker lock(&mMutex);
+	close();
+}
 
-	TIFFClose(tiff);
+bool DkTiledTiff::isValid() const {
+
+	return !mLevels.empty();
+}
+
+/**
+ * Returns true if the TIFF is too large to be decoded at once.
+ * @return bool true if the ARGB image would exceed 256 MB.
+ **/ 
+bool DkTiledTiff::isLarge() const {
+
+	QSize s = size();
+	return (qint64)s.width() * s.height() * 4 > 256*1024*1024ll;
+}
+
+QSize DkTiledTiff::size() const {
+
+	return mLevels.empty() ? QSize() : mLevels[0].size;
+}
+
+int DkTiledTiff::numLevels() const {
+
+	return mLevels.size();
+}
+
+/**
+ * Returns the memory of the decoded tiles (strips).
+ * @return float the cache size in MB.
+ **/ 
+float DkTiledTiff::memoryUsage() const {
+
+	QMutexLocker lock(&mMutex);
+	return mUnits.totalCost() / 1024.0f;
+}
+
+/**
+ * Opens the TIFF & indexes the pyramid of its first page.
+ * The caller has to lock the mutex.
+ * @return bool true if the TIFF could be opened.
+ **/ 
+bool DkTiledTiff::open() {
+
+#ifdef WITH_LIBTIFF
+
+	// first turn off nasty warning/error dialogs - (we do the GUI : )
+	TIFFErrorHandler oldErrorHandler, oldWarningHandler;
+	oldWarningHandler = TIFFSetWarningHandler(NULL);
+	oldErrorHandler = TIFFSetErrorHandler(NULL); 
+
+	mTiff = TIFFOpen(mFilePath.toLatin1(), "r");
+
+	if (mTiff) {
+
+		Level fullRes;
+		fullRes.offset = TIFFCurrentDirOffset(mTiff);
+
+		if (readLevel(fullRes)) {
+
+			mLevels << fullRes;
+			QVector<quint64> offsets;
+
+			// pyramid stored in SubIFDs
+			uint16 numSubIfds = 0;
+			toff_t* subIfds = 0;
+
+			if (TIFFSetSubDirectory(mTiff, fullRes.offset) && TIFFGetField(mTiff, TIFFTAG_SUBIFD, &numSubIfds, &subIfds)) {
+				for (int idx = 0; idx < numSubIfds; idx++)
+					offsets << (quint64)subIfds[idx];
+			}
+
+			// pyramid stored as reduced resolution IFDs (e.g. GDAL overviews) that follow the page
+			TIFFSetSubDirectory(mTiff, fullRes.offset);
+			while (TIFFReadDirectory(mTiff)) {
+
+				uint32 type = 0;
+				if (!TIFFGetField(mTiff, TIFFTAG_SUBFILETYPE, &type) || !(type & FILETYPE_REDUCEDIMAGE))
+					break;	// the next page
+
+				offsets << (quint64)TIFFCurrentDirOffset(mTiff);
+			}
+
+			double ar = (double)fullRes.size.width() / fullRes.size.height();
+
+			for (quint64 o : offsets) {
+
+				Level l;
+				l.offset = o;
+
+				if (readLevel(l) && l.size.width() < fullRes.size.width() && 
+					qAbs((double)l.size.width() / l.size.height() - ar) < 0.02*ar)
+					mLevels << l;
+			}
+
+			// full resolution first
+			std::sort(mLevels.begin(), mLevels.end(), [](const Level& l1, const Level& l2) {
+				return l1.size.width() > l2.size.width();
+			});
+		}
+	}
 
 	TIFFSetWarningHandler(oldWarningHandler);
-	TIFFSetWarningHandler(oldErrorHandler);
+	TIFFSetErrorHandler(oldErrorHandler);
+#endif
+
+	if (mLevels.empty())
+		close();
+
+	return !mLevels.empty();
+}
+
+void DkTiledTiff::close() {
+
+#ifdef WITH_LIBTIFF
+	if (mTiff)
+		TIFFClose(mTiff);
+#endif
+	mTiff = 0;
+	mUnits.clear();
+}
+
+/**
+ * Reads the geometry of a level.
+ * The caller has to lock the mutex.
+ * @param level the level with a valid IFD offset.
+ * @return bool true if the level can be read.
+ **/ 
+bool DkTiledTiff::readLevel(Level& level) {
+
+#ifdef WITH_LIBTIFF
+	if (!mTiff || !TIFFSetSubDirectory(mTiff, level.offset))
+		return false;
+
+	uint32 width = 0, height = 0;
+	TIFFGetField(mTiff, TIFFTAG_IMAGEWIDTH, &width);
+	TIFFGetField(mTiff, TIFFTAG_IMAGELENGTH, &height);
+	level.size = QSize(width, height);
+	level.tiled = TIFFIsTiled(mTiff) != 0;
+
+	if (level.tiled) {
+		uint32 tw = 0, th = 0;
+		TIFFGetField(mTiff, TIFFTAG_TILEWIDTH, &tw);
+		TIFFGetField(mTiff, TIFFTAG_TILELENGTH, &th);
+
+		// we would need to allocate the whole tile
+		if ((quint64)tw * th * 4 > max_unit_size)
+			return false;
+
+		level.unitSize = QSize(tw, th);
+	}
+	else {
+		// huge strips (e.g. a single strip per image) are read in bands
+		uint32 rps = 0;
+		TIFFGetFieldDefaulted(mTiff, TIFFTAG_ROWSPERSTRIP, &rps);
+		quint64 maxRows = qMax((quint64)max_unit_size / ((quint64)width * 4 + 1), (quint64)1);
+		level.unitSize = QSize(width, (int)qMin((quint64)qMin(rps, height), maxRows));
+	}
+
+	return !level.size.isEmpty() && !level.unitSize.isEmpty();
+#else
+	Q_UNUSED(level);
+	return false;
+#endif
+}
+
+/**
+ * Returns the smallest level that has (at least) the scale requested.
+ * @param scale the scale w.r.t. the full resolution.
+ * @return int the level index.
+ **/ 
+int DkTiledTiff::levelIdx(double scale) const {
+
+	int minWidth = qCeil(mLevels[0].size.width() * scale * 0.99);
+
+	for (int idx = mLevels.size()-1; idx > 0; idx--) {
+
+		if (mLevels[idx].size.width() >= minWidth)
+			return idx;
+	}
+
+	return 0;
+}
+
+/**
+ * Decodes a tile (or strip) of a level.
+ * The caller has to lock the mutex.
+ * @param levelIdx the level.
+ * @param ux the tile column.
+ * @param uy the tile row (or strip index).
+ * @return QImage the decoded tile (ARGB32) - edge tiles are cropped.
+ **/ 
+QImage DkTiledTiff::unit(int levelIdx, int ux, int uy) {
+
+	quint64 key = ((quint64)levelIdx << 48) | ((quint64)uy << 24) | (quint64)ux;
+
+	if (QImage* cached = mUnits.object(key))
+		return *cached;
+
+	QImage img;
+
+#ifdef WITH_LIBTIFF
+	const Level& l = mLevels[levelIdx];
+
+	if (!TIFFSetSubDirectory(mTiff, l.offset))
+		return img;
+
+	int uw = l.unitSize.width();
+	int uh = l.unitSize.height();
+	int x = ux * uw;
+	int y = uy * uh;
+
+	// valid part of edge tiles
+	int w = qMin(uw, l.size.width() - x);
+	int h = qMin(uh, l.size.height() - y);
+
+	if (w <= 0 || h <= 0)
+		return img;
+
+	std::vector<uint32> raster;
+	
+	try {
+		raster.resize((size_t)uw * uh);
+	}
+	catch (const std::bad_alloc&) {
+		qWarning() << "[DkTiledTiff] cannot allocate" << uw << "x" << uh << "pixels";
+		return img;
+	}
+
+	int rasterRows = uh;	// libtiff fills tiles completely but bands just with the rows read
+
+	bool ok = false;
+	if (l.tiled)
+		ok = TIFFReadRGBATile(mTiff, x, y, raster.data()) != 0;
+	else {
+		// like TIFFReadRGBAStrip - but bands do not need to match the strips
+		char emsg[1024];
+		TIFFRGBAImage rImg;
+		
+		if (TIFFRGBAImageOK(mTiff, emsg) && TIFFRGBAImageBegin(&rImg, mTiff, 0, emsg)) {
+			rImg.row_offset = y;
+			rImg.col_offset = 0;
+			ok = TIFFRGBAImageGet(&rImg, raster.data(), uw, h) != 0;
+			TIFFRGBAImageEnd(&rImg);
+		}
+		rasterRows = h;
+	}
+
+	if (!ok)
+		return img;
+
+	img = QImage(w, h, QImage::Format_ARGB32);
+
+	if (img.isNull())
+		return img;
+
+	// the raster is bottom-up & ABGR
+	for (int row = 0; row < h; row++) {
+
+		const uint32* src = raster.data() + (size_t)(rasterRows-1-row) * uw;
+		uint32* dst = reinterpret_cast<uint32*>(img.scanLine(row));
+
+		for (int col = 0; col < w; col++) {
+			uint32 p = src[col];
+			dst[col] = (p & 0xff00ff00) | ((p & 0x00ff0000) >> 16) | ((p & 0x000000ff) << 16);
+		}
+	}
+
+	mUnits.insert(key, new QImage(img), qMax(img.byteCount()/1024, 1));
+#else
+	Q_UNUSED(levelIdx);
+	Q_UNUSED(ux);
+	Q_UNUSED(uy);
+#endif
+
+	return img;
+}
 
-	setEditImage(img, tr("Original Image"));
+/**
+ * Reads a region of the TIFF.
+ * Just the tiles (strips) that intersect the region are decoded.
+ * @param rect the region in full resolution coordinates.
+ * @param scale the scale of the returned image (<= 1).
+ * @return QImage the region with size rect.size()*scale.
+ **/ 
+QImage DkTiledTiff::region(const QRect& rect, double scale) {
 
-#endif
+	QMutexLocker lock(&mMutex);
 
+	QRect r = rect.intersected(QRect(QPoint(), size()));
 
-	return imgLoaded;
-}
+	if (!mTiff || r.isEmpty() || scale <= 0)
+		return QImage();
 
-bool DkBasicLoader::setPageIdx(int skipIdx) {
+	scale = qMin(scale, 1.0);
+	int li = levelIdx(scale);
+	const Level& l = mLevels[li];
 
-	// do nothing if we don't have tiff pages
-	if (mNumPages <= 1)
-		return false;
+	// the region in level coordinates
+	double lsx = (double)l.size.width() / size().width();
+	double lsy = (double)l.size.height() / size().height();
+	QRectF lr(r.x()*lsx, r.y()*lsy, r.width()*lsx, r.height()*lsy);
 
-	mPageIdxDirty = false;
+	QImage out(qMax(qRound(r.width()*scale), 1), qMax(qRound(r.height()*scale), 1), QImage::Format_ARGB32);
+	out.fill(Qt::transparent);
 
-	int newPageIdx = mPageIdx + skipIdx;
+	double fx = out.width() / lr.width();
+	double fy = out.height() / lr.height();
 
-	if (newPageIdx > 0 && newPageIdx <= mNumPages) {
-		mPageIdxDirty = true;
-		mPageIdx = newPageIdx;
-	}
+	QPainter p(&out);
+	if (qAbs(fx - 1.0) > 1e-3 || qAbs(fy - 1.0) > 1e-3)
+		p.setRenderHint(QPainter::SmoothPixmapTransform);
 
-	return mPageIdxDirty;
-}
+	QRect lri = lr.toAlignedRect().intersected(QRect(QPoint(), l.size));
+	int uw = l.unitSize.width();
+	int uh = l.unitSize.height();
 
-void DkBasicLoader::resetPageIdx() {
+	for (int uy = lri.top() / uh; uy <= lri.bottom() / uh; uy++) {
+		for (int ux = lri.left() / uw; ux <= lri.right() / uw; ux++) {
 
-	mPageIdxDirty = false;
-	mPageIdx = 1;
-}
+			QImage u = unit(li, ux, uy);
 
-void DkBasicLoader::convert32BitOrder(void *buffer, int width) {
+			if (u.isNull())
+				continue;
 
-#ifdef WITH_LIBTIFF
-	// code from Qt QTiffHandler
-	uint32 *target = reinterpret_cast<uint32 *>(buffer);
-	for (int32 x=0; x<width; ++x) {
-		uint32 p = target[x];
-		// convert between ARGB and ABGR
-		target[x] = (p & 0xff000000)
-			| ((p & 0x00ff0000) >> 16)
-			| (p & 0x0000ff00)
-			| ((p & 0x000000ff) << 16);
+			QRectF target((ux*uw - lr.x())*fx, (uy*uh - lr.y())*fy, u.width()*fx, u.height()*fy);
+			p.drawImage(target, u);
+		}
 	}
-#endif
+
+	return out;
 }
 
 QString DkBasicLoader::save(const QString& filePath, const QImage& img, int compression) {
@@ -1247,6 +2525,77 @@ bool DkBasicLoader::isContainer(const QString& filePath) {
 	return false;
 }
 
+/**
+ * Returns true if an embedded preview should be shown while the file is decoded.
+ * This is the case for RAW files and large jpgs.
+ * If RAW thumbnails are always loaded, the preview is the image anyway.
+ * @param filePath the image file.
+ * @return bool true if a preview stage makes sense.
+ **/ 
+bool DkBasicLoader::hasPreviewStage(const QString& filePath) {
+
+	if (!Settings::param().resources().progressiveDisplay)
+		return false;
+
+	QFileInfo fInfo(filePath);
+	QString suffix = fInfo.suffix().toLower();
+
+	if (suffix == "jpg" || suffix == "jpeg")
+		return fInfo.size() > 5*1024*1024;
+
+	if (Settings::param().app().rawSuffixes.contains(suffix))
+		return Settings::param().resources().loadRawThumb != DkSettings::raw_thumb_always;
+
+	return false;
+}
+
+/**
+ * Loads the embedded preview (or the exif thumbnail) of an image.
+ * This just needs the file's header and is way faster than decoding the image.
+ * The preview is rotated according to its exif orientation.
+ * Previews smaller than size are scaled up so that they do not jump once the image arrives.
+ * This function is thread-safe.
+ * @param filePath the image file.
+ * @param ba the file buffer (might be empty).
+ * @param size the display size (might be empty).
+ * @return QImage the preview or a null image if there is none.
+ **/ 
+QImage DkBasicLoader::loadPreview(const QString& filePath, const QSharedPointer<QByteArray> ba, const QSize& size) {
+
+	DkMetaDataT metaData;
+	metaData.readMetaData(filePath, ba);
+
+	QImage img = metaData.getPreviewImage();
+
+	if (img.isNull())
+		img = metaData.getThumbnail();
+
+#ifdef WITH_LIBRAW
+	if (img.isNull()) {
+
+		LibRaw iProcessor;
+		int error = (ba && ba->size() >= 100) ? 
+			iProcessor.open_buffer((void*)ba->constData(), ba->size()) : 
+			iProcessor.open_file(filePath.toStdString().c_str());
+
+		if (error == LIBRAW_SUCCESS && iProcessor.unpack_thumb() == LIBRAW_SUCCESS && 
+			iProcessor.imgdata.thumbnail.tformat == LIBRAW_THUMBNAIL_JPEG)
+			img.loadFromData((const uchar*)iProcessor.imgdata.thumbnail.thumb, iProcessor.imgdata.thumbnail.tlength);
+	}
+#endif
+
+	if (img.isNull())
+		return img;
+
+	if (!metaData.isTiff() && !Settings::param().metaData().ignoreExifOrientation)
+		img = rotate(img, metaData.getOrientation());
+
+	if (!size.isEmpty() && img.width() < size.width() && img.height() < size.height())
+		img = img.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+	return img;
+}
+
 // image editing --------------------------------------------------------------------
 /**
  * This method rotates an image.
@@ -1274,12 +2623,35 @@ void DkBasicLoader::release(bool clear) {
 	saveMetaData(mFile);
 
 	mImages.clear();
+	mFullSize = QSize();
+	mBinning = 1;
+	mTiledTiff.clear();
 	//metaData.clear();
 	
 	// TODO: where should we clear the metadata?
 	if (clear || !mMetaData->isDirty())
 		mMetaData = QSharedPointer<DkMetaDataT>(new DkMetaDataT());
 
+	if (clear) {
+		QMutexLocker lock(&mPageMutex);
+		closePages();
+	}
+
+}
+
+void DkBasicLoader::cancel() {
+
+	mCanceled.storeRelease(1);
+}
+
+void DkBasicLoader::resetCanceled() {
+
+	mCanceled.storeRelease(0);
+}
+
+bool DkBasicLoader::isCanceled() const {
+
+	return mCanceled.loadAcquire() != 0;
 }
 
 #ifdef WITH_WEBP
@@ -1752,23 +3124,168 @@ FileDownloader::FileDownloader(QUrl imageUrl, QObject *parent) : QObject(parent)
 }
 
 FileDownloader::~FileDownloader() {
+
+	mPartialWatcher.blockSignals(true);
+	DkThreadPool::instance().cancel(mPartialWatcher.future());
 }
 
 void FileDownloader::downloadFile(const QUrl& url) {
 
+	DkThreadPool::instance().cancel(mPartialWatcher.future());
+
+	// the old reply is ignored
+	if (mReply) {
+		QNetworkReply* oldReply = mReply;
+		mReply = 0;
+		oldReply->abort();
+	}
+
+	mDownloadedData.clear();
+	mReceivedData.clear();
+	mPartialImage = QImage();
+	mDecodedBytes = 0;
+	mCanceled = false;
+
 	QNetworkRequest request(url);
-	mWebCtrl.get(request);
+	mReply = mWebCtrl.get(request);
 	mUrl = url;
+
+	connect(mReply.data(), SIGNAL(readyRead()), this, SLOT(dataReceived()));
+}
+
+/**
+ * Aborts the current download.
+ * downloaded() is emitted with empty data.
+ **/ 
+void FileDownloader::cancel() {
+
+	DkThreadPool::instance().cancel(mPartialWatcher.future());
+
+	if (mReply && mReply->isRunning()) {
+		mCanceled = true;
+		mReply->abort();
+	}
+}
+
+bool FileDownloader::isCanceled() const {
+	return mCanceled;
+}
+
+void FileDownloader::dataReceived() {
+
+	QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+	
+	if (!reply || reply != mReply)
+		return;
+
+	mReceivedData.append(reply->readAll());
+
+	// byte budget
+	qint64 maxBytes = (qint64)Settings::param().resources().maxDownloadSize*1024*1024;
+	if (maxBytes > 0 && mReceivedData.size() > maxBytes) {
+		qWarning() << "[FileDownloader]" << mUrl << "exceeds" << Settings::param().resources().maxDownloadSize << "MB - aborting";
+		reply->abort();
+		return;
+	}
+
+	decodePartialImage();
+}
+
+/**
+ * Decodes the bytes received so far.
+ * Partial jpgs (especially progressive ones) show
+ * the image while the rest is still downloaded.
+ **/ 
+void FileDownloader::decodePartialImage() {
+
+	if (!Settings::param().resources().progressiveDisplay || mPartialWatcher.isRunning())
+		return;
+
+	// decode again once 20% more bytes arrived
+	qint64 minBytes = qMax(mDecodedBytes + mDecodedBytes/5, (qint64)64*1024);
+
+	if (mReceivedData.size() < minBytes)
+		return;
+
+	// jpgs start with SOI
+	if (!mReceivedData.startsWith("\xFF\xD8"))
+		return;
+
+	QByteArray ba = mReceivedData;	// implicitly shared
+	mDecodedBytes = ba.size();
+
+	connect(&mPartialWatcher, SIGNAL(finished()), this, SLOT(partialImageLoaded()), Qt::UniqueConnection);
+	mPartialWatcher.setFuture(DkThreadPool::instance().run(DkThreadPool::priority_image, [ba]() {
+		return FileDownloader::loadPartialImage(ba, 1920);
+	}));
+}
+
+QImage FileDownloader::loadPartialImage(const QByteArray& ba, int maxSize) {
+
+	QBuffer buffer;
+	buffer.setData(ba);
+	buffer.open(QIODevice::ReadOnly);
+
+	// other formats (e.g. png) fail on truncated data
+	QImageReader reader(&buffer);
+	if (reader.format() != "jpeg" && reader.format() != "jpg")
+		return QImage();
+
+	QSize s = reader.size();
+	if (s.isEmpty())
+		return QImage();
+
+	// the partial image is just displayed
+	if (qMax(s.width(), s.height()) > maxSize)
+		reader.setScaledSize(s.scaled(QSize(maxSize, maxSize), Qt::KeepAspectRatio));
+
+	QImage img;
+	if (!reader.read(&img))
+		return QImage();
+
+	return img;
+}
+
+void FileDownloader::partialImageLoaded() {
+
+	// too late?
+	if (mPartialWatcher.isCanceled() || mDownloadedData)
+		return;
+
+	QImage img = mPartialWatcher.result();
+
+	if (!img.isNull()) {
+		mPartialImage = img;
+		emit partialImageSignal();
+	}
+
+	// more data arrived in the meantime
+	decodePartialImage();
 }
 
 void FileDownloader::fileDownloaded(QNetworkReply* pReply) {
 
+	if (pReply != mReply) {
+		pReply->deleteLater();
+		return;
+	}
+
+	DkThreadPool::instance().cancel(mPartialWatcher.future());
+
 	if (pReply->error() != QNetworkReply::NoError) {
 		qWarning() << "I could not download: " << mUrl;
 		qWarning() << pReply->errorString();
 	}
 
-	mDownloadedData = QSharedPointer<QByteArray>(new QByteArray(pReply->readAll()));
+	mReceivedData.append(pReply->readAll());
+
+	// canceled downloads are incomplete
+	if (pReply->error() == QNetworkReply::OperationCanceledError)
+		mReceivedData.clear();
+
+	mDownloadedData = QSharedPointer<QByteArray>(new QByteArray(mReceivedData));
+	mReceivedData.clear();
+
 	//emit a signal
 	pReply->deleteLater();
 	emit downloaded();
@@ -1778,6 +3295,10 @@ QSharedPointer<QByteArray> FileDownloader::downloadedData() const {
 	return mDownloadedData;
 }
 
+QImage FileDownloader::partialImage() const {
+	return mPartialImage;
+}
+
 QUrl FileDownloader::getUrl() const {
 	return mUrl;
 }
@@ -1831,42 +3352,20 @@ QString DkZipContainer::decodeImageFile(const QString& encodedFileInfo) {
 
 QSharedPointer<QByteArray> DkZipContainer::extractImage(const QString& zipFile, const QString& imageFile) {
 
-	QuaZip zip(zipFile);		
-	if(!zip.open(QuaZip::mdUnzip)) 
-		return QSharedPointer<QByteArray>(new QByteArray());
-
-	qDebug() << "DkZip::extractImage filePath: " << zipFile;
-	qDebug() << "3.0 image file" << imageFile;
-
-	zip.setCurrentFile(imageFile);
-	QuaZipFile extractedFile(&zip);
-	if(!extractedFile.open(QIODevice::ReadOnly) || extractedFile.getZipError() != UNZ_OK) 
+	QSharedPointer<DkZipArchive> zip = DkZipArchive::open(zipFile);
+	
+	if (!zip)
 		return QSharedPointer<QByteArray>(new QByteArray());
 
-	QSharedPointer<QByteArray> ba(new QByteArray(extractedFile.readAll()));
-	extractedFile.close();
-
-	zip.close();
-
-	return ba;
+	return zip->extract(imageFile);
 }
 
 void DkZipContainer::extractImage(const QString& zipFile, const QString& imageFile, QByteArray& ba) {
 
-	QuaZip zip(zipFile);		
-	if(!zip.open(QuaZip::mdUnzip)) 
-		return;
-
-	zip.setCurrentFile(imageFile);
-	QuaZipFile extractedFile(&zip);
-	if(!extractedFile.open(QIODevice::ReadOnly) || extractedFile.getZipError() != UNZ_OK) 
-		return;
-
-	ba = QByteArray(extractedFile.readAll());
-	extractedFile.close();
-
-	zip.close();
-
+	QSharedPointer<QByteArray> data = extractImage(zipFile, imageFile);
+	
+	if (data && !data->isEmpty())
+		ba = *data;
 }
 
 bool DkZipContainer::isZip() const {
@@ -1894,6 +3393,216 @@ QString DkZipContainer::zipMarker() {
 	return mZipMarker;
 }
 
+// DkZipArchive --------------------------------------------------------------------
+static QMutex zipArchiveMutex;
+static QList<QSharedPointer<DkZipArchive> > zipArchives;	// most recently used first
+
+DkZipArchive::DkZipArchive(const QString& zipFile) {
+
+	mZipFile = zipFile;
+
+	QFileInfo fInfo(zipFile);
+	mModified = fInfo.lastModified();
+	mFileSize = fInfo.size();
+
+	DkTimer dt;
+	mZip = QSharedPointer<QuaZip>(new QuaZip(zipFile));
+
+	if (!mZip->open(QuaZip::mdUnzip)) {
+		qWarning() << "[DkZipArchive] could not open" << zipFile;
+		mZip.clear();
+		return;
+	}
+
+	// index the central directory
+	for (bool more = mZip->goToFirstFile(); more; more = mZip->goToNextFile()) {
+
+		unz64_file_pos pos;
+		if (unzGetFilePos64(mZip->getUnzFile(), &pos) != UNZ_OK)
+			continue;
+
+		Entry e;
+		e.dirPos = pos.pos_in_zip_directory;
+		e.fileIdx = pos.num_of_file;
+
+		QString name = mZip->getCurrentFileName();
+		mFileNames << name;
+		mIndex.insert(name, e);
+	}
+
+	// QuaZipFile needs a current file
+	mZip->goToFirstFile();
+
+	qDebug() << "[DkZipArchive]" << mIndex.size() << "entries indexed in" << dt.getTotal();
+}
+
+DkZipArchive::~DkZipArchive() {
+
+	if (mZip)
+		mZip->close();
+}
+
+/**
+ * Returns the session of a zip archive.
+ * The last archives are kept open - they are reopened if
+ * the file was changed in the meantime.
+ * @param zipFile the archive's file path.
+ * @return QSharedPointer<DkZipArchive> the archive or NULL if it is not a valid zip.
+ **/ 
+QSharedPointer<DkZipArchive> DkZipArchive::open(const QString& zipFile) {
+
+	QMutexLocker lock(&zipArchiveMutex);
+
+	for (int idx = 0; idx < zipArchives.size(); idx++) {
+
+		QSharedPointer<DkZipArchive> zip = zipArchives[idx];
+
+		if (zip->zipFile() != zipFile)
+			continue;
+
+		zipArchives.removeAt(idx);
+
+		if (zip->isModified())
+			break;
+
+		zipArchives.prepend(zip);
+		return zip;
+	}
+
+	QSharedPointer<DkZipArchive> zip(new DkZipArchive(zipFile));
+
+	if (!zip->isValid())
+		return QSharedPointer<DkZipArchive>();
+
+	zipArchives.prepend(zip);
+
+	// one for browsing, some for thumbnails/batch processing
+	while (zipArchives.size() > 4)
+		zipArchives.removeLast();
+
+	return zip;
+}
+
+/**
+ * Releases the file handle of a zip archive.
+ * Workers that still extract from the archive keep it open until they are done.
+ * @param zipFile the archive's file path.
+ **/ 
+void DkZipArchive::close(const QString& zipFile) {
+
+	QMutexLocker lock(&zipArchiveMutex);
+
+	for (int idx = zipArchives.size()-1; idx >= 0; idx--) {
+		if (zipArchives[idx]->zipFile() == zipFile)
+			zipArchives.removeAt(idx);
+	}
+}
+
+bool DkZipArchive::isValid() const {
+
+	return mZip != 0;
+}
+
+bool DkZipArchive::isModified() const {
+
+	QFileInfo fInfo(mZipFile);
+
+	return fInfo.lastModified() != mModified || fInfo.size() != mFileSize;
+}
+
+QString DkZipArchive::zipFile() const {
+
+	return mZipFile;
+}
+
+QStringList DkZipArchive::fileNames() const {
+
+	return mFileNames;
+}
+
+/**
+ * Extracts an entry.
+ * Compressed data is read while holding the lock.
+ * It is inflated afterwards so that many workers can extract concurrently.
+ * @param imageFile the entry's path within the archive.
+ * @return QSharedPointer<QByteArray> the entry's data (empty if it could not be extracted).
+ **/ 
+QSharedPointer<QByteArray> DkZipArchive::extract(const QString& imageFile) {
+
+	QSharedPointer<QByteArray> ba(new QByteArray());
+
+	int method = 0;
+	qint64 size = 0;
+	QByteArray raw = readEntry(imageFile, true, method, size);
+
+	if (method == 0) {
+		*ba = raw;	// stored
+	}
+	else if (method == Z_DEFLATED && size > 0 && size < INT_MAX) {
+
+		ba->resize((int)size);
+
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		zs.next_in = (Bytef*)raw.data();
+		zs.avail_in = raw.size();
+		zs.next_out = (Bytef*)ba->data();
+		zs.avail_out = ba->size();
+
+		// raw deflate stream - no zlib header
+		if (inflateInit2(&zs, -MAX_WBITS) == Z_OK) {
+
+			int err = inflate(&zs, Z_FINISH);
+			inflateEnd(&zs);
+
+			if (err != Z_STREAM_END || zs.total_out != (uLong)size)
+				ba->clear();
+		}
+		else
+			ba->clear();
+	}
+
+	// unknown compression or encrypted entries: let quazip do the job
+	if (ba->isEmpty() && size > 0)
+		*ba = readEntry(imageFile, false, method, size);
+
+	return ba;
+}
+
+/**
+ * Reads an entry.
+ * @param imageFile the entry's path within the archive.
+ * @param raw if true, the compressed data is returned.
+ * @param method the entry's compression method.
+ * @param size the entry's uncompressed size.
+ * @return QByteArray the data.
+ **/ 
+QByteArray DkZipArchive::readEntry(const QString& imageFile, bool raw, int& method, qint64& size) {
+
+	QMutexLocker lock(&mMutex);
+
+	if (!mZip || !mIndex.contains(imageFile))
+		return QByteArray();
+
+	Entry e = mIndex.value(imageFile);
+	unz64_file_pos pos;
+	pos.pos_in_zip_directory = e.dirPos;
+	pos.num_of_file = e.fileIdx;
+
+	if (unzGoToFilePos64(mZip->getUnzFile(), &pos) != UNZ_OK)
+		return QByteArray();
+
+	QuaZipFile extractedFile(mZip.data());
+	if (!extractedFile.open(QIODevice::ReadOnly, &method, 0, raw) || extractedFile.getZipError() != UNZ_OK)
+		return QByteArray();
+
+	size = extractedFile.usize();
+	QByteArray ba = extractedFile.readAll();
+	extractedFile.close();
+
+	return ba;
+}
+
 #endif
 
 }
@@ -32,6 +32,14 @@
 #include <QSharedPointer>
 #include <QUrl>
 #include <QImage>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QCache>
+#include <QVector>
+#include <QHash>
+#include <QDateTime>
+#include <QFutureWatcher>
+#include <QPointer>
 #pragma warning(pop)
 
 #pragma warning(disable: 4251)	// TODO: remove
@@ -64,6 +72,13 @@
 
 // Qt defines
 class QNetworkReply;
+class QIODevice;
+
+// libtiff defines
+struct tiff;
+
+// quazip defines
+class QuaZip;
 
 namespace nmc {
 
@@ -93,6 +108,49 @@ protected:
 	bool mImageInZip;
 	static QString mZipMarker;
 };
+
+/**
+ * An open zip archive.
+ * The central directory is indexed once and the file stays open,
+ * so browsing (and thumbnailing) large archives does not parse
+ * the archive for every image.
+ * Sessions are cached per zip path (see DkZipArchive::open).
+ * This class is thread-safe - entries are read sequentially
+ * but inflated concurrently.
+ **/ 
+class DllLoaderExport DkZipArchive {
+
+public:
+	~DkZipArchive();
+
+	static QSharedPointer<DkZipArchive> open(const QString& zipFile);
+	static void close(const QString& zipFile);
+
+	bool isValid() const;
+	QString zipFile() const;
+	QStringList fileNames() const;
+	QSharedPointer<QByteArray> extract(const QString& imageFile);
+
+protected:
+	DkZipArchive(const QString& zipFile);
+
+	bool isModified() const;
+	QByteArray readEntry(const QString& imageFile, bool raw, int& method, qint64& size);
+
+	struct Entry {
+		quint64 dirPos = 0;		// offset of the entry in the central directory
+		quint64 fileIdx = 0;	// index of the entry
+	};
+
+	QString mZipFile;
+	QDateTime mModified;
+	qint64 mFileSize = 0;
+
+	QSharedPointer<QuaZip> mZip;
+	QStringList mFileNames;			// central directory order
+	QHash<QString, Entry> mIndex;
+	mutable QMutex mMutex;
+};
 #endif
 
 class DllLoaderExport DkEditImage {
@@ -111,6 +169,85 @@ protected:
 
 };
 
+/**
+ * Reads the image dimensions from the file header.
+ * Just a few bytes are parsed (JPEG SOF, PNG IHDR, TIFF IFD, WebP VP8X),
+ * so this is way cheaper than a QImageReader (which locks the file).
+ * Nothing is decoded. Other formats result in an invalid header.
+ **/ 
+class DllLoaderExport DkImageHeader {
+
+public:
+	DkImageHeader();
+
+	static DkImageHeader read(const QString& filePath, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+	static DkImageHeader read(const QByteArray& ba);
+	static DkImageHeader read(QIODevice* device);
+
+	bool isValid() const;
+	QSize size() const;
+	QSize orientedSize() const;
+	int orientation() const;
+	QByteArray format() const;
+
+protected:
+	bool readJpg(QIODevice* device);
+	bool readPng(QIODevice* device);
+	bool readTiff(QIODevice* device, bool exifOnly = false);
+	bool readWebP(QIODevice* device);
+
+	QSize mSize;				// as stored in the file
+	int mOrientation = 0;		// in degrees (see DkMetaDataT::getOrientation)
+	QByteArray mFormat;
+};
+
+/**
+ * Reads regions of huge (tiled or stripped) TIFFs.
+ * Only the tiles (or strips) that intersect a region are decoded.
+ * If the TIFF has a pyramid (SubIFDs or reduced resolution IFDs),
+ * the smallest level that satisfies the requested scale is used.
+ * The file is kept open and decoded tiles are cached.
+ * This class is thread-safe.
+ **/ 
+class DllLoaderExport DkTiledTiff {
+
+public:
+	DkTiledTiff(const QString& filePath);
+	~DkTiledTiff();
+
+	enum {
+		max_unit_size = 64*1024*1024,	// bytes - larger strips are read in bands
+	};
+
+	bool isValid() const;
+	bool isLarge() const;
+	QSize size() const;
+	int numLevels() const;
+	float memoryUsage() const;
+
+	QImage region(const QRect& rect, double scale = 1.0);
+
+protected:
+	struct Level {
+		quint64 offset = 0;		// IFD offset
+		QSize size;
+		QSize unitSize;			// tile size or (width x rows per band)
+		bool tiled = false;
+	};
+
+	bool open();
+	void close();
+	bool readLevel(Level& level);
+	int levelIdx(double scale) const;
+	QImage unit(int levelIdx, int ux, int uy);
+
+	QString mFilePath;
+	struct tiff* mTiff = 0;
+	QVector<Level> mLevels;		// the first level has full resolution
+	QCache<quint64, QImage> mUnits;	// decoded tiles/strips (cost in KB)
+	mutable QMutex mMutex;
+};
+
 /**
  * This class provides image loading and editing capabilities.
  * It additionally stores the currently loaded image.
@@ -134,6 +271,7 @@ public:
 		raw_loader,
 		roh_loader,
 		hdr_loader,
+		tiled_tiff_loader,
 	};
 
 	DkBasicLoader(int mode = mode_default);
@@ -173,6 +311,8 @@ public:
 
 	bool setPageIdx(int skipIdx);
 	void resetPageIdx();
+	void prefetchPages(const QString& filePath, int pageIdx);
+	float pagesMemory() const;
 
 	QString save(const QString& filePath, const QImage& img, int compression = -1);
 	bool saveToBuffer(const QString& filePath, const QImage& img, QSharedPointer<QByteArray>& ba, int compression = -1);
@@ -182,6 +322,8 @@ public:
 	void saveMetaData(const QString& filePath);
 
 	static bool isContainer(const QString& filePath);
+	static bool hasPreviewStage(const QString& filePath);
+	static QImage loadPreview(const QString& filePath, const QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), const QSize& size = QSize());
 
 	/**
 	 * Sets a new image (if edited outside the basicLoader class)
@@ -207,6 +349,10 @@ public:
 		return mMetaData;
 	};
 
+	void setMetaData(QSharedPointer<DkMetaDataT> metaData) {
+		mMetaData = metaData;
+	};
+
 	/**
 	 * Returns the 8-bit image, which is rendered.
 	 * @return QImage an 8bit image
@@ -237,6 +383,55 @@ public:
 		return !image().isNull();
 	};
 
+	/**
+	 * Sets the size of the display.
+	 * If it is valid, JPGs are decoded with the smallest
+	 * DCT scaling (1/2, 1/4, 1/8) that still fills it and
+	 * RAWs might be binned (see DkSettings::rawSize).
+	 * @param size the display size or QSize() for full resolution decoding.
+	 **/
+	void setTargetSize(const QSize& size) {
+		mTargetSize = size;
+	};
+
+	QSize targetSize() const {
+		return mTargetSize;
+	};
+
+	/**
+	 * Restricts RAW decoding to a region of the sensor.
+	 * Only the region is developed, the decoded image has the region's size.
+	 * @param region the region in image coordinates or QRect() for the full image.
+	 **/
+	void setRegion(const QRect& region) {
+		mRegion = region;
+	};
+
+	QRect region() const {
+		return mRegion;
+	};
+
+	/**
+	 * Returns the binning factor of a RAW image (1, 2 or 4).
+	 * @return int 1 if the image was demosaiced.
+	 **/
+	int binning() const {
+		return mBinning;
+	};
+
+	bool isReduced() const;
+	QSize fullSize() const;
+
+	/**
+	 * Returns the reader of huge TIFFs.
+	 * If the TIFF is too large to be decoded at once, just
+	 * an overview is loaded and regions are read on demand.
+	 * @return QSharedPointer<DkTiledTiff> the reader or NULL for other images.
+	 **/
+	QSharedPointer<DkTiledTiff> tiledTiff() const {
+		return mTiledTiff;
+	};
+
 	void undo();
 	void redo();
 	QVector<DkEditImage>* history();
@@ -245,10 +440,20 @@ public:
 
 	void loadFileToBuffer(const QString& filePath, QByteArray& ba) const;
 	QSharedPointer<QByteArray> loadFileToBuffer(const QString& filePath) const;
+	static QSharedPointer<QByteArray> mapFile(const QString& filePath);
+	static bool isMapped(const QSharedPointer<QByteArray> ba);
 	bool writeBufferToFile(const QString& fileInfo, const QSharedPointer<QByteArray> ba) const;
 
 	void release(bool clear = false);
 
+	/**
+	 * Stops the current loadGeneral() (or buffer read) at its next check point.
+	 * This function is thread-safe. The flag is kept until resetCanceled() is called.
+	 **/
+	void cancel();
+	void resetCanceled();
+	bool isCanceled() const;
+
 
 #ifdef WITH_OPENCV
 	cv::Mat getImageCv();
@@ -288,13 +493,19 @@ signals:
 	void errorDialogSignal(const QString& msg);
 
 public slots:
-	QImage rotate(const QImage& img, int orientation);
+	static QImage rotate(const QImage& img, int orientation);
 
 protected:
 	bool loadRohFile(const QString& filePath, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
 	bool loadRawFile(const QString& filePath, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), bool fast = false);
+	bool loadReducedJpgFile(const QString& filePath, QSharedPointer<QByteArray> ba, QImage& img);
+	int rawBinning(int width, int height) const;
 	void indexPages(const QString& filePath);
+	bool openPages(const QString& filePath);
+	void closePages();
+	QImage readPage(const QString& filePath, int pageIdx, bool open = true);
 	void convert32BitOrder(void *buffer, int width);
+	bool readFile(const QString& filePath, QByteArray& ba) const;
 
 	int mLoader;
 	bool mTraining;
@@ -307,10 +518,22 @@ protected:
 	QSharedPointer<DkMetaDataT> mMetaData;
 	QVector<DkEditImage> mImages;
 	int mImageIndex = 0;
+	QAtomicInt mCanceled;
+	QSize mTargetSize;		// decode jpgs for this display size
+	QSize mFullSize;		// the image's size if it was decoded at a reduced resolution
+	QRect mRegion;			// decode just this region of RAWs
+	int mBinning = 1;		// RAW bayer binning factor
+	QSharedPointer<DkTiledTiff> mTiledTiff;
+
+	// multi-page tiffs
+	QString mPageFile;				// the file the page offsets belong to
+	QVector<quint64> mPageOffsets;	// directory offset of each page
+	QCache<int, QImage> mPageCache;	// prefetched pages
+	mutable QMutex mPageMutex;
 };
 
 // file downloader from: http://qt-project.org/wiki/Download_Data_from_URL
-class FileDownloader : public QObject {
+class DllLoaderExport FileDownloader : public QObject {
 	Q_OBJECT
 
 public:
@@ -319,19 +542,33 @@ public:
 	virtual ~FileDownloader();
 
 	QSharedPointer<QByteArray> downloadedData() const;
+	QImage partialImage() const;
 	QUrl getUrl() const;
 	void downloadFile(const QUrl& url);
+	void cancel();
+	bool isCanceled() const;
 
 signals:
 	void downloaded();
+	void partialImageSignal();
 
 private slots:
 	void fileDownloaded(QNetworkReply* pReply);
+	void dataReceived();
+	void partialImageLoaded();
 
 private:
+	void decodePartialImage();
+	static QImage loadPartialImage(const QByteArray& ba, int maxSize);
 
 	QNetworkAccessManager mWebCtrl;
+	QPointer<QNetworkReply> mReply;
 	QSharedPointer<QByteArray> mDownloadedData;
+	QByteArray mReceivedData;		// bytes that arrived so far
+	qint64 mDecodedBytes = 0;		// bytes used for the last partial image
+	bool mCanceled = false;
+	QFutureWatcher<QImage> mPartialWatcher;
+	QImage mPartialImage;
 	QUrl mUrl;
 };
 
@@ -37,7 +37,12 @@
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QObject>
 #include <QImage>
-#include <QtConcurrentRun>
+#include <QDateTime>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMutexLocker>
 
 // quazip
 #ifdef WITH_QUAZIP
@@ -54,6 +59,265 @@ namespace nmc {
 QString DkZipContainer::mZipMarker = "dIrChAr";
 #endif
 
+// DkLoaderStats --------------------------------------------------------------------
+static const int timeBinLimits[] = {10, 25, 50, 100, 250, 500, 1000, 2500};	// ms
+static const int numTimeBins = sizeof(timeBinLimits)/sizeof(int) + 1;		// + overflow
+
+DkLoaderStats::TimeHistogram::TimeHistogram() {
+
+	mBins = QVector<qint64>(numTimeBins, 0);
+}
+
+void DkLoaderStats::TimeHistogram::add(qint64 ms) {
+
+	int bIdx = 0;
+	for (; bIdx < numTimeBins-1; bIdx++) {
+		if (ms < timeBinLimits[bIdx])
+			break;
+	}
+
+	mBins[bIdx]++;
+	mCount++;
+	mTotal += ms;
+	mMax = qMax(mMax, ms);
+}
+
+QJsonObject DkLoaderStats::TimeHistogram::toJson() const {
+
+	QJsonObject o;
+	o["count"] = (double)mCount;
+	o["meanMs"] = mCount ? (double)mTotal/mCount : 0.0;
+	o["maxMs"] = (double)mMax;
+
+	QJsonArray bins;
+	for (int idx = 0; idx < mBins.size(); idx++) {
+
+		QJsonObject bin;
+		bin["lessThanMs"] = (idx < numTimeBins-1) ? timeBinLimits[idx] : -1;	// -1: overflow
+		bin["count"] = (double)mBins[idx];
+		bins.append(bin);
+	}
+	o["histogram"] = bins;
+
+	return o;
+}
+
+QString DkLoaderStats::TimeHistogram::toString() const {
+
+	QString str = QString("n: %1 mean: %2 ms max: %3 ms\n  ")
+		.arg(mCount)
+		.arg(mCount ? (double)mTotal/mCount : 0.0, 0, 'f', 1)
+		.arg(mMax);
+
+	for (int idx = 0; idx < mBins.size(); idx++) {
+		
+		QString limit = (idx < numTimeBins-1) ? QString("<%1").arg(timeBinLimits[idx]) : QString(">=%1").arg(timeBinLimits[numTimeBins-2]);
+		str += QString("%1: %2  ").arg(limit).arg(mBins[idx]);
+	}
+
+	return str;
+}
+
+DkLoaderStats::DkLoaderStats() {
+
+	mCounters = QVector<qint64>(counter_end, 0);
+}
+
+DkLoaderStats& DkLoaderStats::instance() {
+
+	static DkLoaderStats inst;
+	return inst;
+}
+
+void DkLoaderStats::count(Counter counter, qint64 value) {
+
+	QMutexLocker lock(&mMutex);
+	mCounters[counter] += value;
+}
+
+void DkLoaderStats::addDecodeTime(const QString& format, qint64 ms) {
+
+	QMutexLocker lock(&mMutex);
+	mDecodeTimes[format.toLower()].add(ms);
+}
+
+void DkLoaderStats::addLoadTime(qint64 ms) {
+
+	QMutexLocker lock(&mMutex);
+	mLoadTimes.add(ms);
+}
+
+void DkLoaderStats::addFirstPixelTime(qint64 ms) {
+
+	QMutexLocker lock(&mMutex);
+	mFirstPixelTimes.add(ms);
+}
+
+void DkLoaderStats::reset() {
+
+	QMutexLocker lock(&mMutex);
+	mCounters.fill(0);
+	mDecodeTimes.clear();
+	mLoadTimes = TimeHistogram();
+	mFirstPixelTimes = TimeHistogram();
+}
+
+QString DkLoaderStats::counterName(Counter counter) {
+
+	switch (counter) {
+	case counter_decode_hit:		return "decodeHit";
+	case counter_loading_hit:		return "loadingHit";
+	case counter_buffer_hit:		return "bufferHit";
+	case counter_miss:				return "miss";
+	case counter_files_read:		return "filesRead";
+	case counter_bytes_read:		return "bytesRead";
+	case counter_prefetch_decode:	return "prefetchDecode";
+	case counter_prefetch_buffer:	return "prefetchBuffer";
+	case counter_evicted:			return "evicted";
+	case counter_preview:			return "preview";
+	default:						return "unknown";
+	}
+}
+
+QJsonObject DkLoaderStats::toJson() const {
+
+	QMutexLocker lock(&mMutex);
+
+	QJsonObject counters;
+	for (int idx = 0; idx < counter_end; idx++)
+		counters[counterName((Counter)idx)] = (double)mCounters[idx];
+
+	QJsonObject decodeTimes;
+	for (auto it = mDecodeTimes.constBegin(); it != mDecodeTimes.constEnd(); ++it)
+		decodeTimes[it.key()] = it.value().toJson();
+
+	QJsonObject o;
+	o["counters"] = counters;
+	o["decodeTimes"] = decodeTimes;
+	o["loadTimes"] = mLoadTimes.toJson();
+	o["firstPixelTimes"] = mFirstPixelTimes.toJson();
+	o["cacheMemoryMB"] = Settings::param().resources().cacheMemory;
+	o["maxImagesCached"] = Settings::param().resources().maxImagesCached;
+
+	return o;
+}
+
+bool DkLoaderStats::saveJson(const QString& filePath) const {
+
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::WriteOnly)) {
+		qDebug() << "[DkLoaderStats] cannot write" << filePath;
+		return false;
+	}
+
+	file.write(QJsonDocument(toJson()).toJson());
+
+	return true;
+}
+
+QString DkLoaderStats::toString() const {
+
+	QMutexLocker lock(&mMutex);
+
+	QString str;
+	for (int idx = 0; idx < counter_end; idx++) {
+
+		QString val = (idx == counter_bytes_read) ? DkUtils::readableByte((float)mCounters[idx]) : QString::number(mCounters[idx]);
+		str += QString("%1: %2\n").arg(counterName((Counter)idx), -16).arg(val);
+	}
+
+	qint64 numRequests = mCounters[counter_decode_hit] + mCounters[counter_loading_hit] + mCounters[counter_buffer_hit] + mCounters[counter_miss];
+	if (numRequests > 0)
+		str += QString("hit rate: %1%\n").arg((double)(numRequests - mCounters[counter_miss])/numRequests*100.0, 0, 'f', 1);
+
+	str += "\nload times (request -> image)\n  " + mLoadTimes.toString() + "\n";
+	str += "\nfirst pixel (request -> preview or image)\n  " + mFirstPixelTimes.toString() + "\n";
+
+	str += "\ndecode times\n";
+	for (auto it = mDecodeTimes.constBegin(); it != mDecodeTimes.constEnd(); ++it)
+		str += it.key() + " " + it.value().toString() + "\n";
+
+	return str;
+}
+
+// DkSortKey --------------------------------------------------------------------
+DkSortKey::DkSortKey(const QString& fileName) {
+
+	mName = DkUtils::naturalSortKey(fileName);
+}
+
+/**
+ * Caches the file dates.
+ * This needs a stat, so it is only done if we sort by date.
+ * @param fileInfo the file's info
+ **/ 
+void DkSortKey::setFileInfo(const QFileInfo& fileInfo) {
+
+	setFileDates(fileInfo.created().toMSecsSinceEpoch(), fileInfo.lastModified().toMSecsSinceEpoch());
+}
+
+/**
+ * Sets file dates that are already known (e.g. from the folder index cache).
+ * @param created the creation date in ms since epoch
+ * @param modified the modification date in ms since epoch
+ **/ 
+void DkSortKey::setFileDates(qint64 created, qint64 modified) {
+
+	mCreated = created;
+	mModified = modified;
+	mHasFileInfo = true;
+}
+
+bool DkSortKey::hasFileInfo() const {
+
+	return mHasFileInfo;
+}
+
+qint64 DkSortKey::created() const {
+
+	return mCreated;
+}
+
+qint64 DkSortKey::modified() const {
+
+	return mModified;
+}
+
+/**
+ * Computes the random sort key.
+ * The order is random but stable for a given seed (i.e. rescanning a folder does not shuffle it again).
+ * @param seed the seed of the current shuffle
+ **/ 
+void DkSortKey::setRandomSeed(uint seed) {
+
+	mRandom = qHash(mName, seed);
+}
+
+bool DkSortKey::lessThan(const DkSortKey& o, int sortMode, int sortDir) const {
+
+	if (sortDir == DkSettings::sort_descending)
+		return o.lessThan(*this, sortMode, DkSettings::sort_ascending);
+
+	switch (sortMode) {
+	case DkSettings::sort_date_created:
+		if (mCreated != o.mCreated)
+			return mCreated < o.mCreated;
+		break;
+	case DkSettings::sort_date_modified:
+		if (mModified != o.mModified)
+			return mModified < o.mModified;
+		break;
+	case DkSettings::sort_random:
+		if (mRandom != o.mRandom)
+			return mRandom < o.mRandom;
+		break;
+	}
+
+	// sort by filename (or if the other keys are equal)
+	return mName < o.mName;
+}
+
 // DkImageContainer --------------------------------------------------------------------
 /**
  * Creates a DkImageContainer.
@@ -116,8 +380,7 @@ void DkImageContainer::clear() {
 
 	if (mLoader)
 		mLoader->release();
-	if (mFileBuffer)
-		mFileBuffer->clear();
+	releaseFileBuffer();
 	init();
 }
 
@@ -249,13 +512,45 @@ QSharedPointer<QByteArray> DkImageContainer::getFileBuffer() {
 	return mFileBuffer;
 }
 
+bool DkImageContainer::hasFileBuffer() const {
+
+	return mFileBuffer && !mFileBuffer->isEmpty();
+}
+
+bool DkImageContainer::isFileBufferMapped() const {
+
+	return DkBasicLoader::isMapped(mFileBuffer);
+}
+
+/**
+ * Releases the file buffer.
+ * Mapped buffers are dropped (which unmaps the file once nobody else uses it),
+ * all others are cleared since they might be shared with the loader.
+ **/ 
+void DkImageContainer::releaseFileBuffer() {
+
+	if (isFileBufferMapped())
+		mFileBuffer.clear();
+	else if (mFileBuffer)
+		mFileBuffer->clear();
+}
+
 float DkImageContainer::getMemoryUsage() const {
 
-	if (!mLoader)
-		return 0;
+	// prefetched files have a buffer but no loader
+	// mapped files live in the page cache and can be dropped by the OS
+	float memSize = mFileBuffer && !isFileBufferMapped() ? mFileBuffer->size()/(1024.0f*1024.0f) : 0;
+
+	if (mLoader)
+		memSize += DkImage::getBufferSizeFloat(mLoader->image().size(), mLoader->image().depth());
+
+	// decoded tiles of huge tiffs
+	if (mLoader && mLoader->tiledTiff())
+		memSize += mLoader->tiledTiff()->memoryUsage();
 
-	float memSize = mFileBuffer ? mFileBuffer->size()/(1024.0f*1024.0f) : 0;
-	memSize += DkImage::getBufferSizeFloat(mLoader->image().size(), mLoader->image().depth());
+	// prefetched pages of multi-page tiffs
+	if (mLoader)
+		memSize += mLoader->pagesMemory();
 
 	return memSize;
 }
@@ -266,14 +561,46 @@ float DkImageContainer::getFileSize() const {
 }
 
 
+/**
+ * Returns the image.
+ * If the image was decoded at a reduced resolution,
+ * the full resolution is loaded first (e.g. edits & saving need all pixels).
+ * @return QImage the image at full resolution.
+ **/ 
 QImage DkImageContainer::image() {
 
 	if (getLoader()->image().isNull() && getLoadState() == not_loaded)
 		loadImage();
+	else if (mLoader->isReduced())
+		loadFullResolution();
 
 	return mLoader->image();
 }
 
+/**
+ * Returns the image as it is decoded.
+ * It might be reduced (see DkBasicLoader::setTargetSize).
+ * Use this function if the image is just displayed.
+ * @return QImage the image.
+ **/ 
+QImage DkImageContainer::displayImage() {
+
+	if (getLoader()->image().isNull() && getLoadState() == not_loaded)
+		loadImage();
+
+	return mLoader->image();
+}
+
+/**
+ * Returns the size of the image at full resolution.
+ * @return QSize the image size.
+ **/ 
+QSize DkImageContainer::imageSize() {
+
+	displayImage();
+	return mLoader->fullSize();
+}
+
 void DkImageContainer::setImage(const QImage& img, const QString& editName) {
 
 	setImage(img, editName, mFilePath);
@@ -290,15 +617,31 @@ void DkImageContainer::setFilePath(const QString& filePath) {
 
 	mFilePath = filePath;
 	mFileInfo = filePath;
+	mSortKey = DkSortKey(fileName());
+}
 
-#ifdef Q_OS_WIN
-#if QT_VERSION < 0x050000
-	mFileNameStr = fileName().toStdWString();
-#else
-	mFileNameStr = DkUtils::qStringToStdWString(fileName());
-#endif
-#endif
+const DkSortKey& DkImageContainer::sortKey() const {
+
+	return mSortKey;
+}
+
+void DkImageContainer::setFileDates(qint64 created, qint64 modified) {
+
+	mSortKey.setFileDates(created, modified);
+}
+
+/**
+ * Computes the sort keys needed for sortMode.
+ * File dates are cached when they are first needed.
+ * @param sortMode the current DkSettings::sortMode
+ * @param randomSeed the seed used if images are shuffled
+ **/ 
+void DkImageContainer::updateSortKey(int sortMode, uint randomSeed) {
 
+	if ((sortMode == DkSettings::sort_date_created || sortMode == DkSettings::sort_date_modified) && !mSortKey.hasFileInfo())
+		mSortKey.setFileInfo(mFileInfo);
+	else if (sortMode == DkSettings::sort_random)
+		mSortKey.setRandomSeed(randomSeed);
 }
 
 bool DkImageContainer::hasImage() const {
@@ -309,6 +652,33 @@ bool DkImageContainer::hasImage() const {
 	return mLoader->hasImage();
 }
 
+bool DkImageContainer::isReduced() const {
+
+	return mLoader && mLoader->isReduced();
+}
+
+/**
+ * Returns true if just an overview of a huge TIFF is loaded.
+ * Overviews cannot be replaced by the full resolution,
+ * so they must neither be edited nor saved (they would replace the original).
+ * @return bool true if the image is an overview.
+ **/ 
+bool DkImageContainer::isOverview() const {
+
+	return mLoader && mLoader->tiledTiff();
+}
+
+/**
+ * Returns true if regions of the reduced image can be loaded at full resolution.
+ * This is the case for binned RAWs and huge TIFFs.
+ * Huge TIFFs are never loaded at full resolution.
+ * @return bool true if loadRegionThreaded() should be used instead of loading the full resolution.
+ **/ 
+bool DkImageContainer::hasRegions() const {
+
+	return isReduced() && (mLoader->binning() > 1 || mLoader->tiledTiff());
+}
+
 int DkImageContainer::getLoadState() const {
 
 	return mLoadState;
@@ -327,12 +697,49 @@ bool DkImageContainer::loadImage() {
 	return mLoader->hasImage();
 }
 
+/**
+ * Replaces a reduced image with its full resolution.
+ * The image is decoded with a new loader so that the
+ * reduced image stays valid until we are done.
+ * @return bool true if the image was replaced.
+ **/ 
+bool DkImageContainer::loadFullResolution() {
+
+	// huge tiffs cannot be decoded at once
+	if (!isReduced() || mEdited || mLoader->tiledTiff())
+		return false;
+
+	QSharedPointer<DkBasicLoader> loader(new DkBasicLoader());
+	loadImageIntern(mFilePath, loader, mFileBuffer);
+
+	return setFullResolution(loader);
+}
+
+bool DkImageContainer::setFullResolution(QSharedPointer<DkBasicLoader> loader) {
+
+	// the image might have been edited or released meanwhile
+	if (!loader || !loader->hasImage() || !isReduced() || mEdited)
+		return false;
+
+	// keep changes that were not saved yet (e.g. the rating)
+	if (mLoader->getMetaData()->isDirty())
+		loader->setMetaData(mLoader->getMetaData());
+
+	mLoader = loader;
+	return true;
+}
+
 bool DkImageContainer::saveImage(const QString& filePath, int compression /* = -1 */) {
-	return saveImage(filePath, getLoader()->image(), compression);
+	return saveImage(filePath, image(), compression);
 }
 
 bool DkImageContainer::saveImage(const QString& filePath, const QImage saveImg, int compression /* = -1 */) {
 
+	if (isOverview()) {
+		qWarning() << "[DkImageContainer] I won't save the overview of" << mFilePath;
+		return false;
+	}
+
 	QFileInfo saveFile = saveImageIntern(filePath, getLoader(), saveImg, compression);
 
 	saveFile.refresh();
@@ -357,13 +764,8 @@ QSharedPointer<QByteArray> DkImageContainer::loadFileToBuffer(const QString& fil
 		return QSharedPointer<QByteArray>(new QByteArray());
 	}
 
-	QFile file(fInfo.absoluteFilePath());
-	file.open(QIODevice::ReadOnly);
-
-	QSharedPointer<QByteArray> ba(new QByteArray(file.readAll()));
-	file.close();
-
-	return ba;
+	// the loader reads in chunks & stops if it is canceled
+	return getLoader()->loadFileToBuffer(fInfo.absoluteFilePath());
 }
 
 
@@ -429,13 +831,6 @@ QSharedPointer<DkZipContainer> DkImageContainer::getZipData() {
 	return mZipData;
 }
 #endif
-#ifdef Q_OS_WIN
-std::wstring DkImageContainer::getFileNameWStr() const {
-	
-	return mFileNameStr;
-}
-#endif
-
 bool imageContainerLessThanPtr(const QSharedPointer<DkImageContainer> l, const QSharedPointer<DkImageContainer> r) {
 
 	if (!l || !r)
@@ -446,53 +841,7 @@ bool imageContainerLessThanPtr(const QSharedPointer<DkImageContainer> l, const Q
 
 bool imageContainerLessThan(const DkImageContainer& l, const DkImageContainer& r) {
 
-	switch(Settings::param().global().sortMode) {
-
-	case DkSettings::sort_filename:
-#ifdef Q_OS_WIN
-		// not beautiful if you take a look at the code, but:
-		// time on Win8 with compFilename:
-		//		WinAPI, indexed ( 73872 ) files in:  " 92 ms"
-		//		[DkImageLoader]  73872  containers created in  " 1.825 sec"
-		//		[DkImageLoader] after sorting:  " 52.246 sec"
-		// time on Win8 with direct wCompLogic:
-		//		WinAPI, indexed ( 73872 ) files in:  " 63 ms"
-		//		[DkImageLoader]  73872  containers created in  " 1.203 sec"
-		//		[DkImageLoader] after sorting:  " 14.407 sec"
-		if (Settings::param().global().sortDir == DkSettings::sort_ascending)
-			return DkUtils::wCompLogic(l.getFileNameWStr(), r.getFileNameWStr());
-		else
-			return !DkUtils::wCompLogic(l.getFileNameWStr(), r.getFileNameWStr());
-		break;
-#else
-		if (Settings::param().global().sortDir == DkSettings::sort_ascending)
-			return DkUtils::compFilename(l.fileInfo(), r.fileInfo());
-		else
-			return DkUtils::compFilenameInv(l.fileInfo(), r.fileInfo());
-		break;
-#endif
-
-	case DkSettings::sort_date_created:
-		if (Settings::param().global().sortDir == DkSettings::sort_ascending)
-			return DkUtils::compDateCreated(l.fileInfo(), r.fileInfo());
-		else
-			return DkUtils::compDateCreatedInv(l.fileInfo(), r.fileInfo());
-		break;
-
-	case DkSettings::sort_date_modified:
-		if (Settings::param().global().sortDir == DkSettings::sort_ascending)
-			return DkUtils::compDateModified(l.fileInfo(), r.fileInfo());
-		else
-			return DkUtils::compDateModifiedInv(l.fileInfo(), r.fileInfo());
-
-	case DkSettings::sort_random:
-		return DkUtils::compRandom(l.fileInfo(), r.fileInfo());
-
-	default:
-		// filename
-		return DkUtils::compFilename(l.fileInfo(), r.fileInfo());
-	}
-	
+	return l.sortKey().lessThan(r.sortKey(), Settings::param().global().sortMode, Settings::param().global().sortDir);
 }
 
 // DkImageContainerT --------------------------------------------------------------------
@@ -508,10 +857,22 @@ DkImageContainerT::DkImageContainerT(const QString& filePath) : DkImageContainer
 
 DkImageContainerT::~DkImageContainerT() {
 	
+	if (mLoader)
+		mLoader->cancel();
+
 	mBufferWatcher.blockSignals(true);
-	mBufferWatcher.cancel();
+	DkThreadPool::instance().cancel(mBufferWatcher.future());
 	mImageWatcher.blockSignals(true);
-	mImageWatcher.cancel();
+	DkThreadPool::instance().cancel(mImageWatcher.future());
+	mFullResWatcher.blockSignals(true);
+	DkThreadPool::instance().cancel(mFullResWatcher.future());
+	mPreviewWatcher.blockSignals(true);
+	DkThreadPool::instance().cancel(mPreviewWatcher.future());
+	if (mRegionLoader)
+		mRegionLoader->cancel();
+	mRegionWatcher.blockSignals(true);
+	DkThreadPool::instance().cancel(mRegionWatcher.future());
+	DkThreadPool::instance().cancel(mPageWatcher.future());
 
 	saveMetaData();
 
@@ -523,6 +884,9 @@ DkImageContainerT::~DkImageContainerT() {
 void DkImageContainerT::clear() {
 
 	cancel();
+	mPreview = QImage();
+	mRegionImage = QImage();
+	mRegion = QRect();
 
 	if (mFetchingImage || mFetchingBuffer)
 		return;
@@ -620,9 +984,201 @@ bool DkImageContainerT::loadImageThreaded(bool force) {
 	
 	mLoadState = loading;
 	fetchFile();
+	fetchPreview();
 	return true;
 }
 
+/**
+ * Sets the display size for the next decode.
+ * JPGs and RAWs are decoded at a reduced resolution if the display is
+ * smaller than the image (see DkBasicLoader::setTargetSize).
+ * @param size the display size.
+ **/ 
+void DkImageContainerT::setTargetSize(const QSize& size) {
+
+	getLoader()->setTargetSize(size);
+}
+
+bool DkImageContainerT::loadFullResolution() {
+
+	if (!DkImageContainer::loadFullResolution())
+		return false;
+
+	connect(mLoader.data(), SIGNAL(errorDialogSignal(const QString&)), this, SIGNAL(errorDialogSignal(const QString&)), Qt::UniqueConnection);
+	emit imageUpdatedSignal();
+
+	return true;
+}
+
+/**
+ * Loads the full resolution of a reduced image in the background.
+ * imageUpdatedSignal() is emitted once it is ready.
+ **/ 
+void DkImageContainerT::loadFullResolutionThreaded() {
+
+	if (!isReduced() || mEdited || mFullResWatcher.isRunning() || mLoader->tiledTiff())
+		return;
+
+	// create the loader here - it must not be created in the worker thread
+	QSharedPointer<DkBasicLoader> loader(new DkBasicLoader());
+	connect(loader.data(), SIGNAL(errorDialogSignal(const QString&)), this, SIGNAL(errorDialogSignal(const QString&)));
+
+	connect(&mFullResWatcher, SIGNAL(finished()), this, SLOT(fullResolutionLoaded()), Qt::UniqueConnection);
+
+	QString fp = filePath();
+	QSharedPointer<QByteArray> fileBuffer = mFileBuffer;
+
+	mFullResWatcher.setFuture(DkThreadPool::instance().run(DkThreadPool::priority_image, [this, fp, loader, fileBuffer]() {
+		return loadImageIntern(fp, loader, fileBuffer);
+	}));
+}
+
+/**
+ * Loads a region of a reduced image in the background.
+ * This is used if the user zooms into a binned RAW or a huge TIFF:
+ * just the visible part needs to be decoded.
+ * regionLoadedSignal() is emitted once it is ready.
+ * A region that is still loading is canceled.
+ * @param region the region in (full resolution) image coordinates.
+ * @param scale the scale needed - just used for TIFF pyramids, RAW regions have full resolution.
+ **/ 
+void DkImageContainerT::loadRegionThreaded(const QRect& region, double scale) {
+
+	if (!hasRegions() || mEdited || region.isEmpty())
+		return;
+
+	if (mRegionWatcher.isRunning()) {
+		if (mRegionLoader)
+			mRegionLoader->cancel();
+		DkThreadPool::instance().cancel(mRegionWatcher.future());
+	}
+
+	connect(&mRegionWatcher, SIGNAL(finished()), this, SLOT(regionLoaded()), Qt::UniqueConnection);
+	mRequestedRegion = region;
+
+	QSharedPointer<DkTiledTiff> tiff = mLoader->tiledTiff();
+
+	if (tiff) {
+		mRegionLoader.clear();
+		mRegionWatcher.setFuture(DkThreadPool::instance().run(DkThreadPool::priority_image, [tiff, region, scale]() {
+			return tiff->region(region, scale);
+		}));
+		return;
+	}
+
+	// create the loader here - it must not be created in the worker thread
+	QSharedPointer<DkBasicLoader> loader(new DkBasicLoader());
+	loader->setRegion(region);
+	mRegionLoader = loader;
+
+	QString fp = filePath();
+	QSharedPointer<QByteArray> fileBuffer = mFileBuffer;
+
+	mRegionWatcher.setFuture(DkThreadPool::instance().run(DkThreadPool::priority_image, [this, fp, loader, fileBuffer]() {
+		return loadImageIntern(fp, loader, fileBuffer)->image();
+	}));
+}
+
+void DkImageContainerT::regionLoaded() {
+
+	if (mRegionWatcher.isCanceled())
+		return;
+
+	QImage img = mRegionWatcher.result();
+	mRegionLoader.clear();
+
+	// the loader was canceled or the image is not reduced anymore
+	if (img.isNull() || !isReduced())
+		return;
+
+	mRegionImage = img;
+	mRegion = mRequestedRegion;
+
+	emit regionLoadedSignal();
+}
+
+/**
+ * Returns the last region loaded (see loadRegionThreaded).
+ * @return QImage the region - it is scaled to the display for TIFF pyramids.
+ **/ 
+QImage DkImageContainerT::regionImage() const {
+
+	return mRegionImage;
+}
+
+QRect DkImageContainerT::region() const {
+
+	return mRegion;
+}
+
+void DkImageContainerT::fullResolutionLoaded() {
+
+	if (mFullResWatcher.isCanceled())
+		return;
+
+	if (setFullResolution(mFullResWatcher.result()))
+		emit imageUpdatedSignal();
+}
+
+/**
+ * Returns the embedded preview of the image.
+ * It is only available while the selected image is being decoded.
+ * @return QImage the preview or a null image.
+ **/ 
+QImage DkImageContainerT::previewImage() const {
+
+	return mPreview;
+}
+
+/**
+ * Extracts the embedded preview of RAWs & large jpgs in the background.
+ * previewLoadedSignal() is emitted if it is ready before the image.
+ * Only the selected image needs a preview - prefetched images are decoded before we see them.
+ **/ 
+void DkImageContainerT::fetchPreview() {
+
+	if (!mSelected || mLoadState != loading || !mPreview.isNull() || mPreviewWatcher.isRunning() || isFromZip())
+		return;
+
+	QString fp = filePath();
+
+	if (!DkBasicLoader::hasPreviewStage(fp))
+		return;
+
+	// the buffer might still be fetched - read the header from the file then
+	QSharedPointer<QByteArray> fileBuffer = hasFileBuffer() ? mFileBuffer : QSharedPointer<QByteArray>();
+	QSize size = getLoader()->targetSize();
+
+	connect(&mPreviewWatcher, SIGNAL(finished()), this, SLOT(previewLoaded()), Qt::UniqueConnection);
+	mPreviewWatcher.setFuture(DkThreadPool::instance().run(DkThreadPool::priority_image, [fp, fileBuffer, size]() {
+		return DkBasicLoader::loadPreview(fp, fileBuffer, size);
+	}));
+}
+
+void DkImageContainerT::previewLoaded() {
+
+	// too late?
+	if (mPreviewWatcher.isCanceled() || mLoadState != loading || getLoader()->hasImage())
+		return;
+
+	QImage img = mPreviewWatcher.result();
+
+	if (img.isNull())
+		return;
+
+	mPreview = img;
+	emit previewLoadedSignal();
+}
+
+/**
+ * Returns true if the file is read or decoded in the background.
+ * The buffer (or image) is assigned once the thread is done.
+ **/ 
+bool DkImageContainerT::isFetching() const {
+
+	return mFetchingBuffer || mFetchingImage;
+}
+
 void DkImageContainerT::fetchFile() {
 	
 	if (mFetchingBuffer && getLoadState() == loading_canceled) {
@@ -630,7 +1186,7 @@ void DkImageContainerT::fetchFile() {
 		return;
 	}
 	if (mFetchingImage)
-		mImageWatcher.waitForFinished();
+		DkThreadPool::instance().waitForFinished(mImageWatcher.future());
 	// I think we missed to return here
 	if (mFetchingBuffer)
 		return;
@@ -641,11 +1197,16 @@ void DkImageContainerT::fetchFile() {
 		return;
 	}
 
+	// create the loader here - it must not be created in the worker thread
+	getLoader()->resetCanceled();
+
 	mFetchingBuffer = true;	// saves the threaded call
 	connect(&mBufferWatcher, SIGNAL(finished()), this, SLOT(bufferLoaded()), Qt::UniqueConnection);
 
-	mBufferWatcher.setFuture(QtConcurrent::run(this, 
-		&nmc::DkImageContainerT::loadFileToBuffer, filePath()));
+	QString fp = filePath();
+	mBufferWatcher.setFuture(DkThreadPool::instance().run(loadPriority(), [this, fp]() {
+		return loadFileToBuffer(fp);
+	}));
 }
 
 void DkImageContainerT::bufferLoaded() {
@@ -655,6 +1216,11 @@ void DkImageContainerT::bufferLoaded() {
 	if (!mBufferWatcher.isCanceled())
 		mFileBuffer = mBufferWatcher.result();
 
+	if (mFileBuffer && !mFileBuffer->isEmpty()) {
+		DkLoaderStats::instance().count(DkLoaderStats::counter_files_read);
+		DkLoaderStats::instance().count(DkLoaderStats::counter_bytes_read, mFileBuffer->size());
+	}
+
 	if (getLoadState() == loading)
 		fetchImage();
 	else if (getLoadState() == loading_canceled) {
@@ -667,7 +1233,7 @@ void DkImageContainerT::bufferLoaded() {
 void DkImageContainerT::fetchImage() {
 
 	if (mFetchingBuffer)
-		mBufferWatcher.waitForFinished();
+		DkThreadPool::instance().waitForFinished(mBufferWatcher.future());
 
 	if (mFetchingImage) {
 		mLoadState = loading;
@@ -681,11 +1247,17 @@ void DkImageContainerT::fetchImage() {
 	
 	qDebug() << "fetching: " << filePath();
 	mFetchingImage = true;
+	mLoader->resetCanceled();	// the newest request wins
 
 	connect(&mImageWatcher, SIGNAL(finished()), this, SLOT(imageLoaded()), Qt::UniqueConnection);
 
-	mImageWatcher.setFuture(QtConcurrent::run(this, 
-		&nmc::DkImageContainerT::loadImageIntern, filePath(), mLoader, mFileBuffer));
+	QString fp = filePath();
+	QSharedPointer<DkBasicLoader> loader = mLoader;
+	QSharedPointer<QByteArray> fileBuffer = mFileBuffer;
+
+	mImageWatcher.setFuture(DkThreadPool::instance().run(loadPriority(), [this, fp, loader, fileBuffer]() {
+		return loadImageIntern(fp, loader, fileBuffer);
+	}));
 }
 
 void DkImageContainerT::imageLoaded() {
@@ -698,8 +1270,16 @@ void DkImageContainerT::imageLoaded() {
 		return;
 	}
 
+	// the decode was stopped, but the image was requested again
+	if ((mImageWatcher.isCanceled() || mLoader->isCanceled()) && !mLoader->hasImage()) {
+		qDebug() << "[DkImageContainerT] restarting canceled decode:" << fileName();
+		fetchImage();
+		return;
+	}
+
 	// deliver image
-	mLoader = mImageWatcher.result();
+	if (!mImageWatcher.isCanceled())
+		mLoader = mImageWatcher.result();
 
 	loadingFinished();
 }
@@ -728,11 +1308,43 @@ void DkImageContainerT::loadingFinished() {
 	}
 
 	// clear file buffer if it exceeds a certain size?! e.g. psd files
-	if (mFileBuffer && mFileBuffer->size()/(1024.0f*1024.0f) > Settings::param().resources().cacheMemory*0.5f)
+	if (!isFileBufferMapped() && mFileBuffer && mFileBuffer->size()/(1024.0f*1024.0f) > Settings::param().resources().cacheMemory*0.5f)
 		mFileBuffer->clear();
 	
+	mPreview = QImage();
 	mLoadState = loaded;
 	emit fileLoadedSignal(true);
+
+	fetchPages();
+}
+
+/**
+ * Decodes the pages next to the current page of a multi-page tiff.
+ * Like neighbouring files, they are ready once the user pages through the file.
+ **/ 
+void DkImageContainerT::fetchPages() {
+
+	QSharedPointer<DkBasicLoader> loader = getLoader();
+
+	if (!mSelected || isFromZip() || loader->getNumPages() <= 1 || mPageWatcher.isRunning())
+		return;
+
+	QString fp = filePath();
+	int pageIdx = loader->getPageIdx();
+
+	mPageWatcher.setFuture(DkThreadPool::instance().run(DkThreadPool::priority_prefetch, [loader, fp, pageIdx]() {
+		loader->prefetchPages(fp, pageIdx);
+	}));
+}
+
+/**
+ * Drops the prefetched pages once the file is not displayed anymore.
+ * The prefetch is canceled first so that we do not wait for it.
+ **/ 
+void DkImageContainerT::resetPages() {
+
+	DkThreadPool::instance().cancel(mPageWatcher.future());
+	getLoader()->resetPageIdx();
 }
 
 void DkImageContainerT::downloadFile(const QUrl& url) {
@@ -740,6 +1352,7 @@ void DkImageContainerT::downloadFile(const QUrl& url) {
 	if (!mFileDownloader) {
 		mFileDownloader = QSharedPointer<FileDownloader>(new FileDownloader(url, this));
 		connect(mFileDownloader.data(), SIGNAL(downloaded()), this, SLOT(fileDownloaded()), Qt::UniqueConnection);
+		connect(mFileDownloader.data(), SIGNAL(partialImageSignal()), this, SLOT(partialImageDownloaded()), Qt::UniqueConnection);
 		qDebug() << "trying to download: " << url;
 	}
 	else
@@ -759,7 +1372,9 @@ void DkImageContainerT::fileDownloaded() {
 	if (!mFileBuffer || mFileBuffer->isEmpty()) {
 		qDebug() << mFileDownloader->getUrl() << " not downloaded...";
 		mEdited = false;
-		emit showInfoSignal(tr("Sorry, I could not download:\n%1").arg(mFileDownloader->getUrl().toString()));
+		mPreview = QImage();
+		if (!mFileDownloader->isCanceled())
+			emit showInfoSignal(tr("Sorry, I could not download:\n%1").arg(mFileDownloader->getUrl().toString()));
 		emit fileLoadedSignal(false);
 		mLoadState = exists_not;
 		return;
@@ -769,12 +1384,50 @@ void DkImageContainerT::fileDownloaded() {
 	fetchImage();
 }
 
+void DkImageContainerT::partialImageDownloaded() {
+
+	// too late?
+	if (!mFileDownloader || mDownloaded || getLoader()->hasImage())
+		return;
+
+	QImage img = mFileDownloader->partialImage();
+
+	if (img.isNull())
+		return;
+
+	mPreview = img;
+	emit previewLoadedSignal();
+}
+
 void DkImageContainerT::cancel() {
 
+	// stop downloading
+	if (mFileDownloader && !mDownloaded)
+		mFileDownloader->cancel();
+
+	// we do not need the full resolution anymore
+	if (mFullResWatcher.isRunning())
+		DkThreadPool::instance().cancel(mFullResWatcher.future());
+	if (mPreviewWatcher.isRunning())
+		DkThreadPool::instance().cancel(mPreviewWatcher.future());
+	if (mRegionWatcher.isRunning()) {
+		if (mRegionLoader)
+			mRegionLoader->cancel();
+		DkThreadPool::instance().cancel(mRegionWatcher.future());
+	}
+
 	if (mLoadState != loading)
 		return;
 
 	mLoadState = loading_canceled;
+
+	// stop the work - not just the result
+	if (mLoader)
+		mLoader->cancel();
+	if (mFetchingBuffer)
+		DkThreadPool::instance().cancel(mBufferWatcher.future());
+	if (mFetchingImage)
+		DkThreadPool::instance().cancel(mImageWatcher.future());
 }
 
 void DkImageContainerT::receiveUpdates(QObject* obj, bool connectSignals /* = true */) {
@@ -786,6 +1439,8 @@ void DkImageContainerT::receiveUpdates(QObject* obj, bool connectSignals /* = tr
 		connect(this, SIGNAL(showInfoSignal(const QString&, int, int)), obj, SIGNAL(showInfoSignal(const QString&, int, int)), Qt::UniqueConnection);
 		connect(this, SIGNAL(fileSavedSignal(const QString&, bool)), obj, SLOT(imageSaved(const QString&, bool)), Qt::UniqueConnection);
 		connect(this, SIGNAL(imageUpdatedSignal()), obj, SLOT(currentImageUpdated()), Qt::UniqueConnection);
+		connect(this, SIGNAL(previewLoadedSignal()), obj, SLOT(previewLoaded()), Qt::UniqueConnection);
+		connect(this, SIGNAL(regionLoadedSignal()), obj, SLOT(regionLoaded()), Qt::UniqueConnection);
 		mFileUpdateTimer.start();
 	}
 	else if (!connectSignals) {
@@ -794,11 +1449,27 @@ void DkImageContainerT::receiveUpdates(QObject* obj, bool connectSignals /* = tr
 		disconnect(this, SIGNAL(showInfoSignal(const QString&, int, int)), obj, SIGNAL(showInfoSignal(const QString&, int, int)));
 		disconnect(this, SIGNAL(fileSavedSignal(const QString&, bool)), obj, SLOT(imageSaved(const QString&, bool)));
 		disconnect(this, SIGNAL(imageUpdatedSignal()), obj, SLOT(currentImageUpdated()));
+		disconnect(this, SIGNAL(previewLoadedSignal()), obj, SLOT(previewLoaded()));
+		disconnect(this, SIGNAL(regionLoadedSignal()), obj, SLOT(regionLoaded()));
 		mFileUpdateTimer.stop();
 	}
 
 	mSelected = connectSignals;
 
+	// the selected image is loaded first
+	if (mFetchingBuffer)
+		DkThreadPool::instance().setPriority(mBufferWatcher.future(), loadPriority());
+	if (mFetchingImage)
+		DkThreadPool::instance().setPriority(mImageWatcher.future(), loadPriority());
+
+	// a prefetched image that is still loading gets its preview now
+	if (mSelected)
+		fetchPreview();
+}
+
+DkThreadPool::Priority DkImageContainerT::loadPriority() const {
+
+	return mSelected ? DkThreadPool::priority_image : DkThreadPool::priority_prefetch;
 }
 
 void DkImageContainerT::saveMetaDataThreaded() {
@@ -807,20 +1478,26 @@ void DkImageContainerT::saveMetaDataThreaded() {
 		return;
 
 	mFileUpdateTimer.stop();
-	QFuture<void> future = QtConcurrent::run(this, 
-		&nmc::DkImageContainerT::saveMetaDataIntern, filePath(), getLoader(), getFileBuffer());
+
+	QString fp = filePath();
+	QSharedPointer<DkBasicLoader> loader = getLoader();
+	QSharedPointer<QByteArray> fileBuffer = getFileBuffer();
+
+	DkThreadPool::instance().run(DkThreadPool::priority_batch, [this, fp, loader, fileBuffer]() {
+		saveMetaDataIntern(fp, loader, fileBuffer);
+	});
 
 }
 
 bool DkImageContainerT::saveImageThreaded(const QString& filePath, int compression /* = -1 */) {
 
-	return saveImageThreaded(filePath, getLoader()->image(), compression);
+	return saveImageThreaded(filePath, image(), compression);
 }
 
 
 bool DkImageContainerT::saveImageThreaded(const QString& filePath, const QImage saveImg, int compression /* = -1 */) {
 
-	mSaveImageWatcher.waitForFinished();
+	DkThreadPool::instance().waitForFinished(mSaveImageWatcher.future());
 
 	QFileInfo fInfo = filePath;
 
@@ -829,6 +1506,11 @@ bool DkImageContainerT::saveImageThreaded(const QString& filePath, const QImage
 		emit errorDialogSignal(msg);
 		return false;
 	}
+	if (isOverview()) {
+		QString msg = tr("Sorry, %1 is too large - I just display an overview which cannot be saved.\n").arg(fileName());
+		emit errorDialogSignal(msg);
+		return false;
+	}
 	if (!fInfo.absoluteDir().exists()) {
 		QString msg = tr("Sorry, the directory: %1  does not exist\n").arg(filePath);
 		emit errorDialogSignal(msg);
@@ -845,8 +1527,11 @@ bool DkImageContainerT::saveImageThreaded(const QString& filePath, const QImage
 	mFileUpdateTimer.stop();
 	connect(&mSaveImageWatcher, SIGNAL(finished()), this, SLOT(savingFinished()), Qt::UniqueConnection);
 
-	mSaveImageWatcher.setFuture(QtConcurrent::run(this, 
-		&nmc::DkImageContainerT::saveImageIntern, filePath, mLoader, saveImg, compression));
+	QSharedPointer<DkBasicLoader> loader = mLoader;
+
+	mSaveImageWatcher.setFuture(DkThreadPool::instance().run(DkThreadPool::priority_batch, [this, filePath, loader, saveImg, compression]() {
+		return saveImageIntern(filePath, loader, saveImg, compression);
+	}));
 
 	return true;
 }
@@ -865,8 +1550,7 @@ void DkImageContainerT::savingFinished() {
 		//// reset thumb - loadImageThreaded should do it anyway
 		//thumb = QSharedPointer<DkThumbNailT>(new DkThumbNailT(saveFile, loader->image()));
 
-		if (mFileBuffer)
-			mFileBuffer->clear();	// do a complete clear?
+		releaseFileBuffer();	// do a complete clear?
 		setFilePath(savePath);
 		mEdited = false;
 		mDownloaded = false;
@@ -885,7 +1569,13 @@ QSharedPointer<QByteArray> DkImageContainerT::loadFileToBuffer(const QString& fi
 
 QSharedPointer<DkBasicLoader> DkImageContainerT::loadImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer) {
 
-	return DkImageContainer::loadImageIntern(filePath, loader, fileBuffer);
+	QElapsedTimer dt;
+	dt.start();
+
+	QSharedPointer<DkBasicLoader> l = DkImageContainer::loadImageIntern(filePath, loader, fileBuffer);
+	DkLoaderStats::instance().addDecodeTime(QFileInfo(filePath).suffix(), dt.elapsed());
+
+	return l;
 }
 
 QString DkImageContainerT::saveImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression) {
@@ -31,6 +31,10 @@
 #include <QFutureWatcher>
 #include <QTimer>
 #include <QSharedPointer>
+#include <QMutex>
+#include <QMap>
+#include <QVector>
+#include <QJsonObject>
 #pragma warning(pop)		// no warnings from includes - end
 
 #pragma warning(disable: 4251)	// TODO: remove
@@ -46,6 +50,7 @@
 #endif
 
 #include "DkThumbs.h"
+#include "DkThreadPool.h"
 
 namespace nmc {
 
@@ -55,6 +60,99 @@ class DkMetaDataT;
 class DkZipContainer;
 class FileDownloader;
 
+/**
+ * Collects cache and loading statistics.
+ * It tells us if a slow image was a cache miss, a slow read or a slow decode.
+ * This class is thread-safe.
+ **/ 
+class DllLoaderExport DkLoaderStats {
+
+public:
+	enum Counter {
+		counter_decode_hit,		// the image was decoded already
+		counter_loading_hit,	// the image was being prefetched
+		counter_buffer_hit,		// the file was in memory
+		counter_miss,			// the file had to be read & decoded
+		counter_files_read,
+		counter_bytes_read,
+		counter_prefetch_decode,
+		counter_prefetch_buffer,
+		counter_evicted,
+		counter_preview,		// an embedded preview was shown before the image
+
+		counter_end
+	};
+
+	/**
+	 * Histogram of timings in ms.
+	 **/ 
+	class TimeHistogram {
+
+	public:
+		TimeHistogram();
+
+		void add(qint64 ms);
+		QJsonObject toJson() const;
+		QString toString() const;
+
+	protected:
+		QVector<qint64> mBins;
+		qint64 mCount = 0;
+		qint64 mTotal = 0;
+		qint64 mMax = 0;
+	};
+
+	static DkLoaderStats& instance();
+
+	void count(Counter counter, qint64 value = 1);
+	void addDecodeTime(const QString& format, qint64 ms);
+	void addLoadTime(qint64 ms);
+	void addFirstPixelTime(qint64 ms);
+	void reset();
+
+	QJsonObject toJson() const;
+	bool saveJson(const QString& filePath) const;
+	QString toString() const;
+
+	static QString counterName(Counter counter);
+
+private:
+	DkLoaderStats();
+
+	mutable QMutex mMutex;
+	QVector<qint64> mCounters;
+	QMap<QString, TimeHistogram> mDecodeTimes;	// per format
+	TimeHistogram mLoadTimes;					// user request -> image ready
+	TimeHistogram mFirstPixelTimes;				// user request -> preview or image shown
+};
+
+/**
+ * Precomputed sort keys of a file.
+ * Comparing keys is cheap: no natural string compare,
+ * file system access or settings lookup per comparison.
+ **/ 
+class DllLoaderExport DkSortKey {
+
+public:
+	DkSortKey(const QString& fileName = QString());
+
+	void setFileInfo(const QFileInfo& fileInfo);
+	void setFileDates(qint64 created, qint64 modified);
+	bool hasFileInfo() const;
+	qint64 created() const;
+	qint64 modified() const;
+	void setRandomSeed(uint seed);
+
+	bool lessThan(const DkSortKey& o, int sortMode, int sortDir) const;
+
+protected:
+	QString mName;			// natural sort key of the file name
+	qint64 mCreated = 0;	// ms since epoch
+	qint64 mModified = 0;	// ms since epoch
+	uint mRandom = 0;		// seeded hash of the file name
+	bool mHasFileInfo = false;
+};
+
 class DllLoaderExport DkImageContainer {
 
 public:
@@ -75,8 +173,13 @@ public:
 	bool operator>= (const DkImageContainer& o) const;
 
 	QImage image();
+	QImage displayImage();
+	QSize imageSize();
 
 	bool hasImage() const;
+	bool isReduced() const;
+	bool isOverview() const;
+	bool hasRegions() const;
 	int getLoadState() const;
 	QFileInfo fileInfo() const;
 	QString filePath() const;
@@ -93,18 +196,21 @@ public:
 	virtual QSharedPointer<DkMetaDataT> getMetaData();
 	virtual QSharedPointer<DkThumbNailT> getThumb();
 	virtual QSharedPointer<QByteArray> getFileBuffer();
+	bool hasFileBuffer() const;
+	bool isFileBufferMapped() const;
 #ifdef WITH_QUAZIP
 	QSharedPointer<DkZipContainer> getZipData();
 #endif
-#ifdef Q_OS_WIN
-	std::wstring getFileNameWStr() const;
-#endif
+	const DkSortKey& sortKey() const;
+	void updateSortKey(int sortMode, uint randomSeed);
+	void setFileDates(qint64 created, qint64 modified);
 
 	bool exists();
 	bool setPageIdx(int skipIdx);
 
 	QSharedPointer<QByteArray> loadFileToBuffer(const QString& filePath);
 	bool loadImage();
+	virtual bool loadFullResolution();
 	void setImage(const QImage& img, const QString& editName);
 	void setImage(const QImage& img, const QString& editName, const QString& filePath);
 	bool saveImage(const QString& filePath, const QImage saveImg, int compression = -1);
@@ -117,9 +223,11 @@ public:
 
 protected:
 	QSharedPointer<DkBasicLoader> loadImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer);
+	bool setFullResolution(QSharedPointer<DkBasicLoader> loader);
 	void saveMetaDataIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer = QSharedPointer<QByteArray>());
 	QString saveImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression);
 	void setFilePath(const QString& filePath);
+	void releaseFileBuffer();
 	void init();
 
 	QSharedPointer<QByteArray> mFileBuffer;
@@ -131,13 +239,11 @@ protected:
 	bool mSelected	= false;
 
 	QFileInfo mFileInfo;
+	DkSortKey mSortKey;
 
 #ifdef WITH_QUAZIP	
 	QSharedPointer<DkZipContainer> mZipData;
 #endif
-#ifdef Q_OS_WIN
-	std::wstring mFileNameStr;	// speeds up sorting of filenames on windows
-#endif
 
 private:
 	QString mFilePath;
@@ -157,14 +263,23 @@ public:
 	void fetchFile();
 	void cancel();
 	void clear();
+	void resetPages();
 	void receiveUpdates(QObject* obj, bool connectSignals = true);
 	void downloadFile(const QUrl& url);
 
 	bool loadImageThreaded(bool force = false);
+	bool loadFullResolution() override;
+	void loadFullResolutionThreaded();
+	void loadRegionThreaded(const QRect& region, double scale = 1.0);
+	void setTargetSize(const QSize& size);
+	QImage previewImage() const;
+	QImage regionImage() const;
+	QRect region() const;
 	bool saveImageThreaded(const QString& filePath, const QImage saveImg, int compression = -1);
 	bool saveImageThreaded(const QString& filePath, int compression = -1);
 	void saveMetaDataThreaded();
 	bool isFileDownloaded() const;
+	bool isFetching() const;
 
 	virtual QSharedPointer<DkBasicLoader> getLoader();
 	virtual QSharedPointer<DkThumbNailT> getThumb();
@@ -181,6 +296,8 @@ signals:
 	void errorDialogSignal(const QString& msg) const;
 	void thumbLoadedSignal(bool loaded = true) const;
 	void imageUpdatedSignal() const;
+	void previewLoadedSignal() const;
+	void regionLoadedSignal() const;
 
 public slots:
 	void checkForFileUpdates(); 
@@ -190,10 +307,17 @@ protected slots:
 	void imageLoaded();
 	void savingFinished();
 	void loadingFinished();
+	void fullResolutionLoaded();
+	void previewLoaded();
+	void regionLoaded();
 	void fileDownloaded();
+	void partialImageDownloaded();
 
 protected:
 	void fetchImage();
+	void fetchPreview();
+	void fetchPages();
+	DkThreadPool::Priority loadPriority() const;
 	
 	QSharedPointer<QByteArray> loadFileToBuffer(const QString& filePath);
 	QSharedPointer<DkBasicLoader> loadImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer);
@@ -202,10 +326,19 @@ protected:
 	
 	QFutureWatcher<QSharedPointer<QByteArray> > mBufferWatcher;
 	QFutureWatcher<QSharedPointer<DkBasicLoader> > mImageWatcher;
+	QFutureWatcher<QSharedPointer<DkBasicLoader> > mFullResWatcher;
+	QFutureWatcher<QImage> mPreviewWatcher;
+	QFutureWatcher<QImage> mRegionWatcher;
+	QFutureWatcher<void> mPageWatcher;
 	QFutureWatcher<QString> mSaveImageWatcher;
 	QFutureWatcher<bool> mSaveMetaDataWatcher;
 
 	QSharedPointer<FileDownloader> mFileDownloader;
+	QImage mPreview;	// embedded preview shown while the image is decoded
+	QSharedPointer<DkBasicLoader> mRegionLoader;
+	QImage mRegionImage;	// a region of a reduced RAW or huge TIFF
+	QRect mRegion;
+	QRect mRequestedRegion;
 
 	bool mFetchingImage = false;
 	bool mFetchingBuffer = false;
@@ -57,6 +57,7 @@
 #include <QMutex>
 #include <QFileIconProvider>
 #include <QStringList>
+#include <QSet>
 #include <QMessageBox>
 #include <QDirIterator>
 #include <QProgressDialog>
@@ -73,29 +74,880 @@
 #include <QPainter>
 #include <qmath.h>
 #include <QtConcurrentRun>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QSaveFile>
+
+#if QT_VERSION >= 0x050000
+#include <QStandardPaths>
+#else
+#include <QDesktopServices>
+#endif
+
+#include <algorithm>
+
+// quazip
+#ifdef WITH_QUAZIP
+#include <quazip/JlCompress.h>
+#endif
+
+// opencv
+#ifdef WITH_OPENCV
+
+#ifdef Q_OS_WIN
+#pragma warning(disable: 4996)
+#endif
+#endif 
+
+#ifdef WITH_LIBRAW
+#include <libraw/libraw.h>
+#elif defined(Q_OS_WIN) && !defined(SOCK_STREAM)
+#include <winsock2.h>	// needed since libraw 0.16
+#endif
+
+#pragma warning(pop)	// no warnings from includes - end
+
+namespace nmc {
+
+// DkFolderIndexCache --------------------------------------------------------------------
+static const quint32 folderIndexMagic = 0x4e4d4958;	// NMIX
+static const quint32 folderIndexVersion = 1;
+
+/**
+ * Loads the cached index of dirPath.
+ * @param dirPath the directory
+ * @param filterKey the filter settings the index was created with (see filterKey())
+ * @param entries the cached files (sorted as they were when cached)
+ * @param dirModified if not null, the folder's modification date stored with the index
+ * @return bool true if a valid index was found
+ **/ 
+bool DkFolderIndexCache::load(const QString& dirPath, const QString& filterKey, QVector<Entry>& entries, qint64* dirModified) {
+
+	QMutexLocker locker(&mutex());
+	QFile file(cacheFilePath(dirPath, "idx"));
+
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream ds(&file);
+
+	quint32 magic = 0, version = 0;
+	ds >> magic >> version;
+
+	if (magic != folderIndexMagic || version != folderIndexVersion)
+		return false;
+
+	QString cDirPath, cFilterKey;
+	qint64 cModified = -1;
+	qint32 numEntries = 0;
+	ds >> cDirPath >> cModified >> cFilterKey >> numEntries;
+
+	// the folder (or the filters) changed
+	if (ds.status() != QDataStream::Ok || cDirPath != dirPath || cFilterKey != filterKey ||
+		cModified < 0 || cModified != DkFolderIndexCache::dirModified(dirPath) || numEntries < 0 || numEntries > max_entries)
+		return false;
+
+	entries.resize(numEntries);
+	for (Entry& e : entries)
+		ds >> e.fileName >> e.created >> e.modified;
+
+	if (ds.status() != QDataStream::Ok) {
+		qDebug() << "[DkFolderIndexCache] corrupted index of" << dirPath;
+		entries.clear();
+		return false;
+	}
+
+	if (dirModified)
+		*dirModified = cModified;
+
+	return true;
+}
+
+/**
+ * Saves the index of dirPath.
+ * @param dirPath the directory
+ * @param dirModified the folder's modification date - read it before indexing the folder
+ * @param filterKey the filter settings the index was created with (see filterKey())
+ * @param entries the files
+ * @return bool true if the index was written
+ **/ 
+bool DkFolderIndexCache::save(const QString& dirPath, qint64 dirModified, const QString& filterKey, const QVector<Entry>& entries) {
+
+	if (dirModified < 0 || entries.size() > max_entries)
+		return false;
+
+	QMutexLocker locker(&mutex());
+
+	QString filePath = cacheFilePath(dirPath, "idx");
+	QDir().mkpath(QFileInfo(filePath).absolutePath());
+
+	// other instances read the index while we are writing it
+	QSaveFile file(filePath);
+
+	if (!file.open(QIODevice::WriteOnly)) {
+		qDebug() << "[DkFolderIndexCache] cannot write" << filePath;
+		return false;
+	}
+
+	QDataStream ds(&file);
+	ds << folderIndexMagic << folderIndexVersion;
+	ds << dirPath << dirModified << filterKey << (qint32)entries.size();
+
+	for (const Entry& e : entries)
+		ds << e.fileName << e.created << e.modified;
+
+	if (ds.status() != QDataStream::Ok || !file.commit())
+		return false;
+
+	prune();
+
+	return true;
+}
+
+/**
+ * Updates a valid index (e.g. if file dates are known now).
+ * @param dirPath the directory
+ * @param filterKey the filter settings the index was created with (see filterKey())
+ * @param entries the files
+ * @return bool true if the index was updated
+ **/ 
+bool DkFolderIndexCache::update(const QString& dirPath, const QString& filterKey, const QVector<Entry>& entries) {
+
+	// no one else may write the index in between
+	QMutexLocker locker(&mutex());
+
+	// we can only update an index that is up-to-date
+	QVector<Entry> cEntries;
+	qint64 cModified = -1;
+
+	if (!load(dirPath, filterKey, cEntries, &cModified) || cEntries.size() != entries.size())
+		return false;
+
+	return save(dirPath, cModified, filterKey, entries);
+}
+
+/**
+ * Loads the cached sub folders of dirPath.
+ * The list is valid if none of the folders was modified.
+ * @param dirPath the root directory
+ * @param subFolders the sub folders (without dirPath)
+ * @return bool true if a valid list was found
+ **/ 
+bool DkFolderIndexCache::loadSubFolders(const QString& dirPath, QStringList& subFolders) {
+
+	QMutexLocker locker(&mutex());
+	QFile file(cacheFilePath(dirPath, "dirs"));
+
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream ds(&file);
+
+	quint32 magic = 0, version = 0;
+	QStringList folders;
+	QVector<qint64> modified;
+	ds >> magic >> version;
+
+	if (magic != folderIndexMagic || version != folderIndexVersion)
+		return false;
+
+	ds >> folders >> modified;
+
+	if (ds.status() != QDataStream::Ok || folders.empty() || folders.size() != modified.size() || folders.first() != dirPath)
+		return false;
+
+	// one stat per folder is still way faster than scanning them
+	for (int idx = 0; idx < folders.size(); idx++) {
+		if (modified[idx] != dirModified(folders[idx]))
+			return false;
+	}
+
+	subFolders = folders.mid(1);
+
+	return true;
+}
+
+/**
+ * Saves the sub folders of a directory.
+ * @param folders the root directory followed by its sub folders
+ * @param modified the modification dates of the folders - read them before scanning
+ * @return bool true if the list was written
+ **/ 
+bool DkFolderIndexCache::saveSubFolders(const QStringList& folders, const QVector<qint64>& modified) {
+
+	if (folders.empty() || folders.size() != modified.size() || folders.size() > max_entries)
+		return false;
+
+	QMutexLocker locker(&mutex());
+
+	QString filePath = cacheFilePath(folders.first(), "dirs");
+	QDir().mkpath(QFileInfo(filePath).absolutePath());
+
+	QSaveFile file(filePath);
+
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	QDataStream ds(&file);
+	ds << folderIndexMagic << folderIndexVersion << folders << modified;
+
+	if (ds.status() != QDataStream::Ok || !file.commit())
+		return false;
+
+	prune();
+
+	return true;
+}
+
+/**
+ * Returns a string that describes all settings which change a folder's index.
+ * @param ignoreKeywords the ignore keywords
+ * @param keywords the keywords
+ * @param folderKeywords the folder filter
+ * @return QString the key
+ **/ 
+QString DkFolderIndexCache::filterKey(const QStringList& ignoreKeywords, const QStringList& keywords, const QStringList& folderKeywords) {
+
+	QStringList key;
+	key << Settings::param().app().browseFilters.join(";");
+	key << ignoreKeywords.join(";");
+	key << keywords.join(";");
+	key << folderKeywords.join(";");
+	key << QString::number(Settings::param().resources().filterDuplicats);
+	key << Settings::param().resources().preferredExtensions.join(";");
+
+	return key.join("|");
+}
+
+QStringList DkFolderIndexCache::fileNames(const QVector<Entry>& entries) {
+
+	QStringList fileNames;
+	fileNames.reserve(entries.size());
+
+	for (const Entry& e : entries)
+		fileNames.append(e.fileName);
+
+	return fileNames;
+}
+
+QVector<DkFolderIndexCache::Entry> DkFolderIndexCache::toEntries(const QStringList& fileNames) {
+
+	QVector<Entry> entries(fileNames.size());
+
+	for (int idx = 0; idx < fileNames.size(); idx++)
+		entries[idx].fileName = fileNames[idx];
+
+	return entries;
+}
+
+/**
+ * Compares the cached file dates with the files.
+ * Editing a file does not change the folder's modification date,
+ * so the cached dates are validated after the index was loaded.
+ * This function is thread-safe.
+ * @param dirPath the directory
+ * @param entries the cached files
+ * @return QVector<DkFolderIndexCache::Entry> the files with their current dates if they changed
+ **/ 
+QVector<DkFolderIndexCache::Entry> DkFolderIndexCache::changedEntries(const QString& dirPath, const QVector<Entry>& entries) {
+
+	DkTimer dt;
+	QVector<Entry> changed;
+
+	for (const Entry& e : entries) {
+
+		// the dates were never cached
+		if (e.modified == -1)
+			continue;
+
+		QFileInfo fileInfo(dirPath, e.fileName);
+		qint64 modified = fileInfo.lastModified().toMSecsSinceEpoch();
+
+		if (modified != e.modified) {
+
+			Entry ce = e;
+			ce.created = fileInfo.created().toMSecsSinceEpoch();
+			ce.modified = modified;
+			changed << ce;
+		}
+	}
+
+	qDebug() << "[DkFolderIndexCache]" << changed.size() << "of" << entries.size() << "files changed, checked in" << dt.getTotal();
+
+	return changed;
+}
+
+qint64 DkFolderIndexCache::dirModified(const QString& dirPath) {
+
+	QFileInfo dirInfo(dirPath);
+
+	if (!dirInfo.exists())
+		return -1;
+
+	return dirInfo.lastModified().toMSecsSinceEpoch();
+}
+
+QString DkFolderIndexCache::cacheFilePath(const QString& dirPath, const QString& suffix) {
+
+#if QT_VERSION >= 0x050000
+	QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+#else
+	QString cacheDir = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#endif
+
+	QString hash = QCryptographicHash::hash(dirPath.toUtf8(), QCryptographicHash::Md5).toHex();
+
+	return cacheDir + "/folder-index/" + hash + "." + suffix;
+}
+
+/**
+ * Removes the oldest indexes if more than max_indexes are cached.
+ * The caller has to lock the mutex.
+ **/ 
+void DkFolderIndexCache::prune() {
+
+	QDir cacheDir = QFileInfo(cacheFilePath(QString(), "idx")).absoluteDir();
+	QFileInfoList files = cacheDir.entryInfoList(QStringList() << "*.idx" << "*.dirs", QDir::Files, QDir::Time);
+
+	for (int idx = max_indexes; idx < files.size(); idx++)
+		QFile::remove(files[idx].absoluteFilePath());
+}
+
+/**
+ * Serializes all reads and writes of the index files.
+ * The index is written by the indexing threads and updated by the GUI thread.
+ **/ 
+QMutex& DkFolderIndexCache::mutex() {
+
+	static QMutex m(QMutex::Recursive);
+	return m;
+}
+
+// DkFileNameFilter --------------------------------------------------------------------
+/**
+ * Creates a file name filter.
+ * @param ignoreKeywords file names matching one of these (regular expression) keywords are rejected
+ * @param keywords file names have to contain all of these keywords
+ **/ 
+DkFileNameFilter::DkFileNameFilter(const QStringList& ignoreKeywords, const QStringList& keywords) {
+
+	mEmpty = ignoreKeywords.empty() && keywords.empty();
+
+	if (mEmpty)
+		return;
+
+	mExp.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+	mExp.setPattern(createPattern(ignoreKeywords, keywords, false));
+
+	// users might type anything - so fall back to plain strings
+	if (!mExp.isValid()) {
+		qDebug() << "[DkFileNameFilter] invalid ignore keywords:" << mExp.errorString();
+		mExp.setPattern(createPattern(ignoreKeywords, keywords, true));
+	}
+
+#if QT_VERSION >= 0x050400
+	mExp.optimize();	// JIT compile - we match lots of file names
+#endif
+}
+
+/**
+ * Creates a pattern like: ^(?!.*(?:ign1|ign2))(?=.*kw1)(?=.*kw2)
+ **/ 
+QString DkFileNameFilter::createPattern(const QStringList& ignoreKeywords, const QStringList& keywords, bool escapeIgnore) const {
+
+	QString pattern = "^";
+
+	if (!ignoreKeywords.empty()) {
+
+		QStringList ignore;
+		for (const QString& kw : ignoreKeywords)
+			ignore << "(?:" + (escapeIgnore ? QRegularExpression::escape(kw) : kw) + ")";
+
+		pattern += "(?!.*(?:" + ignore.join("|") + "))";
+	}
+
+	for (const QString& kw : keywords)
+		pattern += "(?=.*" + QRegularExpression::escape(kw) + ")";
+
+	return pattern;
+}
+
+bool DkFileNameFilter::isEmpty() const {
+
+	return mEmpty;
+}
+
+bool DkFileNameFilter::matches(const QString& fileName) const {
+
+	return mEmpty || mExp.match(fileName).hasMatch();
+}
+
+QStringList DkFileNameFilter::filter(const QStringList& fileNames) const {
+
+	if (mEmpty)
+		return fileNames;
+
+	QStringList resultList;
+	resultList.reserve(fileNames.size());
+
+	for (const QString& fileName : fileNames) {
+		if (mExp.match(fileName).hasMatch())
+			resultList.append(fileName);
+	}
+
+	return resultList;
+}
+
+// DkFolderIndexer --------------------------------------------------------------------
+DkFolderIndexer::DkFolderIndexer(QObject* parent) : QObject(parent) {
+
+	connect(this, SIGNAL(chunkIndexedSignal(int, const QString&, const QStringList&, bool)), 
+		this, SLOT(chunkIndexed(int, const QString&, const QStringList&, bool)), Qt::QueuedConnection);
+}
+
+DkFolderIndexer::~DkFolderIndexer() {
+
+	cancel();
+
+	// the threads access this object
+	for (QFuture<void>& f : mFutures)
+		f.waitForFinished();
+}
+
+/**
+ * Starts indexing dirPath in a background thread.
+ * A running index is canceled.
+ * @param dirPath the directory to be indexed
+ * @param ignoreKeywords files containing these keywords are ignored
+ * @param keywords files not containing these keywords are ignored
+ * @param folderKeywords the folder filter
+ * @param reportChunks if true, filesIndexed() is emitted while indexing
+ **/ 
+void DkFolderIndexer::index(const QString& dirPath, const QStringList& ignoreKeywords, const QStringList& keywords, const QStringList& folderKeywords, bool reportChunks) {
+
+	cancel();
+
+	// forget about threads that are done
+	for (int idx = mFutures.size()-1; idx >= 0; idx--) {
+		if (mFutures[idx].isFinished())
+			mFutures.removeAt(idx);
+	}
+
+	Task task = createTask(dirPath, ignoreKeywords, keywords, folderKeywords, reportChunks);
+	mIndexing = true;
+
+	mFutures.append(QtConcurrent::run([=]() {
+		indexIntern(task);
+	}));
+}
+
+/**
+ * Indexes dirPath in the calling thread.
+ * A running index is canceled.
+ * Use it if the complete folder is needed right away.
+ * @return QStringList the (filtered) files of dirPath
+ **/ 
+QStringList DkFolderIndexer::indexNow(const QString& dirPath, const QStringList& ignoreKeywords, const QStringList& keywords, const QStringList& folderKeywords) {
+
+	cancel();
+
+	return indexFiles(createTask(dirPath, ignoreKeywords, keywords, folderKeywords, false));
+}
+
+DkFolderIndexer::Task DkFolderIndexer::createTask(const QString& dirPath, const QStringList& ignoreKeywords, const QStringList& keywords, const QStringList& folderKeywords, bool reportChunks) const {
+
+	Task task;
+	task.indexId = mIndexId.load();
+	task.dirPath = dirPath;
+	task.ignoreKeywords = ignoreKeywords;
+	task.keywords = keywords;
+	task.folderKeywords = folderKeywords;
+	task.browseFilters = Settings::param().app().browseFilters;
+	task.reportChunks = reportChunks;
+
+	if (Settings::param().resources().filterDuplicats)
+		task.preferredExtensions = Settings::param().resources().preferredExtensions;
+
+	if (Settings::param().resources().cacheFolderIndex)
+		task.filterKey = DkFolderIndexCache::filterKey(ignoreKeywords, keywords, folderKeywords);
+
+	return task;
+}
+
+/**
+ * Cancels indexing - the thread stops with the next file.
+ **/ 
+void DkFolderIndexer::cancel() {
+
+	mIndexId.fetchAndAddOrdered(1);
+	mIndexing = false;
+}
+
+bool DkFolderIndexer::isIndexing() const {
+	return mIndexing;
+}
+
+bool DkFolderIndexer::isCanceled(int indexId) const {
+	return indexId != mIndexId.load();
+}
+
+void DkFolderIndexer::indexIntern(const Task& task) {
+
+	QStringList files = indexFiles(task);
+
+	if (isCanceled(task.indexId))
+		return;
+
+	emit chunkIndexedSignal(task.indexId, task.dirPath, files, true);
+}
+
+/**
+ * Lists and filters the files of task.dirPath.
+ * @return QStringList the files - empty if the task was canceled
+ **/ 
+QStringList DkFolderIndexer::indexFiles(const Task& task) {
+
+	DkTimer dt;
+	QElapsedTimer chunkTimer;
+	chunkTimer.start();
+
+	int reportIvl = 100;	// ms - doubled with every chunk so that we don't flood the UI
+	int numReported = 0;
+	QStringList fileNames;
+
+	// read it before indexing - otherwise we might miss changes
+	qint64 dirModified = DkFolderIndexCache::dirModified(task.dirPath);
+
+	// returns false if indexing was canceled
+	auto addFile = [&](const QString& fileName) -> bool {
+
+		if (isCanceled(task.indexId)) {
+			qDebug() << "[DkFolderIndexer] indexing" << task.dirPath << "canceled after" << dt.getTotal();
+			return false;
+		}
+
+		fileNames.append(fileName);
+
+		if (task.reportChunks && chunkTimer.elapsed() > reportIvl) {
+
+			// duplicates are filtered against the merged folder (a pair might be split across chunks)
+			QStringList chunk = DkImageLoader::filterFileList(fileNames.mid(numReported), task.ignoreKeywords, task.keywords, task.folderKeywords, QStringList());
+			numReported = fileNames.size();
+
+			if (!chunk.empty())
+				emit chunkIndexedSignal(task.indexId, task.dirPath, chunk, false);
+
+			reportIvl = qMin(reportIvl*2, 1600);
+			chunkTimer.restart();
+		}
+
+		return true;
+	};
+
+#ifdef Q_OS_WIN
+
+	// the WinAPI is much faster than QDirIterator (especially on network drives)
+	QString winPath = QDir::toNativeSeparators(task.dirPath) + "\\*.*";
+	const wchar_t* fname = reinterpret_cast<const wchar_t *>(winPath.utf16());
+
+	WIN32_FIND_DATAW findFileData;
+	HANDLE findHandle = FindFirstFileW(fname, &findFileData);
+
+	// remove the * in fileFilters
+	QStringList fileFiltersClean = task.browseFilters;
+	for (QString& filter : fileFiltersClean)
+		filter.replace("*", "");
+
+	if (findHandle != INVALID_HANDLE_VALUE) {
+
+		do {
+
+			if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				continue;
+
+			QString fileName = DkUtils::stdWStringToQString(findFileData.cFileName);
+
+			// we also get files that contain *.jpg* (see getFilteredFileInfoList)
+			for (const QString& filter : fileFiltersClean) {
+
+				if (fileName.contains(filter, Qt::CaseInsensitive)) {
+
+					if (!addFile(fileName)) {
+						FindClose(findHandle);
+						return QStringList();
+					}
+					break;
+				}
+			}
+
+		} while (FindNextFileW(findHandle, &findFileData) != 0);
+
+		FindClose(findHandle);
+	}
+#else
+
+	QDirIterator dirIt(task.dirPath, task.browseFilters, QDir::Files | QDir::Hidden);
+
+	while (dirIt.hasNext()) {
+
+		dirIt.next();
+
+		if (!addFile(dirIt.fileName()))
+			return QStringList();
+	}
+#endif
+
+	if (isCanceled(task.indexId))
+		return QStringList();
+
+	QStringList files = DkImageLoader::filterFileList(fileNames, task.ignoreKeywords, task.keywords, task.folderKeywords, task.preferredExtensions);
+	qDebug() << "[DkFolderIndexer]" << files.size() << "files indexed in" << dt.getTotal();
+
+	if (!task.filterKey.isEmpty() && files.size() >= DkFolderIndexCache::min_files)
+		DkFolderIndexCache::save(task.dirPath, dirModified, task.filterKey, DkFolderIndexCache::toEntries(files));
+
+	return files;
+}
+
+void DkFolderIndexer::chunkIndexed(int indexId, const QString& dirPath, const QStringList& fileNames, bool finished) {
+
+	// this chunk is from a canceled run
+	if (isCanceled(indexId))
+		return;
+
+	if (finished) {
+		mIndexing = false;
+		emit indexFinished(dirPath, fileNames);
+	}
+	else
+		emit filesIndexed(dirPath, fileNames);
+}
+
+// DkImageCache --------------------------------------------------------------------
+/**
+ * Updates the cache after the image at cIdx was loaded.
+ * @param images the images of the current folder
+ * @param cIdx the index of the current image
+ **/ 
+void DkImageCache::update(const QVector<QSharedPointer<DkImageContainerT> >& images, int cIdx) {
+
+	float memBudget = Settings::param().resources().cacheMemory;
+
+	if (cIdx < 0 || cIdx >= images.size() || memBudget <= 0)
+		return;
+
+	DkTimer dt;
+
+	updateDirection(cIdx, images.size());
+	touch(images.at(cIdx));
+
+	// edited images are not cached (their history is too large)
+	for (int idx = mImages.size()-1; idx > 0; idx--) {
+		if (mImages.at(idx)->isEdited()) {
+			mImages.at(idx)->clear();
+			mImages.removeAt(idx);
+		}
+	}
+
+	evict(memBudget);
+
+	// estimate the memory of images that are not loaded yet
+	float mem = 0;
+	int numLoaded = 0;
+	for (const QSharedPointer<DkImageContainerT>& imgC : mImages) {
+		
+		float cMem = imgC->getMemoryUsage();
+		mem += cMem;
+
+		if (cMem > 0)
+			numLoaded++;
+	}
+	float avgMem = (numLoaded > 0) ? mem/numLoaded : 0;
+
+	QVector<int> pIdxs = prefetchIndexes(cIdx, images.size());
+	int numFullyLoaded = (mDirection == 0) ? 2 : 1;
+
+	// insert in reverse order -> the closest image is the most recent
+	for (int idx = pIdxs.size()-1; idx >= 0; idx--)
+		touch(images.at(pIdxs[idx]), 1);
+
+	for (int idx = 0; idx < pIdxs.size(); idx++) {
+
+		QSharedPointer<DkImageContainerT> imgC = images.at(pIdxs[idx]);
+
+		// buffered files are decoded too - we just skip images that are decoded (or decoding)
+		if (imgC->hasImage() || imgC->getLoadState() == DkImageContainerT::loading)
+			continue;
+
+		if (mem + avgMem > memBudget)
+			break;
+
+		// fully load the next image(s) - just fetch the file for the others
+		if (idx < numFullyLoaded) {
+			imgC->setTargetSize(mTargetSize);
+			imgC->loadImageThreaded();
+			DkLoaderStats::instance().count(DkLoaderStats::counter_prefetch_decode);
+			qDebug() << "[Cacher] " << imgC->filePath() << " fully cached...";
+		}
+		else if (imgC->hasFileBuffer() || imgC->isFetching())
+			continue;
+		else {
+			imgC->fetchFile();
+			DkLoaderStats::instance().count(DkLoaderStats::counter_prefetch_buffer);
+			qDebug() << "[Cacher] " << imgC->filePath() << " file fetched...";
+		}
+
+		mem += avgMem;
+	}
+
+	qDebug() << "cache with: " << mImages.size() << "images" << mem << " MB updated in: " << dt.getTotal();
+}
+
+/**
+ * Clears all cached images.
+ * @param keepImage this image is not cleared (e.g. the current image)
+ **/ 
+void DkImageCache::clear(QSharedPointer<DkImageContainerT> keepImage) {
+
+	for (QSharedPointer<DkImageContainerT>& imgC : mImages) {
+		if (imgC != keepImage)
+			imgC->clear();
+	}
+
+	mImages.clear();
+	mLastIdx = -1;
+	mDirection = 1;
+}
+
+void DkImageCache::setTargetSize(const QSize& size) {
+
+	mTargetSize = size;
+}
+
+float DkImageCache::memoryUsage() const {
+
+	float mem = 0;
+
+	for (const QSharedPointer<DkImageContainerT>& imgC : mImages)
+		mem += imgC->getMemoryUsage();
+
+	return mem;
+}
+
+/**
+ * Updates the navigation direction.
+ * If the user jumps or the images are shuffled, we prefetch in both directions.
+ **/ 
+void DkImageCache::updateDirection(int cIdx, int numImages) {
+
+	if (Settings::param().global().sortMode == DkSettings::sort_random)
+		mDirection = 0;
+	else if (mLastIdx != -1 && mLastIdx != cIdx) {
+		
+		int delta = cIdx - mLastIdx;
+
+		// we looped
+		if (delta > numImages/2)
+			delta -= numImages;
+		else if (delta < -numImages/2)
+			delta += numImages;
+
+		if (qAbs(delta) <= 2)
+			mDirection = (delta > 0) ? 1 : -1;
+		else
+			mDirection = 0;
+	}
+
+	mLastIdx = cIdx;
+}
+
+/**
+ * Returns the indexes of the images to be prefetched (ordered by priority).
+ **/ 
+QVector<int> DkImageCache::prefetchIndexes(int cIdx, int numImages) const {
+
+	int maxImages = Settings::param().resources().maxImagesCached;
+	bool loop = Settings::param().global().loop;
+
+	QVector<int> directions;
+	if (mDirection == 0)
+		directions << 1 << -1;
+	else
+		directions << mDirection;
+
+	QVector<int> pIdxs;
+
+	for (int step = 1; step <= maxImages && pIdxs.size() < maxImages; step++) {
+
+		for (int dir : directions) {
 
-// quazip
-#ifdef WITH_QUAZIP
-#include <quazip/JlCompress.h>
-#endif
+			int idx = cIdx + dir*step;
 
-// opencv
-#ifdef WITH_OPENCV
+			if (loop)
+				idx = ((idx % numImages) + numImages) % numImages;
 
-#ifdef Q_OS_WIN
-#pragma warning(disable: 4996)
-#endif
-#endif 
+			if (idx < 0 || idx >= numImages || idx == cIdx || pIdxs.contains(idx))
+				continue;
 
-#ifdef WITH_LIBRAW
-#include <libraw/libraw.h>
-#elif defined(Q_OS_WIN) && !defined(SOCK_STREAM)
-#include <winsock2.h>	// needed since libraw 0.16
-#endif
+			if (pIdxs.size() < maxImages)
+				pIdxs << idx;
+		}
+	}
 
-#pragma warning(pop)	// no warnings from includes - end
+	return pIdxs;
+}
 
-namespace nmc {
+void DkImageCache::touch(QSharedPointer<DkImageContainerT> imgC, int pos) {
+
+	mImages.removeOne(imgC);
+	mImages.insert(qMin(pos, mImages.size()), imgC);
+}
+
+/**
+ * Clears the least recently used images until we are within the memory budget.
+ * Mapped files do not count against the budget, they are unmapped
+ * once they are far enough behind in the LRU list.
+ * The current (first) image is never evicted.
+ * Images that are fetched are kept - their buffer is assigned once the thread
+ * is done and it would not be tracked anymore.
+ **/ 
+void DkImageCache::evict(float memBudget) {
+
+	float mem = memoryUsage();
+	int maxMapped = 2*Settings::param().resources().maxImagesCached;
+
+	for (int idx = mImages.size()-1; idx > 0; idx--) {
+
+		QSharedPointer<DkImageContainerT> imgC = mImages.at(idx);
+
+		if (imgC->isFetching())
+			continue;
+
+		float cMem = imgC->getMemoryUsage();
+
+		if (cMem <= 0 && idx > maxMapped && imgC->isFileBufferMapped() && imgC->getLoadState() != DkImageContainerT::loading) {
+			imgC->clear();
+			mImages.removeAt(idx);
+			DkLoaderStats::instance().count(DkLoaderStats::counter_evicted);
+			continue;
+		}
+
+		// forget about images that are neither loaded nor loading
+		if (cMem <= 0 && !imgC->hasFileBuffer() && imgC->getLoadState() != DkImageContainerT::loading) {
+			mImages.removeAt(idx);
+			continue;
+		}
+
+		if (mem > memBudget && cMem > 0) {
+			imgC->clear();
+			mem -= cMem;
+			mImages.removeAt(idx);
+			DkLoaderStats::instance().count(DkLoaderStats::counter_evicted);
+		}
+	}
+}
 
 // DkImageLoader -> is nomacs file handling routine --------------------------------------------------------------------
 /**
@@ -110,14 +962,24 @@ DkImageLoader::DkImageLoader(const QString& filePath) {
 	mDirWatcher = new QFileSystemWatcher(this);
 	connect(mDirWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
 
+	mFolderIndexer = new DkFolderIndexer(this);
+	connect(mFolderIndexer, SIGNAL(filesIndexed(const QString&, const QStringList&)), this, SLOT(filesIndexed(const QString&, const QStringList&)));
+	connect(mFolderIndexer, SIGNAL(indexFinished(const QString&, const QStringList&)), this, SLOT(indexFinished(const QString&, const QStringList&)));
+
 	mSortingIsDirty = false;
 	mSortingImages = false;
+	mRandomSeed = (uint)QDateTime::currentMSecsSinceEpoch();
 
 	connect(&mCreateImageWatcher, SIGNAL(finished()), this, SLOT(imagesSorted()));
+	connect(&mRestatWatcher, SIGNAL(finished()), this, SLOT(filesRestated()));
 
 	mDelayedUpdateTimer.setSingleShot(true);
 	connect(&mDelayedUpdateTimer, SIGNAL(timeout()), this, SLOT(directoryChanged()));
 
+	mDirUpdateTimer.setSingleShot(true);
+	mDirUpdateTimer.setInterval(500);
+	connect(&mDirUpdateTimer, SIGNAL(timeout()), this, SLOT(notifyDirUpdate()));
+
 	connect(DkActionManager::instance().action(DkActionManager::menu_edit_undo), SIGNAL(triggered()), this, SLOT(undo()));
 	connect(DkActionManager::instance().action(DkActionManager::menu_edit_redo), SIGNAL(triggered()), this, SLOT(redo()));
 
@@ -138,6 +1000,11 @@ DkImageLoader::~DkImageLoader() {
 	
 	if (mCreateImageWatcher.isRunning())
 		mCreateImageWatcher.blockSignals(true);
+
+	if (mRestatWatcher.isRunning())
+		mRestatWatcher.blockSignals(true);
+
+	mFolderIndexer->cancel();
 }
 
 /**
@@ -148,11 +1015,14 @@ DkImageLoader::~DkImageLoader() {
  **/ 
 void DkImageLoader::clearPath() {
 
+	closeZipArchive();
+
 	// lastFileLoaded must exist
 	if (mCurrentImage && mCurrentImage->exists()) {
 		mCurrentImage->receiveUpdates(this, false);
 		mLastImageLoaded = mCurrentImage;
 		mImages.clear();
+		mImageIndex.clear();
 	}
 
 	mCurrentImage.clear();
@@ -165,7 +1035,9 @@ void DkImageLoader::clearPath() {
  **/ 
 bool DkImageLoader::loadZipArchive(const QString& zipPath) {
 
-	QStringList fileNameList = JlCompress::getFileList(zipPath);
+	// the session is kept open - images & thumbnails are extracted from it
+	QSharedPointer<DkZipArchive> zip = DkZipArchive::open(zipPath);
+	QStringList fileNameList = zip ? zip->fileNames() : QStringList();
 	
 	// remove the * in fileFilters
 	QStringList fileFiltersClean = Settings::param().app().browseFilters;
@@ -197,174 +1069,494 @@ bool DkImageLoader::loadZipArchive(const QString& zipPath) {
 		return false;
 	}
 
-	createImages(fileInfoList);
+	createImages(fileInfoList);
+
+	if (mZipPath != zipPath)
+		closeZipArchive();
+	mZipPath = zipPath;
+
+	emit updateDirSignal(mImages);
+	mCurrentDir = zipInfo.absolutePath();
+
+	qDebug() << "ZIP FOLDER set: " << mCurrentDir;
+
+	return true;
+}
+#endif
+
+/**
+ * Releases the session of the archive we browsed.
+ * Otherwise the file stays open (and locked on Windows).
+ **/ 
+void DkImageLoader::closeZipArchive() {
+
+#ifdef WITH_QUAZIP
+	if (!mZipPath.isEmpty())
+		DkZipArchive::close(mZipPath);
+#endif
+	mZipPath = QString();
+}
+
+/**
+ * Loads a given directory.
+ * @param newDir the directory to be loaded.
+ **/ 
+bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
+
+	// the folder is currently indexed - the files will be here soon
+	if (!mFolderUpdated && newDirPath == mCurrentDir && mFolderIndexer->isIndexing())
+		return true;
+
+	// folder changed signal was emitted
+	if (mFolderUpdated && newDirPath == mCurrentDir) {
+		
+		mFolderUpdated = false;
+
+		// the current images stay valid until the folder is re-indexed
+		mFolderIndexer->index(newDirPath, mIgnoreKeywords, mKeywords, mFolderKeywords, mImages.empty());
+
+		qDebug() << "getting file list.....";
+	}
+	// new folder is loaded
+	else if ((newDirPath != mCurrentDir || mImages.empty()) && !newDirPath.isEmpty() && QDir(newDirPath).exists()) {
+
+		mFolderIndexer->cancel();
+		mDirUpdateTimer.stop();
+		closeZipArchive();
+
+		// update save directory
+		mCurrentDir = newDirPath;
+		mFolderUpdated = false;
+
+		mFolderKeywords.clear();	// delete key words -> otherwise user may be confused
+
+		// ok new folder, this should speed-up loading
+		mImages.clear();
+		mImageIndex.clear();
+		mImageCache.clear(mCurrentImage);
+
+		if (scanRecursive && Settings::param().global().scanSubFolders) {
+			
+			QFileInfoList files = updateSubFolders(mCurrentDir);
+
+			if (files.empty()) {
+				emit showInfoSignal(tr("%1 \n does not contain any image").arg(mCurrentDir), 4000);	// stop mShowing
+				return false;
+			}
+
+			createImages(files, true);
+			qDebug() << "new folder path: " << newDirPath << " contains: " << mImages.size() << " images";
+		}
+		else if (loadIndexCache(mCurrentDir)) {
+			qDebug() << "new folder path (cached): " << newDirPath << " contains: " << mImages.size() << " images";
+		}
+		else {
+			// indexing large (or network) folders takes seconds - so we index in the background
+			// and the files are added while indexing
+			emit updateDirSignal(mImages);
+			mFolderIndexer->index(mCurrentDir, mIgnoreKeywords, mKeywords, mFolderKeywords);
+			qDebug() << "indexing new folder: " << newDirPath;
+		}
+	}
+	//else
+	//	qDebug() << "ignoring... old dir: " << dir.absolutePath() << " newDir: " << newDir << " file size: " << images.size();
+
+	return true;
+}
+
+/**
+ * Adds files of the folder that is currently indexed.
+ * @param dirPath the indexed directory
+ * @param fileNames the file names found since the last chunk
+ **/ 
+void DkImageLoader::filesIndexed(const QString& dirPath, const QStringList& fileNames) {
+
+	if (dirPath != mCurrentDir)
+		return;
+
+	QFileInfoList files;
+	for (const QString& fileName : fileNames)
+		files.append(QFileInfo(dirPath, fileName));
+
+	appendImages(files);
+}
+
+/**
+ * Sets the files of a completely indexed folder.
+ * @param dirPath the indexed directory
+ * @param fileNames all (filtered) files of the directory
+ **/ 
+void DkImageLoader::indexFinished(const QString& dirPath, const QStringList& fileNames) {
+
+	if (dirPath != mCurrentDir)
+		return;
+
+	// the complete folder is announced below
+	mDirUpdateTimer.stop();
+
+	// might get empty too (e.g. someone deletes all images)
+	if (fileNames.empty()) {
+		emit showInfoSignal(tr("%1 \n does not contain any image").arg(dirPath), 4000);	// stop mShowing
+		mImages.clear();
+		mImageIndex.clear();
+		emit updateDirSignal(mImages);
+		mLoadIndexedFile = false;
+		return;
+	}
+
+	QFileInfoList files;
+	for (const QString& fileName : fileNames)
+		files.append(QFileInfo(dirPath, fileName));
+
+	createImages(files, true);
+	updateIndexCache();
+
+	// the user requested a file while we were indexing
+	if (mLoadIndexedFile) {
+		mLoadIndexedFile = false;
+		loadFileAt(mIndexedFileIdx);
+	}
+}
+
+void DkImageLoader::sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT > > images) {
+
+	if (mSortingImages) {
+		mSortingIsDirty = true;
+		return;
+	}
+
+	mSortingIsDirty = false;
+	mSortingImages = true;
+	mCreateImageWatcher.setFuture(QtConcurrent::run(this, 
+		&nmc::DkImageLoader::sortImages, images));
+
+	qDebug() << "sorting images threaded...";
+}
+
+void DkImageLoader::imagesSorted() {
+
+	mSortingImages = false;
+	mImages = mCreateImageWatcher.result();
+	updateImageIndex();
+
+	if (mSortingIsDirty) {
+		qDebug() << "re-sorting because it's dirty...";
+		sortImagesThreaded(mImages);
+		return;
+	}
+
+	emit updateDirSignal(mImages);
+
+	if (mDirWatcher) {
+		if (!mDirWatcher->directories().isEmpty())
+			mDirWatcher->removePaths(mDirWatcher->directories());
+		mDirWatcher->addPath(mCurrentDir);
+	}
+
+	qDebug() << "images sorted...";
+}
+
+void DkImageLoader::createImages(const QFileInfoList& files, bool sort) {
+
+	// TODO: change files to QStringList
+	DkTimer dt;
+	QVector<QSharedPointer<DkImageContainerT > > oldImages = mImages;
+
+	// index the old containers once - searching them for every file is O(n^2) in large folders
+	QHash<QString, QSharedPointer<DkImageContainerT> > oldImageIndex;
+	oldImageIndex.reserve(oldImages.size());
+	for (const QSharedPointer<DkImageContainerT>& imgC : oldImages)
+		oldImageIndex.insert(imgC->filePath(), imgC);
+
+	// the current image might have been opened before the folder was indexed
+	if (mCurrentImage && !oldImageIndex.contains(mCurrentImage->filePath()))
+		oldImageIndex.insert(mCurrentImage->filePath(), mCurrentImage);
+
+	mImages.clear();
+	mImages.reserve(files.size());
+	mImageIndex.clear();
+	mImageIndex.reserve(files.size());
+
+	for (int idx = 0; idx < files.size(); idx++) {
+
+		QString cFilePath = files.at(idx).absoluteFilePath();
+		QSharedPointer<DkImageContainerT> oldImg = oldImageIndex.value(cFilePath);
+
+		if (oldImg && QFileInfo(oldImg->filePath()).lastModified() == files.at(idx).lastModified())
+			mImages.append(oldImg);
+		else
+			mImages.append(QSharedPointer<DkImageContainerT >(new DkImageContainerT(cFilePath)));
+
+		mImageIndex.insert(cFilePath, mImages.size()-1);
+	}
+	qDebug() << "[DkImageLoader] " << mImages.size() << " containers created in " << dt.getTotal();
+
+	if (sort) {
+		sortImagesAndNotify();
+		qDebug() << "[DkImageLoader] after sorting: " << dt.getTotal();
+	}
+
+}
+
+/**
+ * Sorts mImages and announces the new folder.
+ **/ 
+void DkImageLoader::sortImagesAndNotify() {
+
+	mImages = sortImages(mImages);
+	updateImageIndex();
+
+	emit updateDirSignal(mImages);
+
+	if (mDirWatcher) {
+		if (!mDirWatcher->directories().isEmpty())
+			mDirWatcher->removePaths(mDirWatcher->directories());
+		mDirWatcher->addPath(mCurrentDir);
+	}
+}
+
+/**
+ * Loads the folder from the index cache.
+ * @param dirPath the folder to be loaded
+ * @return bool true if a valid index was cached
+ **/ 
+bool DkImageLoader::loadIndexCache(const QString& dirPath) {
+
+	if (!Settings::param().resources().cacheFolderIndex)
+		return false;
+
+	DkTimer dt;
+	QVector<DkFolderIndexCache::Entry> entries;
+
+	if (!DkFolderIndexCache::load(dirPath, DkFolderIndexCache::filterKey(mIgnoreKeywords, mKeywords, mFolderKeywords), entries) || entries.empty())
+		return false;
+
+	QFileInfoList files;
+	files.reserve(entries.size());
+
+	for (const DkFolderIndexCache::Entry& e : entries)
+		files.append(QFileInfo(dirPath, e.fileName));
+
+	createImages(files, false);
+
+	// no need to stat the files if we sort by date
+	for (int idx = 0; idx < entries.size() && idx < mImages.size(); idx++) {
+		if (entries[idx].created != -1)
+			mImages[idx]->setFileDates(entries[idx].created, entries[idx].modified);
+	}
+
+	sortImagesAndNotify();
+	qDebug() << "[DkImageLoader]" << mImages.size() << "images loaded from the index cache in" << dt.getTotal();
+
+	// files edited in place keep the folder's date - so we check the cached dates in the background
+	mRestatDir = dirPath;
+	mRestatWatcher.setFuture(QtConcurrent::run(&DkFolderIndexCache::changedEntries, dirPath, entries));
+
+	return true;
+}
+
+/**
+ * Updates the file dates of files that changed since the index was cached.
+ **/ 
+void DkImageLoader::filesRestated() {
+
+	if (mRestatDir != mCurrentDir || mRestatWatcher.isCanceled())
+		return;
+
+	QVector<DkFolderIndexCache::Entry> changed = mRestatWatcher.result();
+
+	if (changed.empty())
+		return;
+
+	for (const DkFolderIndexCache::Entry& e : changed) {
+
+		int idx = mImageIndex.value(QFileInfo(mCurrentDir, e.fileName).absoluteFilePath(), -1);
+
+		if (idx != -1)
+			mImages[idx]->setFileDates(e.created, e.modified);
+	}
+
+	int sortMode = Settings::param().global().sortMode;
+
+	if (sortMode == DkSettings::sort_date_created || sortMode == DkSettings::sort_date_modified)
+		sortImagesAndNotify();
+
+	updateIndexCache();
+}
+
+/**
+ * Stores the current order and the file dates (if known) in the index cache.
+ **/ 
+void DkImageLoader::updateIndexCache() {
+
+	if (!Settings::param().resources().cacheFolderIndex || mImages.size() < DkFolderIndexCache::min_files || mImages.first()->isFromZip())
+		return;
+
+	// no new information
+	if (!mImages.first()->sortKey().hasFileInfo())
+		return;
+
+	QVector<DkFolderIndexCache::Entry> entries(mImages.size());
+
+	for (int idx = 0; idx < mImages.size(); idx++) {
 
-	emit updateDirSignal(mImages);
-	mCurrentDir = zipInfo.absolutePath();
+		const DkSortKey& key = mImages[idx]->sortKey();
+		entries[idx].fileName = mImages[idx]->fileName();
 
-	qDebug() << "ZIP FOLDER set: " << mCurrentDir;
+		if (key.hasFileInfo()) {
+			entries[idx].created = key.created();
+			entries[idx].modified = key.modified();
+		}
+	}
 
-	return true;
+	DkFolderIndexCache::update(mCurrentDir, DkFolderIndexCache::filterKey(mIgnoreKeywords, mKeywords, mFolderKeywords), entries);
 }
-#endif
 
 /**
- * Loads a given directory.
- * @param newDir the directory to be loaded.
+ * Sorts the images according to the current sort mode.
+ * The keys are computed once per image (and cached) so the comparisons are cheap.
+ * @param images the images to be sorted
+ * @return QVector<QSharedPointer<DkImageContainerT > > the sorted images
  **/ 
-bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
+QVector<QSharedPointer<DkImageContainerT > > DkImageLoader::sortImages(QVector<QSharedPointer<DkImageContainerT > > images) const {
 
-	//if (creatingImages) {
-	//	//emit showInfoSignal(tr("Indexing folder..."), 4000);	// stop mShowing
-	//	return false;
-	//}
+	// read the settings once - not per comparison
+	int sortMode = Settings::param().global().sortMode;
+	int sortDir = Settings::param().global().sortDir;
 
-	// folder changed signal was emitted
-	if (mFolderUpdated && newDirPath == mCurrentDir) {
-		
-		mFolderUpdated = false;
-		QFileInfoList files = getFilteredFileInfoList(newDirPath, mIgnoreKeywords, mKeywords, mFolderKeywords);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
+	for (int idx = 0; idx < images.size(); idx++)
+		images.at(idx)->updateSortKey(sortMode, mRandomSeed);
 
-		// might get empty too (e.g. someone deletes all images)
- 		if (files.empty()) {
-			emit showInfoSignal(tr("%1 \n does not contain any image").arg(newDirPath), 4000);	// stop mShowing
-			mImages.clear();
-			emit updateDirSignal(mImages);
-			return false;
-		}
+	std::sort(images.begin(), images.end(), 
+		[sortMode, sortDir](const QSharedPointer<DkImageContainerT>& l, const QSharedPointer<DkImageContainerT>& r) {
+		return l->sortKey().lessThan(r->sortKey(), sortMode, sortDir);
+	});
 
-		// disabled threaded sorting - people didn't like it (#484 and #460)
-		//if (files.size() > 2000) {
-		//	createImages(files, false);
-		//	sortImagesThreaded(images);
-		//}
-		//else
-			createImages(files, true);
+	return images;
+}
 
-		qDebug() << "getting file list.....";
-	}
-	// new folder is loaded
-	else if ((newDirPath != mCurrentDir || mImages.empty()) && !newDirPath.isEmpty() && QDir(newDirPath).exists()) {
+/**
+ * Appends new files to the (partially indexed) folder.
+ * Only the new files are sorted - they are merged into the (sorted) folder.
+ * @param files the files to be appended
+ **/ 
+void DkImageLoader::appendImages(const QFileInfoList& files) {
 
-		QFileInfoList files;
+	DkTimer dt;
+	QVector<QSharedPointer<DkImageContainerT > > newImages;
+	newImages.reserve(files.size());
 
-		//newDir.setNameFilters(Settings::param().app().fileFilters);
-		//newDir.setSorting(QDir::LocaleAware);		// TODO: extend
+	for (const QFileInfo& file : files) {
 
-		// update save directory
-		mCurrentDir = newDirPath;
-		mFolderUpdated = false;
+		QString cFilePath = file.absoluteFilePath();
 
-		mFolderKeywords.clear();	// delete key words -> otherwise user may be confused
+		if (mImageIndex.contains(cFilePath))
+			continue;
 
-		if (scanRecursive && Settings::param().global().scanSubFolders)
-			files = updateSubFolders(mCurrentDir);
-		else 
-			files = getFilteredFileInfoList(mCurrentDir, mIgnoreKeywords, mKeywords, mFolderKeywords);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
+		if (mCurrentImage && mCurrentImage->filePath() == cFilePath)
+			newImages.append(mCurrentImage);
+		else
+			newImages.append(QSharedPointer<DkImageContainerT >(new DkImageContainerT(cFilePath)));
+	}
 
-		if (files.empty()) {
-			emit showInfoSignal(tr("%1 \n does not contain any image").arg(mCurrentDir), 4000);	// stop mShowing
-			return false;
-		}
+	if (newImages.empty())
+		return;
 
-		// ok new folder, this should speed-up loading
-		mImages.clear();
-		
-		//// TODO: creating ~120 000 images takes about 2 secs
-		//// but sorting (just filenames) takes ages (on windows)
-		//// so we should fix this using 2 strategies: 
-		//// - thread the image creation process
-		//// - while loading (if the user wants to move in the folder) we could display some message (e.g. indexing dir)
-		//if (files.size() > 2000) {
-		//	createImages(files, false);
-		//	sortImagesThreaded(mImages);
-		//}
-		//else
-			createImages(files, true);
+	newImages = sortImages(newImages);
 
-		qDebug() << "new folder path: " << newDirPath << " contains: " << mImages.size() << " images";
-	}
-	//else
-	//	qDebug() << "ignoring... old dir: " << dir.absolutePath() << " newDir: " << newDir << " file size: " << images.size();
+	int sortMode = Settings::param().global().sortMode;
+	int sortDir = Settings::param().global().sortDir;
+	int numOld = mImages.size();
+	mImages += newImages;
 
-	return true;
-}
+	std::inplace_merge(mImages.begin(), mImages.begin()+numOld, mImages.end(),
+		[sortMode, sortDir](const QSharedPointer<DkImageContainerT>& l, const QSharedPointer<DkImageContainerT>& r) {
+		return l->sortKey().lessThan(r->sortKey(), sortMode, sortDir);
+	});
 
-void DkImageLoader::sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT > > images) {
+	// a pair (e.g. img.arw & img.jpg) might be split across chunks
+	if (Settings::param().resources().filterDuplicats)
+		removeDuplicates();
 
-	if (mSortingImages) {
-		mSortingIsDirty = true;
-		return;
-	}
+	updateImageIndex();
 
-	mSortingIsDirty = false;
-	mSortingImages = true;
-	mCreateImageWatcher.setFuture(QtConcurrent::run(this, 
-		&nmc::DkImageLoader::sortImages, images));
+	qDebug() << "[DkImageLoader]" << newImages.size() << "files appended (" << mImages.size() << "total) in" << dt.getTotal();
 
-	qDebug() << "sorting images threaded...";
+	// show the first files immediately
+	if (numOld == 0)
+		notifyDirUpdate();
+	else if (!mDirUpdateTimer.isActive())
+		mDirUpdateTimer.start();
 }
 
-void DkImageLoader::imagesSorted() {
+/**
+ * Removes images of mImages that exist with a preferred extension.
+ **/ 
+void DkImageLoader::removeDuplicates() {
 
-	mSortingImages = false;
-	mImages = mCreateImageWatcher.result();
+	QStringList fileNames;
+	fileNames.reserve(mImages.size());
 
-	if (mSortingIsDirty) {
-		qDebug() << "re-sorting because it's dirty...";
-		sortImagesThreaded(mImages);
+	for (const QSharedPointer<DkImageContainerT>& imgC : mImages)
+		fileNames.append(imgC->fileName());
+
+	QStringList keptNames = filterDuplicates(fileNames, Settings::param().resources().preferredExtensions);
+
+	if (keptNames.size() == fileNames.size())
 		return;
-	}
 
-	emit updateDirSignal(mImages);
+	QSet<QString> kept;
+	kept.reserve(keptNames.size());
+	for (const QString& fileName : keptNames)
+		kept.insert(fileName);
 
-	if (mDirWatcher) {
-		if (!mDirWatcher->directories().isEmpty())
-			mDirWatcher->removePaths(mDirWatcher->directories());
-		mDirWatcher->addPath(mCurrentDir);
+	QVector<QSharedPointer<DkImageContainerT > > images;
+	images.reserve(kept.size());
+
+	for (const QSharedPointer<DkImageContainerT>& imgC : mImages) {
+		if (kept.contains(imgC->fileName()))
+			images.append(imgC);
 	}
 
-	qDebug() << "images sorted...";
+	mImages = images;
 }
 
-void DkImageLoader::createImages(const QFileInfoList& files, bool sort) {
-
-	// TODO: change files to QStringList
-	DkTimer dt;
-	QVector<QSharedPointer<DkImageContainerT > > oldImages = mImages;
-	mImages.clear();
+/**
+ * Indexes the current folder in this thread if it is still indexed in the background.
+ * Use it if the complete folder is needed right away (e.g. to skip into the next folder).
+ **/ 
+void DkImageLoader::finishIndexing() {
 
-	for (int idx = 0; idx < files.size(); idx++) {
+	if (!mFolderIndexer->isIndexing())
+		return;
 
-		int oIdx = findFileIdx(files.at(idx).absoluteFilePath(), oldImages);
+	DkTimer dt;
+	QStringList fileNames = mFolderIndexer->indexNow(mCurrentDir, mIgnoreKeywords, mKeywords, mFolderKeywords);
+	qDebug() << "[DkImageLoader]" << mCurrentDir << "indexed in the GUI thread in" << dt.getTotal();
 
-		if (oIdx != -1 && QFileInfo(oldImages.at(oIdx)->filePath()).lastModified() == files.at(idx).lastModified())
-			mImages.append(oldImages.at(oIdx));
-		else
-			mImages.append(QSharedPointer<DkImageContainerT >(new DkImageContainerT(files.at(idx).absoluteFilePath())));
-	}
-	qDebug() << "[DkImageLoader] " << mImages.size() << " containers created in " << dt.getTotal();
+	indexFinished(mCurrentDir, fileNames);
+}
 
-	if (sort) {
-		qSort(mImages.begin(), mImages.end(), imageContainerLessThanPtr);
-		qDebug() << "[DkImageLoader] after sorting: " << dt.getTotal();
+void DkImageLoader::notifyDirUpdate() const {
 
-		emit updateDirSignal(mImages);
+	emit updateDirSignal(mImages);
+}
 
-		if (mDirWatcher) {
-			if (!mDirWatcher->directories().isEmpty())
-				mDirWatcher->removePaths(mDirWatcher->directories());
-			mDirWatcher->addPath(mCurrentDir);
-		}
-	}
+/**
+ * Rebuilds the file path index of mImages.
+ * It needs to be updated whenever mImages is assigned or re-ordered.
+ **/ 
+void DkImageLoader::updateImageIndex() {
 
-}
+	DkTimer dt;
 
-QVector<QSharedPointer<DkImageContainerT > > DkImageLoader::sortImages(QVector<QSharedPointer<DkImageContainerT > > images) const {
+	mImageIndex.clear();
+	mImageIndex.reserve(mImages.size());
 
-	qSort(images.begin(), images.end(), imageContainerLessThanPtr);
+	for (int idx = 0; idx < mImages.size(); idx++)
+		mImageIndex.insert(mImages.at(idx)->filePath(), idx);
 
-	return images;
+	qDebug() << "[DkImageLoader] " << mImageIndex.size() << " files indexed in " << dt.getTotal();
 }
 
 /**
@@ -485,6 +1677,7 @@ QSharedPointer<DkImageContainerT> DkImageLoader::getSkippedImage(int skipIdx, bo
 				
 			int oldFileSize = mImages.size();
 			loadDir(mSubFolders[folderIdx], false);	// don't scan recursive again
+			finishIndexing();						// we skip into the folder - so we need all files now
 			qDebug() << "loading new folder: " << mSubFolders[folderIdx];
 
 			if (newFileIdx >= oldFileSize) {
@@ -605,6 +1798,13 @@ void DkImageLoader::loadFileAt(int idx) {
 	if (mCurrentImage && !cDir.exists())
 		loadDir(mCurrentImage->dirPath());
 
+	// load the file as soon as the folder is indexed
+	if (mImages.empty() && mFolderIndexer->isIndexing()) {
+		mLoadIndexedFile = true;
+		mIndexedFileIdx = idx;
+		return;
+	}
+
 	if(mImages.empty())
 		return;
 
@@ -652,26 +1852,12 @@ QSharedPointer<DkImageContainerT> DkImageLoader::findOrCreateFile(const QString&
 
 QSharedPointer<DkImageContainerT> DkImageLoader::findFile(const QString& filePath) const {
 
-	// if one image is from zip than all should be
-	// for images in zip the "images[idx]->file() == file" comparison somahow does not work
-	if(mImages.size() > 0) {
-
-		if (mImages[0]->isFromZip()) {
-			int idx = findFileIdx(filePath, mImages);
-			if (idx < 0) 
-				return QSharedPointer<DkImageContainerT>();
-			else 
-				return mImages[idx];
-		}
-	}
-
-	for (int idx = 0; idx < mImages.size(); idx++) {
+	int idx = findFileIdx(filePath, mImages);
 
-		if (mImages[idx]->filePath() == filePath)
-			return mImages[idx];
-	}
+	if (idx < 0)
+		return QSharedPointer<DkImageContainerT>();
 
-	return QSharedPointer<DkImageContainerT>();
+	return mImages[idx];
 }
 
 int DkImageLoader::findFileIdx(const QString& filePath, const QVector<QSharedPointer<DkImageContainerT> >& images) const {
@@ -680,6 +1866,20 @@ int DkImageLoader::findFileIdx(const QString& filePath, const QVector<QSharedPoi
 	// however, in converting the string from a fileInfo - we quarantee that the separators are the same (/ vs \)
 	QString lFilePath = QFileInfo(filePath).absoluteFilePath();
 
+	// our own images are indexed
+	if (&images == &mImages) {
+
+		int idx = mImageIndex.value(lFilePath, -1);
+
+		if (idx >= 0 && idx < mImages.size() && mImages[idx]->filePath() == lFilePath)
+			return idx;
+
+		// if one image is from zip than all should be
+		// zip containers change their file path once they are decoded - so we have to search them
+		if (idx == -1 && (mImages.empty() || !mImages[0]->isFromZip()))
+			return -1;
+	}
+
 	for (int idx = 0; idx < images.size(); idx++) {
 
 		if (images[idx]->filePath() == lFilePath)
@@ -702,12 +1902,15 @@ QStringList DkImageLoader::getFileNames() const {
 QVector<QSharedPointer<DkImageContainerT> > DkImageLoader::getImages() {
 
 	loadDir(mCurrentDir);
+	finishIndexing();	// callers expect the complete folder
+
 	return mImages;
 }
 
 void DkImageLoader::setImages(QVector<QSharedPointer<DkImageContainerT> > images) {
 
 	mImages = images;
+	updateImageIndex();
 	emit updateDirSignal(images);
 }
 
@@ -786,6 +1989,10 @@ void DkImageLoader::activate(bool isActive /* = true */) {
 
 void DkImageLoader::setCurrentImage(QSharedPointer<DkImageContainerT> newImg) {
 
+	// the user opened a file - so forget about previous requests
+	if (newImg)
+		mLoadIndexedFile = false;
+
 	// force index folder if we dir out of the zip
 	if (mCurrentImage && newImg && mCurrentImage->isFromZip() && !newImg->isFromZip())
 		mFolderUpdated = true;
@@ -828,7 +2035,7 @@ void DkImageLoader::setCurrentImage(QSharedPointer<DkImageContainerT> newImg) {
 			if (!Settings::param().resources().cacheMemory)
 				mCurrentImage->clear();
 
-			mCurrentImage->getLoader()->resetPageIdx();
+			mCurrentImage->resetPages();
 		}
 		mCurrentImage->receiveUpdates(this, false);	// reset updates
 	}
@@ -853,6 +2060,7 @@ void DkImageLoader::reloadImage() {
 
 	mCurrentDir = "";
 	mImages.clear();
+	mImageIndex.clear();
 	mCurrentImage->clear();
 	setCurrentImage(mCurrentImage);
 	loadDir(mCurrentImage->dirPath());
@@ -894,12 +2102,26 @@ void DkImageLoader::load(QSharedPointer<DkImageContainerT> image /* = QSharedPoi
 	}
 #endif
 
+	// classify the request before the image gets touched
+	if (image->getLoadState() == DkImageContainerT::loaded && image->hasImage())
+		DkLoaderStats::instance().count(DkLoaderStats::counter_decode_hit);
+	else if (image->getLoadState() == DkImageContainerT::loading)
+		DkLoaderStats::instance().count(DkLoaderStats::counter_loading_hit);
+	else if (image->getMemoryUsage() > 0 || image->hasFileBuffer())
+		DkLoaderStats::instance().count(DkLoaderStats::counter_buffer_hit);
+	else
+		DkLoaderStats::instance().count(DkLoaderStats::counter_miss);
+
+	mLoadTimer.start();
+	mFirstPixelShown = false;
+
 	setCurrentImage(image);
 
 	if (mCurrentImage && mCurrentImage->getLoadState() == DkImageContainerT::loading)
 		return;
 
 	emit updateSpinnerSignalDelayed(true);
+	mCurrentImage->setTargetSize(mTargetSize);
 	bool loaded = mCurrentImage->loadImageThreaded();	// loads file threaded
 	
 	if (!loaded)
@@ -923,6 +2145,14 @@ void DkImageLoader::imageLoaded(bool loaded /* = false */) {
 
 	emit imageUpdatedSignal(mCurrentImage);
 
+	// the image is painted now
+	if (mLoadTimer.isValid()) {
+		if (!mFirstPixelShown)
+			DkLoaderStats::instance().addFirstPixelTime(mLoadTimer.elapsed());
+		DkLoaderStats::instance().addLoadTime(mLoadTimer.elapsed());
+		mLoadTimer.invalidate();
+	}
+
 	if (mCurrentImage) {
 		// this signal is needed by the folder scrollbar
 		int idx = findFileIdx(mCurrentImage->filePath(), mImages);
@@ -941,8 +2171,10 @@ void DkImageLoader::imageLoaded(bool loaded /* = false */) {
 		emit imageHasGPSSignal(DkMetaDataHelper::getInstance().hasGPS(mCurrentImage->getMetaData()));
 
 	// update status bar info
-	if (mCurrentImage && !mImages.empty() && mImages.indexOf(mCurrentImage) >= 0)
-		DkStatusBarManager::instance().setMessage(tr("%1 of %2").arg(mImages.indexOf(mCurrentImage)+1).arg(mImages.size()), DkStatusBar::status_filenumber_info);
+	int cIdx = (mCurrentImage) ? findFileIdx(mCurrentImage->filePath(), mImages) : -1;
+
+	if (cIdx >= 0 && mImages.at(cIdx) == mCurrentImage)
+		DkStatusBarManager::instance().setMessage(tr("%1 of %2").arg(cIdx+1).arg(mImages.size()), DkStatusBar::status_filenumber_info);
 	else
 		DkStatusBarManager::instance().setMessage("", DkStatusBar::status_filenumber_info);
 
@@ -1388,6 +2620,11 @@ void DkImageLoader::rotateImage(double angle) {
 		return;
 	}
 
+	if (mCurrentImage->isOverview()) {
+		emit showInfoSignal(tr("Sorry, this image is too large to be rotated."));
+		return;
+	}
+
 	QImage img = mCurrentImage->getLoader()->rotate(mCurrentImage->image(), qRound(angle));
 
 	QImage thumb = DkImage::createThumb(mCurrentImage->image());
@@ -1576,7 +2813,13 @@ QStringList DkImageLoader::getFoldersRecursive(const QString& dirPath) {
 	QStringList subFolders;
 	//qDebug() << "scanning recursively: " << dir.absolutePath();
 
-	if (Settings::param().global().scanSubFolders) {
+	bool useCache = Settings::param().resources().cacheFolderIndex;
+
+	if (Settings::param().global().scanSubFolders && !(useCache && DkFolderIndexCache::loadSubFolders(dirPath, subFolders))) {
+
+		// the modification dates validate the cached folders
+		QStringList cacheFolders(dirPath);
+		QVector<qint64> cacheModified(1, DkFolderIndexCache::dirModified(dirPath));
 
 		QDirIterator dirs(dirPath, QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks, QDirIterator::Subdirectories);
 	
@@ -1586,12 +2829,20 @@ QStringList DkImageLoader::getFoldersRecursive(const QString& dirPath) {
 			subFolders << dirs.filePath();
 			nFolders++;
 
+			if (useCache) {
+				cacheFolders << dirs.filePath();
+				cacheModified << dirs.fileInfo().lastModified().toMSecsSinceEpoch();
+			}
+
 			if (nFolders > 100)
 				break;
 			
 			//getFoldersRecursive(dirs.filePath(), subFolders);
 			//qDebug() << "loop: " << dirs.filePath();
 		}
+
+		if (useCache)
+			DkFolderIndexCache::saveSubFolders(cacheFolders, cacheModified);
 	}	
 
 	subFolders << dirPath;
@@ -1694,57 +2945,14 @@ void DkImageLoader::updateCacher(QSharedPointer<DkImageContainerT> imgC) {
 	if (!imgC || !Settings::param().resources().cacheMemory)
 		return;
 
-	DkTimer dt;
-
-	//// no caching? delete all
-	//if (!Settings::param().resources().cacheMemory) {
-	//	for (int idx = 0; idx < images.size(); idx++) {
-	//		images.at(idx)->clear();
-	//	}
-	//	return;
-	//}
-
 	int cIdx = findFileIdx(imgC->filePath(), mImages);
-	float mem = 0;
 
 	if (cIdx == -1) {
 		qDebug() << "WARNING: image not found for caching!";
 		return;
 	}
 
-	for (int idx = 0; idx < mImages.size(); idx++) {
-
-		// clear images if they are edited
-		if (idx != cIdx && mImages.at(idx)->isEdited()) {
-			mImages.at(idx)->clear();
-			continue;
-		}
-
-		if (idx >= cIdx-1 && idx <= cIdx+Settings::param().resources().maxImagesCached)
-			mem += mImages.at(idx)->getMemoryUsage();
-		else {
-			mImages.at(idx)->clear();
-			continue;
-		}
-
-		// ignore the last and current one
-		if (idx == cIdx-1 || idx == cIdx) {
-			continue;
-		}
-		// fully load the next image
-		else if (idx == cIdx+1 && mem < Settings::param().resources().cacheMemory && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
-			mImages.at(idx)->loadImageThreaded();
-			qDebug() << "[Cacher] " << mImages.at(idx)->filePath() << " fully cached...";
-		}
-		else if (idx > cIdx && idx < cIdx+Settings::param().resources().maxImagesCached-2 && mem < Settings::param().resources().cacheMemory && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
-			//dt.getIvl();
-			mImages.at(idx)->fetchFile();		// TODO: crash detected here
-			qDebug() << "[Cacher] " << mImages.at(idx)->filePath() << " file fetched...";
-		}
-	}
-
-	qDebug() << "cache with: " << mem << " MB created in: " << dt.getTotal();
-
+	mImageCache.update(mImages, cIdx);
 }
 
 /**
@@ -1761,6 +2969,22 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString& dirPath, QSt
 
 	DkTimer dt;
 
+	bool useCache = Settings::param().resources().cacheFolderIndex;
+	QString filterKey = DkFolderIndexCache::filterKey(ignoreKeywords, keywords, folderKeywords);
+	QVector<DkFolderIndexCache::Entry> entries;
+	QFileInfoList fileInfoList;
+
+	if (useCache && DkFolderIndexCache::load(dirPath, filterKey, entries)) {
+
+		for (const DkFolderIndexCache::Entry& e : entries)
+			fileInfoList.append(QFileInfo(dirPath, e.fileName));
+
+		qDebug() << "cached index with" << fileInfoList.size() << "files loaded in:" << dt.getTotal();
+		return fileInfoList;
+	}
+
+	qint64 dirModified = DkFolderIndexCache::dirModified(dirPath);
+
 #ifdef Q_OS_WIN
 
 	QString winPath = QDir::toNativeSeparators(dirPath) + "\\*.*";
@@ -1822,82 +3046,158 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString& dirPath, QSt
 
 #endif
 
-	for (int idx = 0; idx < ignoreKeywords.size(); idx++) {
-		QRegExp exp = QRegExp("^((?!" + ignoreKeywords[idx] + ").)*$");
-		exp.setCaseSensitivity(Qt::CaseInsensitive);
-		fileList = fileList.filter(exp);
-	}
+	fileList = filterFileList(fileList, ignoreKeywords, keywords, folderKeywords);
 
-	for (int idx = 0; idx < keywords.size(); idx++) {
-		fileList = fileList.filter(keywords[idx], Qt::CaseInsensitive);
-	}
+	if (useCache && fileList.size() >= DkFolderIndexCache::min_files)
+		DkFolderIndexCache::save(dirPath, dirModified, filterKey, DkFolderIndexCache::toEntries(fileList));
+
+	for (int idx = 0; idx < fileList.size(); idx++)
+		fileInfoList.append(QFileInfo(dirPath, fileList.at(idx)));
+
+	return fileInfoList;
+}
+
+/**
+ * Filters a file list according to the keywords and the duplicate settings.
+ * This function is thread-safe.
+ * @param fileList the file names
+ * @param ignoreKeywords if one of these keywords is in the file name, the file will be ignored.
+ * @param keywords if one of these keywords is not in the file name, the file will be ignored.
+ * @param folderKeywords the current folder filter.
+ * @return QStringList the filtered file names.
+ **/ 
+QStringList DkImageLoader::filterFileList(QStringList fileList, const QStringList& ignoreKeywords, const QStringList& keywords, const QStringList& folderKeywords) {
+
+	QStringList preferredExtensions;
+
+	if (Settings::param().resources().filterDuplicats)
+		preferredExtensions = Settings::param().resources().preferredExtensions;
+
+	return filterFileList(fileList, ignoreKeywords, keywords, folderKeywords, preferredExtensions);
+}
+
+/**
+ * Filters a file list according to the keywords.
+ * Use this function if the settings cannot be accessed (e.g. in worker threads).
+ * @param fileList the file names
+ * @param ignoreKeywords if one of these keywords is in the file name, the file will be ignored.
+ * @param keywords if one of these keywords is not in the file name, the file will be ignored.
+ * @param folderKeywords the current folder filter.
+ * @param preferredExtensions the extensions used to filter duplicates - duplicates are kept if empty.
+ * @return QStringList the filtered file names.
+ **/ 
+QStringList DkImageLoader::filterFileList(QStringList fileList, const QStringList& ignoreKeywords, const QStringList& keywords, const QStringList& folderKeywords, const QStringList& preferredExtensions) {
+
+	DkTimer dt;
+
+	// the folder keywords are just keywords - unless they don't match anything
+	QStringList resultList = DkFileNameFilter(ignoreKeywords, keywords + folderKeywords).filter(fileList);
 
 	if (!folderKeywords.empty()) {
-		
-		QStringList resultList = fileList;
-		for (int idx = 0; idx < folderKeywords.size(); idx++) {
-			resultList = resultList.filter(folderKeywords[idx], Qt::CaseInsensitive);
-		}
 
 		// if string match returns nothing -> try a regexp
-		if (resultList.empty())
-			resultList = fileList.filter(QRegExp(folderKeywords.join(" ")));
+		if (resultList.empty()) {
+			resultList = DkFileNameFilter(ignoreKeywords, keywords).filter(fileList);
+			resultList = resultList.filter(QRegularExpression(folderKeywords.join(" ")));
+		}
 
-		qDebug() << "filtered file list (get)" << resultList;
+		qDebug() << "filtered file list (get)" << resultList.size() << "files";
 		qDebug() << "keywords: " << folderKeywords;
-		fileList = resultList;
 	}
 
-	if (Settings::param().resources().filterDuplicats) {
+	if (!ignoreKeywords.empty() || !keywords.empty() || !folderKeywords.empty())
+		qDebug() << "[DkImageLoader]" << fileList.size() << "files filtered in" << dt.getTotal();
+
+	fileList = resultList;
+
+	if (!preferredExtensions.empty())
+		fileList = filterDuplicates(fileList, preferredExtensions);
+
+	return fileList;
+}
+
+/**
+ * Removes files that exist with a preferred extension (e.g. img.jpg if img.arw exists).
+ * Files are grouped by their base name. If a group contains preferred extensions,
+ * only the files with the highest priority are kept - otherwise all files are kept.
+ * @param fileList the file names
+ * @param preferredExtensions the extensions (e.g. *.arw, *.jpg) ordered by priority
+ * @return QStringList the file names without duplicates (the order is preserved)
+ **/ 
+QStringList DkImageLoader::filterDuplicates(const QStringList& fileList, const QStringList& preferredExtensions) {
 
-		QString preferredExtension = Settings::param().resources().preferredExtension;
-		preferredExtension = preferredExtension.replace("*.", "");
-		qDebug() << "preferred extension: " << preferredExtension;
+	DkTimer dt;
 
-		QStringList resultList = fileList;
-		fileList.clear();
+	// extension -> priority (lower is better)
+	QHash<QString, int> priorities;
+	for (int idx = 0; idx < preferredExtensions.size(); idx++) {
 		
-		for (int idx = 0; idx < resultList.size(); idx++) {
-			
-			QFileInfo cFName = QFileInfo(resultList.at(idx));
+		QString ext = preferredExtensions[idx].toLower();
+		ext.replace("*.", "");
+		
+		if (!priorities.contains(ext))
+			priorities.insert(ext, idx);
+	}
 
-			if (preferredExtension.compare(cFName.suffix(), Qt::CaseInsensitive) == 0) {
-				fileList.append(resultList.at(idx));
-				continue;
-			}
+	if (priorities.empty())
+		return fileList;
 
-			QString cFBase = cFName.baseName();
-			bool remove = false;
+	QVector<int> fileRanks(fileList.size(), -1);
+	QStringList baseNames;
+	baseNames.reserve(fileList.size());
+	QHash<QString, int> bestRanks;	// base name -> best priority
 
-			for (int cIdx = 0; cIdx < resultList.size(); cIdx++) {
+	for (int idx = 0; idx < fileList.size(); idx++) {
 
-				QString ccBase = QFileInfo(resultList.at(cIdx)).baseName();
+		const QString& fileName = fileList.at(idx);
 
-				if (cIdx != idx && ccBase == cFBase && resultList.at(cIdx).contains(preferredExtension, Qt::CaseInsensitive)) {
-					remove = true;
-					break;
-				}
-			}
-			
-			if (!remove)
-				fileList.append(resultList.at(idx));
-		}
+		// same as QFileInfo::baseName() and QFileInfo::suffix() - without the overhead
+		int sIdx = fileName.lastIndexOf('.');
+		QString suffix = (sIdx != -1) ? fileName.mid(sIdx+1).toLower() : QString();
+		baseNames.append(fileName.left(fileName.indexOf('.')));
+
+		int rank = priorities.value(suffix, -1);
+		fileRanks[idx] = rank;
+
+		if (rank == -1)
+			continue;
+
+		QHash<QString, int>::iterator bIt = bestRanks.find(baseNames.last());
+		
+		if (bIt == bestRanks.end())
+			bestRanks.insert(baseNames.last(), rank);
+		else if (rank < bIt.value())
+			bIt.value() = rank;
 	}
 
-	//fileList = sort(fileList, dir);
+	QStringList resultList;
+	resultList.reserve(fileList.size());
 
-	QFileInfoList fileInfoList;
-	
-	for (int idx = 0; idx < fileList.size(); idx++)
-		fileInfoList.append(QFileInfo(mCurrentDir, fileList.at(idx)));
+	for (int idx = 0; idx < fileList.size(); idx++) {
 
-	return fileInfoList;
+		int bestRank = bestRanks.value(baseNames.at(idx), -1);
+
+		if (bestRank == -1 || fileRanks[idx] == bestRank)
+			resultList.append(fileList.at(idx));
+	}
+
+	qDebug() << "[DkImageLoader]" << fileList.size() - resultList.size() << "duplicates removed in" << dt.getTotal();
+
+	return resultList;
 }
 
 void DkImageLoader::sort() {
 	
-	qSort(mImages.begin(), mImages.end(), imageContainerLessThanPtr);
+	// the user explicitly asked to sort - so shuffle again
+	if (Settings::param().global().sortMode == DkSettings::sort_random)
+		mRandomSeed = (uint)QDateTime::currentMSecsSinceEpoch();
+
+	mImages = sortImages(mImages);
+	updateImageIndex();
 	emit updateDirSignal(mImages);
+
+	// file dates are known if we sorted by date
+	updateIndexCache();
 }
 
 void DkImageLoader::currentImageUpdated() const {
@@ -1908,6 +3208,32 @@ void DkImageLoader::currentImageUpdated() const {
 	emit imageUpdatedSignal(mCurrentImage);
 }
 
+void DkImageLoader::regionLoaded() const {
+
+	if (mCurrentImage.isNull())
+		return;
+
+	emit regionLoadedSignal(mCurrentImage);
+}
+
+/**
+ * The embedded preview of the current image is ready.
+ * It is shown until the image is decoded.
+ **/ 
+void DkImageLoader::previewLoaded() {
+
+	if (mCurrentImage.isNull())
+		return;
+
+	emit previewLoadedSignal(mCurrentImage);
+	DkLoaderStats::instance().count(DkLoaderStats::counter_preview);
+
+	if (mLoadTimer.isValid() && !mFirstPixelShown) {
+		DkLoaderStats::instance().addFirstPixelTime(mLoadTimer.elapsed());
+		mFirstPixelShown = true;
+	}
+}
+
 /**
  * Returns the directory where files are saved to.
  * @return QDir the directory where the user saved the last file to.
@@ -1953,6 +3279,17 @@ void DkImageLoader::redo() {
 	mCurrentImage->redo();
 }
 
+/**
+ * Sets the size of the viewport.
+ * JPGs are decoded at this size until the user zooms in.
+ * @param size the viewport's size in pixels.
+ **/ 
+void DkImageLoader::setTargetSize(const QSize& size) {
+
+	mTargetSize = size;
+	mImageCache.setTargetSize(size);
+}
+
 /**
 	* Returns the currently loaded image.
 	* @return QImage the current image
@@ -2015,6 +3352,7 @@ void DkImageLoader::setFolderFilters(const QStringList& filters) {
 	mFolderKeywords = filters;
 	mFolderUpdated = true;
 	loadDir(mCurrentDir);	// simulate a folder update operation
+	finishIndexing();		// otherwise the old filter is shown until the folder is indexed
 }
 
 QStringList DkImageLoader::getFolderFilters() {
@@ -30,6 +30,12 @@
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QTimer>
 #include <QImage>
+#include <QHash>
+#include <QFuture>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QMutex>
 #pragma warning(pop)	// no warnings from includes - end
 
 #ifndef DllLoaderExport
@@ -55,6 +61,144 @@ class QUrl;
 
 namespace nmc {
 
+/**
+ * Persistent cache of folder indexes.
+ * Indexing large (network) folders is slow, hence we store
+ * the filtered file list of a folder on disk. A cached index is valid
+ * as long as the folder's modification date does not change.
+ **/ 
+class DllLoaderExport DkFolderIndexCache {
+
+public:
+	struct Entry {
+		QString fileName;
+		qint64 created = -1;	// ms since epoch, -1 if unknown
+		qint64 modified = -1;
+	};
+
+	enum {
+		min_files = 100,		// smaller folders are indexed fast enough
+		max_entries = 2000000,	// larger indexes are neither written nor read
+		max_indexes = 200,		// the least recently written indexes are removed
+	};
+
+	static bool load(const QString& dirPath, const QString& filterKey, QVector<Entry>& entries, qint64* dirModified = 0);
+	static bool save(const QString& dirPath, qint64 dirModified, const QString& filterKey, const QVector<Entry>& entries);
+	static bool update(const QString& dirPath, const QString& filterKey, const QVector<Entry>& entries);
+
+	static bool loadSubFolders(const QString& dirPath, QStringList& subFolders);
+	static bool saveSubFolders(const QStringList& folders, const QVector<qint64>& modified);
+
+	static QString filterKey(const QStringList& ignoreKeywords, const QStringList& keywords, const QStringList& folderKeywords);
+	static QStringList fileNames(const QVector<Entry>& entries);
+	static QVector<Entry> toEntries(const QStringList& fileNames);
+	static QVector<Entry> changedEntries(const QString& dirPath, const QVector<Entry>& entries);
+	static qint64 dirModified(const QString& dirPath);
+
+protected:
+	static QString cacheFilePath(const QString& dirPath, const QString& suffix);
+	static void prune();
+	static QMutex& mutex();
+};
+
+/**
+ * Filters file names by keywords.
+ * All keywords are compiled into a single regular expression
+ * so that each file name is matched exactly once.
+ **/ 
+class DllLoaderExport DkFileNameFilter {
+
+public:
+	DkFileNameFilter(const QStringList& ignoreKeywords = QStringList(), const QStringList& keywords = QStringList());
+
+	bool isEmpty() const;
+	bool matches(const QString& fileName) const;
+	QStringList filter(const QStringList& fileNames) const;
+
+protected:
+	QString createPattern(const QStringList& ignoreKeywords, const QStringList& keywords, bool escapeIgnore) const;
+
+	QRegularExpression mExp;
+	bool mEmpty = true;
+};
+
+/**
+ * Indexes a folder in a background thread.
+ * Files are reported in chunks while indexing so that
+ * large (or network) folders become usable immediately.
+ **/ 
+class DllLoaderExport DkFolderIndexer : public QObject {
+	Q_OBJECT
+
+public:
+	DkFolderIndexer(QObject* parent = 0);
+	virtual ~DkFolderIndexer();
+
+	void index(const QString& dirPath, const QStringList& ignoreKeywords, const QStringList& keywords, const QStringList& folderKeywords, bool reportChunks = true);
+	QStringList indexNow(const QString& dirPath, const QStringList& ignoreKeywords, const QStringList& keywords, const QStringList& folderKeywords);
+	void cancel();
+	bool isIndexing() const;
+
+signals:
+	void filesIndexed(const QString& dirPath, const QStringList& fileNames) const;
+	void indexFinished(const QString& dirPath, const QStringList& fileNames) const;
+
+	// internal - emitted by the indexing thread
+	void chunkIndexedSignal(int indexId, const QString& dirPath, const QStringList& fileNames, bool finished) const;
+
+protected slots:
+	void chunkIndexed(int indexId, const QString& dirPath, const QStringList& fileNames, bool finished);
+
+protected:
+	// the settings are read in the GUI thread
+	struct Task {
+		int indexId = 0;
+		QString dirPath;
+		QStringList ignoreKeywords;
+		QStringList keywords;
+		QStringList folderKeywords;
+		QStringList browseFilters;
+		QStringList preferredExtensions;	// empty if duplicates are not filtered
+		QString filterKey;					// empty if the index is not cached
+		bool reportChunks = true;
+	};
+
+	Task createTask(const QString& dirPath, const QStringList& ignoreKeywords, const QStringList& keywords, const QStringList& folderKeywords, bool reportChunks) const;
+	void indexIntern(const Task& task);
+	QStringList indexFiles(const Task& task);
+	bool isCanceled(int indexId) const;
+
+	QAtomicInt mIndexId;
+	bool mIndexing = false;
+	QList<QFuture<void> > mFutures;
+};
+
+/**
+ * Keeps decoded images within the cacheMemory budget.
+ * Images are prefetched in the current navigation direction
+ * and the least recently used images are evicted first.
+ * Only cached images are visited, never the whole folder.
+ **/ 
+class DllLoaderExport DkImageCache {
+
+public:
+	void update(const QVector<QSharedPointer<DkImageContainerT> >& images, int cIdx);
+	void clear(QSharedPointer<DkImageContainerT> keepImage = QSharedPointer<DkImageContainerT>());
+	float memoryUsage() const;
+	void setTargetSize(const QSize& size);
+
+protected:
+	void updateDirection(int cIdx, int numImages);
+	QVector<int> prefetchIndexes(int cIdx, int numImages) const;
+	void touch(QSharedPointer<DkImageContainerT> imgC, int pos = 0);
+	void evict(float memBudget);
+
+	QList<QSharedPointer<DkImageContainerT> > mImages;	// most recently used first
+	int mLastIdx = -1;
+	int mDirection = 1;		// 1 forward, -1 backward, 0 both
+	QSize mTargetSize;		// display size of prefetched images
+};
+
 /**
  * This class is a basic image loader class.
  * It takes care of the file watches for the current folder,
@@ -73,6 +217,9 @@ public:
 	static QStringList getFoldersRecursive(const QString& dirPath);
 	QFileInfoList updateSubFolders(const QString& rootDirPath);
 	QFileInfoList getFilteredFileInfoList(const QString& dirPath, QStringList ignoreKeywords = QStringList(), QStringList keywords = QStringList(), QStringList folderKeywords = QStringList());
+	static QStringList filterFileList(QStringList fileList, const QStringList& ignoreKeywords = QStringList(), const QStringList& keywords = QStringList(), const QStringList& folderKeywords = QStringList());
+	static QStringList filterFileList(QStringList fileList, const QStringList& ignoreKeywords, const QStringList& keywords, const QStringList& folderKeywords, const QStringList& preferredExtensions);
+	static QStringList filterDuplicates(const QStringList& fileList, const QStringList& preferredExtensions);
 
 	void rotateImage(double angle);
 	QSharedPointer<DkImageContainerT> getCurrentImage() const;
@@ -85,6 +232,7 @@ public:
 	QSharedPointer<DkImageContainerT> setImage(const QImage& img, const QString& editName, const QString& editFilePath = QString());
 	QSharedPointer<DkImageContainerT> setImage(QSharedPointer<DkImageContainerT> img);
 	void setCurrentImage(QSharedPointer<DkImageContainerT> newImg);
+	void setTargetSize(const QSize& size);
 	void sort();
 
 	// file selection
@@ -138,6 +286,8 @@ signals:
 	void imageUpdatedSignal(QSharedPointer<DkImageContainerT> image) const;
 	void imageUpdatedSignal(int idx) const;	// folder scrollbar needs that
 	void imageLoadedSignal(QSharedPointer<DkImageContainerT> image, bool loaded = true) const;
+	void previewLoadedSignal(QSharedPointer<DkImageContainerT> image) const;
+	void regionLoadedSignal(QSharedPointer<DkImageContainerT> image) const;
 	void showInfoSignal(const QString& msg, int time = 3000, int position = 0) const;
 	void updateDirSignal(QVector<QSharedPointer<DkImageContainerT> > images) const;
 	void imageHasGPSSignal(bool hasGPS) const;
@@ -164,12 +314,20 @@ public slots:
 
 	// new slots
 	void currentImageUpdated() const;
+	void previewLoaded();
+	void regionLoaded() const;
 	void imageLoaded(bool loaded = false);
 	void imageSaved(const QString& file, bool saved = true);
 	void imagesSorted();
 	bool unloadFile();
 	void reloadImage();
 
+protected slots:
+	void filesIndexed(const QString& dirPath, const QStringList& fileNames);
+	void indexFinished(const QString& dirPath, const QStringList& fileNames);
+	void notifyDirUpdate() const;
+	void filesRestated();
+
 protected:
 	// functions
 	void updateCacher(QSharedPointer<DkImageContainerT> imgC);
@@ -178,26 +336,47 @@ protected:
 	void updateHistory();
 	void sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT > > images);
 	void createImages(const QFileInfoList& files, bool sort = true);
+	void appendImages(const QFileInfoList& files);
+	void removeDuplicates();
+	void finishIndexing();
+	void sortImagesAndNotify();
+	bool loadIndexCache(const QString& dirPath);
+	void updateIndexCache();
 	QVector<QSharedPointer<DkImageContainerT > > sortImages(QVector<QSharedPointer<DkImageContainerT > > images) const;
+	void updateImageIndex();
+	void closeZipArchive();
 
 	QStringList mIgnoreKeywords;
 	QStringList mKeywords;
 	QStringList mFolderKeywords;		// are deleted if a new folder is opened
 
 	QTimer mDelayedUpdateTimer;
+	QTimer mDirUpdateTimer;			// throttles updateDirSignal while indexing
 	bool mTimerBlockedUpdate = false;
 	QString mCurrentDir;
+	QString mZipPath;				// the archive we browse (its session is kept open)
 	QString mSaveDir;
 	QFileSystemWatcher* mDirWatcher = 0;
+	DkFolderIndexer* mFolderIndexer = 0;
+	bool mLoadIndexedFile = false;		// load mIndexedFileIdx once the folder is indexed
+	int mIndexedFileIdx = 0;
 	QStringList mSubFolders;
 	QVector<QSharedPointer<DkImageContainerT > > mImages;
+	QHash<QString, int> mImageIndex;	// file path -> index in mImages
 	QSharedPointer<DkImageContainerT > mCurrentImage;
 	QSharedPointer<DkImageContainerT > mLastImageLoaded;
+	DkImageCache mImageCache;
+	QElapsedTimer mLoadTimer;	// time to first paint
+	bool mFirstPixelShown = false;	// a preview was shown before the image
+	QSize mTargetSize;			// the viewport's size
 	bool mFolderUpdated = false;
 	int mTmpFileIdx = 0;
 	bool mSortingImages = false;
 	bool mSortingIsDirty = false;
+	uint mRandomSeed = 0;				// seed of sort_random, kept if the folder is rescanned
 	QFutureWatcher<QVector<QSharedPointer<DkImageContainerT > > > mCreateImageWatcher;
+	QFutureWatcher<QVector<DkFolderIndexCache::Entry> > mRestatWatcher;
+	QString mRestatDir;
 
 };
 
@@ -29,10 +29,10 @@
 #include "DkActionManager.h"
 #include "DkSettings.h"
 #include "DkTimer.h"
+#include "DkThreadPool.h"
 
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QDebug>
-#include <QThread>
 #include <QPixmap>
 #include <QPainter>
 #include <QBitmap>
@@ -1140,13 +1140,16 @@ QColor DkImage::getMeanColor(const QImage& img) {
 DkImageStorage::DkImageStorage(const QImage& img) {
 	mImg = img;
 
-	mComputeThread = new QThread;
-	mComputeThread->start();
-	moveToThread(mComputeThread);
-
 	connect(DkActionManager::instance().action(DkActionManager::menu_view_anti_aliasing), SIGNAL(toggled(bool)), this, SLOT(antiAliasingChanged(bool)));
 }
 
+DkImageStorage::~DkImageStorage() {
+
+	mStop = true;
+	DkThreadPool::instance().cancel(mComputeWatcher.future());
+	DkThreadPool::instance().waitForFinished(mComputeWatcher.future());
+}
+
 void DkImageStorage::setImage(const QImage& img) {
 
 	mStop = true;
@@ -1188,8 +1191,11 @@ QImage DkImageStorage::getImage(float factor) {
 	// if the image does not exist - create it
 	if (!mBusy && mImgs.empty() && /*img.colorTable().isEmpty() &&*/ mImg.width() > 32 && mImg.height() > 32) {
 		mStop = false;
+		mBusy = true;
 		// nobody is busy so start working
-		QMetaObject::invokeMethod(this, "computeImage", Qt::QueuedConnection);
+		mComputeWatcher.setFuture(DkThreadPool::instance().run(DkThreadPool::priority_image, [this]() {
+			computeImage();
+		}));
 	}
 
 	// currently no alternative is available
@@ -1199,8 +1205,10 @@ QImage DkImageStorage::getImage(float factor) {
 void DkImageStorage::computeImage() {
 
 	// obviously, computeImage gets called multiple times in some wired cases...
-	if (!mImgs.empty())
+	if (!mImgs.empty()) {
+		mBusy = false;
 		return;
+	}
 
 	DkTimer dt;
 	mBusy = true;
@@ -32,6 +32,7 @@
 #include <QMutex>
 #include <QVector>
 #include <QObject>
+#include <QFutureWatcher>
 
 // opencv
 #ifdef WITH_OPENCV
@@ -124,6 +125,7 @@ class DllLoaderExport DkImageStorage : public QObject {
 
 public:
 	DkImageStorage(const QImage& img = QImage());
+	~DkImageStorage();
 
 	void setImage(const QImage& img);
 	QImage getImageConst() const;
@@ -145,7 +147,7 @@ protected:
 	QVector<QImage> mImgs;
 
 	QMutex mMutex;
-	QThread* mComputeThread = 0;
+	QFutureWatcher<void> mComputeWatcher;
 	bool mBusy = false;
 	bool mStop = true;
 };
@@ -52,6 +52,7 @@ DkMetaDataT::DkMetaDataT() {
 void DkMetaDataT::readMetaData(const QString& filePath, QSharedPointer<QByteArray> ba) {
 
 	mFilePath = filePath;
+	mExifBuffer.clear();
 	QFileInfo fileInfo(filePath);
 
 	try {
@@ -74,6 +75,7 @@ void DkMetaDataT::readMetaData(const QString& filePath, QSharedPointer<QByteArra
 		else {
 			Exiv2::MemIo::AutoPtr exifBuffer(new Exiv2::MemIo((const byte*)ba->constData(), ba->size()));
 			mExifImg = Exiv2::ImageFactory::open(exifBuffer);
+			mExifBuffer = ba;
 		}
 	} 
 	catch (...) {
@@ -133,6 +133,7 @@ protected:
 	};
 
 	Exiv2::Image::AutoPtr mExifImg;
+	QSharedPointer<QByteArray> mExifBuffer;	// Exiv2 reads from this buffer (it might be a mapped file)
 	QString mFilePath;
 	QStringList mQtKeys;
 	QStringList mQtValues;
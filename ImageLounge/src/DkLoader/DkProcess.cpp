@@ -29,13 +29,14 @@
 #include "DkUtils.h"
 #include "DkImageContainer.h"
 #include "DkImageStorage.h"
+#include "DkBasicLoader.h"
 #include "DkPluginManager.h"
 #include "DkSettings.h"
+#include "DkThreadPool.h"
 
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QFuture>
 #include <QFutureWatcher>
-#include <QtConcurrentMap>
 #include <QWidget>
 #include <QUuid>
 #pragma warning(pop)		// no warnings from includes - end
@@ -128,6 +129,27 @@ bool DkResizeBatch::compute(QImage& img, QStringList& logStrings) const {
 	return true;
 }
 
+/**
+ * Returns the size of the resized image.
+ * @param imgSize the size of the input image.
+ * @return QSize the new size. Empty if the image is not resized or
+ * the size depends on the decoded image (scale factor mode).
+ **/ 
+QSize DkResizeBatch::plannedSize(const QSize& imgSize) const {
+
+	if (mMode == mode_default || imgSize.isEmpty())
+		return QSize();
+
+	QSize size;
+	float sf = 1.0f;
+	QStringList logStrings;
+
+	if (!prepareProperties(imgSize, size, sf, logStrings))
+		return QSize();
+
+	return size;
+}
+
 bool DkResizeBatch::prepareProperties(const QSize& imgSize, QSize& size, float& scaleFactor, QStringList& logStrings) const {
 
 	float sf = 1.0f;
@@ -411,12 +433,22 @@ bool DkBatchProcess::process() {
 
 	QSharedPointer<DkImageContainer> imgC(new DkImageContainer(mFilePathIn));
 
-	if (!imgC->loadImage() || imgC->image().isNull()) {
+	QSize ts = targetSize();
+	if (!ts.isEmpty())
+		imgC->getLoader()->setTargetSize(ts);
+
+	if (!imgC->loadImage() || imgC->displayImage().isNull()) {
 		mLogStrings.append(QObject::tr("Error while loading..."));
 		mFailure++;
 		return false;
 	}
 
+	// keep the reduced image - image() would load all pixels otherwise
+	if (imgC->isReduced()) {
+		mLogStrings.append(QObject::tr("%1 decoded at %2 x %3 px").arg(mFilePathIn).arg(imgC->displayImage().width()).arg(imgC->displayImage().height()));
+		imgC->setImage(imgC->displayImage(), QObject::tr("Reduced Image"));
+	}
+
 	for (QSharedPointer<DkAbstractBatch> batch : mProcessFunctions) {
 
 		if (!batch) {
@@ -452,6 +484,36 @@ bool DkBatchProcess::process() {
 	return true;
 }
 
+/**
+ * Returns the size the image should be decoded with.
+ * If the first step shrinks the image, the new size is planned from the file header
+ * and the image (e.g. jpgs) is decoded at a reduced resolution (see DkBasicLoader::setTargetSize).
+ * @return QSize the target size. Empty if all pixels are needed.
+ **/ 
+QSize DkBatchProcess::targetSize() const {
+
+	if (mProcessFunctions.empty())
+		return QSize();
+
+	QSharedPointer<DkResizeBatch> resizeBatch = qSharedPointerDynamicCast<DkResizeBatch>(mProcessFunctions.first());
+
+	if (!resizeBatch)
+		return QSize();
+
+	DkImageHeader header = DkImageHeader::read(mFilePathIn);
+
+	if (!header.isValid())
+		return QSize();
+
+	QSize s = resizeBatch->plannedSize(header.orientedSize());
+	int maxSide = qMax(s.width(), s.height());
+
+	if (s.isEmpty() || maxSide >= qMax(header.size().width(), header.size().height()))
+		return QSize();
+
+	return QSize(maxSide, maxSide);
+}
+
 bool DkBatchProcess::renameFile() {
 
 	if (QFileInfo(mFilePathOut).exists()) {
@@ -647,14 +709,19 @@ void DkBatchProcessing::init() {
 
 void DkBatchProcessing::compute() {
 
+	// do not touch the items while they are processed
+	if (batchWatcher.isRunning())
+		DkThreadPool::instance().waitForFinished(batchWatcher.future());
+
 	init();
 
 	qDebug() << "computing...";
 
-	if (batchWatcher.isRunning())
-		batchWatcher.waitForFinished();
+	DkBatchProcess* items = batchItems.data();
 
-	QFuture<void> future = QtConcurrent::map(batchItems, &nmc::DkBatchProcessing::computeItem);
+	QFuture<void> future = DkThreadPool::instance().map(DkThreadPool::priority_batch, batchItems.size(), [items](int idx) {
+		DkBatchProcessing::computeItem(items[idx]);
+	});
 	batchWatcher.setFuture(future);
 }
 
@@ -758,7 +825,7 @@ bool DkBatchProcessing::isComputing() const {
 
 void DkBatchProcessing::cancel() {
 
-	batchWatcher.cancel();
+	DkThreadPool::instance().cancel(batchWatcher.future());
 }
 
 }
\ No newline at end of file
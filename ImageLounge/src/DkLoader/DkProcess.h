@@ -90,6 +90,7 @@ public:
 	virtual bool compute(QImage& img, QStringList& logStrings) const;
 	virtual QString name() const;
 	virtual bool isActive() const;
+	QSize plannedSize(const QSize& imgSize) const;
 
 	enum {
 		mode_default,
@@ -177,6 +178,7 @@ protected:
 	bool deleteOriginalFile();
 	bool copyFile();
 	bool renameFile();
+	QSize targetSize() const;
 
 	QString mFilePathIn;
 	QString mFilePathOut;
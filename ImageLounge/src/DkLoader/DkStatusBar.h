@@ -62,6 +62,7 @@ public:
 		status_format_info,
 		status_zoom_info,
 		status_filenumber_info,
+		status_thumb_queue_info,
 		status_filesize_info,
 		status_time_info,
 
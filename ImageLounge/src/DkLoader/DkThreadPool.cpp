@@ -0,0 +1,340 @@
+/*******************************************************************************************************
+ DkThreadPool.cpp
+ Created on:	17.10.2016
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkThreadPool.h"
+#include "DkSettings.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QDebug>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmc {
+
+// DkThreadPoolJob --------------------------------------------------------------------
+/**
+ * Runs a job and notifies the pool once it is done.
+ **/
+class DkThreadPoolJob : public QRunnable {
+
+public:
+	DkThreadPoolJob(DkThreadPool* pool, DkThreadPool::Priority priority, const std::function<void()>& work) {
+		mPool = pool;
+		mPriority = priority;
+		mWork = work;
+	}
+
+	void run() override {
+		mWork();
+		mPool->jobFinished(mPriority);
+	}
+
+protected:
+	DkThreadPool* mPool;
+	DkThreadPool::Priority mPriority;
+	std::function<void()> mWork;
+};
+
+// DkThreadPool --------------------------------------------------------------------
+DkThreadPool::DkThreadPool() {
+
+	mQueues.resize(priority_end);
+	mRunning = QVector<int>(priority_end, 0);
+	mLimits = QVector<int>(priority_end, 1);
+
+	mPool = new QThreadPool();
+	updateLimits();
+}
+
+DkThreadPool::~DkThreadPool() {
+
+	// we are shutting down - nobody waits for queued jobs anymore
+	mMutex.lock();
+	for (QList<Job>& queue : mQueues) {
+		for (Job& job : queue)
+			job.future.cancel();
+		queue.clear();
+	}
+	mMutex.unlock();
+
+	mPool->waitForDone();
+	delete mPool;
+}
+
+DkThreadPool& DkThreadPool::instance() {
+
+	// the initialization of function-local statics is thread-safe
+	static DkThreadPool inst;
+	return inst;
+}
+
+/**
+ * Reads the thread limits from the settings.
+ * Call it in the GUI thread - the settings are not thread-safe.
+ * The limits are read once the pool is created.
+ **/
+void DkThreadPool::updateLimits() {
+
+	const DkSettings::Resources& r = Settings::param().resources();
+
+	QMutexLocker lock(&mMutex);
+	mLimits[priority_image] = r.maxThreadsImage;
+	mLimits[priority_prefetch] = r.maxThreadsPrefetch;
+	mLimits[priority_thumb] = r.maxThreadsThumbs;
+	mLimits[priority_thumb_offscreen] = r.maxThreadsOffscreenThumbs;
+	mLimits[priority_batch] = r.maxThreadsBatch;
+
+	// 0 threads would block a class forever
+	for (int& limit : mLimits)
+		limit = qMax(limit, 1);
+
+	mMaxTotal = qMax(r.maxThreads, 1);
+}
+
+/**
+ * Cancels the future and drops all of its jobs that did not start yet.
+ * Running jobs have to check the future themselves.
+ * @param future the future to be canceled.
+ **/
+void DkThreadPool::cancel(const QFuture<void>& future) {
+
+	QFuture<void> f = future;
+	f.cancel();
+	dispatch();
+}
+
+/**
+ * Cancels the future if none of its jobs started yet.
+ * Running jobs are not affected and report their results.
+ * @param future the future to be canceled.
+ * @return bool true if queued jobs were dropped.
+ **/
+bool DkThreadPool::cancelQueued(const QFuture<void>& future) {
+
+	QList<Job> jobs;
+
+	mMutex.lock();
+	for (QList<Job>& queue : mQueues) {
+
+		for (int idx = 0; idx < queue.size(); idx++) {
+
+			if (queue.at(idx).future == future)
+				jobs << queue.takeAt(idx--);
+		}
+	}
+	mMutex.unlock();
+
+	if (jobs.empty())
+		return false;
+
+	QFuture<void> f = future;
+	f.cancel();
+
+	// the future is canceled - the jobs just report that they are finished
+	for (Job& job : jobs)
+		job.work();
+
+	return true;
+}
+
+/**
+ * Waits until all jobs of future are done.
+ * Jobs that did not start yet are run in the calling thread
+ * so that we do not wait for unrelated jobs queued before them.
+ * @param future the future to wait for.
+ **/
+void DkThreadPool::waitForFinished(const QFuture<void>& future) {
+
+	QList<Job> jobs;
+
+	mMutex.lock();
+	for (QList<Job>& queue : mQueues) {
+
+		for (int idx = 0; idx < queue.size(); idx++) {
+
+			if (queue.at(idx).future == future)
+				jobs << queue.takeAt(idx--);
+		}
+	}
+	mMutex.unlock();
+
+	for (Job& job : jobs)
+		job.work();
+
+	// running jobs
+	QFuture<void> f = future;
+	f.waitForFinished();
+}
+
+/**
+ * Moves all queued jobs of future to another priority class.
+ * This is needed if e.g. a prefetched image is displayed.
+ * Jobs that are already running are not affected.
+ * @param future the future of the jobs.
+ * @param priority the new priority class.
+ * @return bool true if a queued job was found.
+ **/
+bool DkThreadPool::setPriority(const QFuture<void>& future, Priority priority) {
+
+	bool found = false;
+
+	mMutex.lock();
+	for (int pIdx = 0; pIdx < mQueues.size(); pIdx++) {
+
+		if (pIdx == priority)
+			continue;
+
+		QList<Job>& queue = mQueues[pIdx];
+
+		for (int idx = queue.size()-1; idx >= 0; idx--) {
+
+			if (queue.at(idx).future == future) {
+				mQueues[priority].prepend(queue.takeAt(idx));
+				found = true;
+			}
+		}
+	}
+	mMutex.unlock();
+
+	if (found)
+		dispatch();
+
+	return found;
+}
+
+int DkThreadPool::numQueued(Priority priority) const {
+
+	QMutexLocker lock(&mMutex);
+	return mQueues[priority].size();
+}
+
+int DkThreadPool::numRunning(Priority priority) const {
+
+	QMutexLocker lock(&mMutex);
+	return mRunning[priority];
+}
+
+void DkThreadPool::enqueue(Priority priority, const QFuture<void>& future, std::function<void()> work) {
+
+	Job job;
+	job.future = future;
+	job.work = work;
+
+	mMutex.lock();
+	mQueues[priority].append(job);
+	mMutex.unlock();
+
+	dispatch();
+}
+
+void DkThreadPool::jobFinished(Priority priority) {
+
+	mMutex.lock();
+	mRunning[priority]--;
+	mMutex.unlock();
+
+	dispatch();
+}
+
+void DkThreadPool::dispatch() {
+
+	QList<Job> canceled;
+
+	mMutex.lock();
+
+	canceled = takeCanceled();
+
+	int maxTotal = mMaxTotal;
+	int numTotal = 0;
+
+	// the visible image does not count
+	for (int pIdx = priority_image+1; pIdx < priority_end; pIdx++)
+		numTotal += mRunning[pIdx];
+
+	// guarantee that the visible image always finds a thread
+	int poolSize = maxTotal + maxThreads(priority_image);
+	if (mPool->maxThreadCount() != poolSize)
+		mPool->setMaxThreadCount(poolSize);
+
+	for (int pIdx = 0; pIdx < priority_end; pIdx++) {
+
+		Priority p = (Priority)pIdx;
+		int limit = maxThreads(p);
+		QList<Job>& queue = mQueues[pIdx];
+
+		while (!queue.empty() && mRunning[pIdx] < limit && (p == priority_image || numTotal < maxTotal)) {
+
+			Job job = queue.takeFirst();
+			mRunning[pIdx]++;
+
+			if (p != priority_image)
+				numTotal++;
+
+			mPool->start(new DkThreadPoolJob(this, p, job.work));
+		}
+	}
+
+	mMutex.unlock();
+
+	// finish canceled jobs outside the lock (their watchers get notified)
+	for (Job& job : canceled)
+		job.work();
+}
+
+/**
+ * Removes all canceled jobs from the queues.
+ * The caller has to lock the mutex.
+ * @return QList<DkThreadPool::Job> the canceled jobs.
+ **/
+QList<DkThreadPool::Job> DkThreadPool::takeCanceled() {
+
+	QList<Job> canceled;
+
+	for (QList<Job>& queue : mQueues) {
+
+		for (int idx = queue.size()-1; idx >= 0; idx--) {
+
+			if (queue.at(idx).future.isCanceled())
+				canceled.prepend(queue.takeAt(idx));
+		}
+	}
+
+	return canceled;
+}
+
+/**
+ * Returns the thread limit of a priority class.
+ * The caller has to lock the mutex.
+ **/
+int DkThreadPool::maxThreads(Priority priority) const {
+
+	return mLimits[priority];
+}
+
+}
@@ -0,0 +1,201 @@
+/*******************************************************************************************************
+ DkThreadPool.h
+ Created on:	17.10.2016
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QFuture>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QVector>
+#include <QList>
+#include <functional>
+#pragma warning(pop)		// no warnings from includes - end
+
+#ifdef Q_OS_WIN
+#pragma warning(disable: 4251)	// TODO: remove
+#endif
+
+#ifndef DllLoaderExport
+#ifdef DK_LOADER_DLL_EXPORT
+#define DllLoaderExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllLoaderExport Q_DECL_IMPORT
+#else
+#define DllLoaderExport Q_DECL_IMPORT
+#endif
+#endif
+
+// Qt defines
+class QThreadPool;
+
+namespace nmc {
+
+/**
+ * Runs the loader's background jobs.
+ * Jobs are queued per priority class and the most important queue is served first.
+ * Each class has its own thread limit (see DkSettings::Resources and updateLimits()) so that
+ * a folder of thumbnails cannot starve the image the user is looking at.
+ * The visible image is not counted against the total thread limit.
+ * Jobs that are canceled before they start are dropped.
+ * Use waitForFinished() rather than QFuture::waitForFinished() -
+ * QFuture cannot run jobs of this pool in the waiting thread.
+ * This class is thread-safe.
+ **/
+class DllLoaderExport DkThreadPool {
+
+public:
+	enum Priority {
+		priority_image,				// the image currently displayed
+		priority_prefetch,			// images cached for the next steps
+		priority_thumb,				// thumbnails currently visible
+		priority_thumb_offscreen,	// thumbnails nobody looks at (yet)
+		priority_batch,				// batch processing
+
+		priority_end
+	};
+
+	static DkThreadPool& instance();
+	~DkThreadPool();
+
+	void updateLimits();
+
+	/**
+	 * Runs func in the priority class priority.
+	 * Similar to QtConcurrent::run, the returned future
+	 * can be observed using a QFutureWatcher.
+	 * @param priority the job's priority class.
+	 * @param func a function (or lambda) without arguments.
+	 * @return QFuture the future that holds the function's result.
+	 **/
+	template <typename Function>
+	auto run(Priority priority, Function func) -> QFuture<decltype(func())> {
+
+		typedef decltype(func()) T;
+
+		QFutureInterface<T> fi;
+		fi.reportStarted();
+		QFuture<T> future = fi.future();
+
+		enqueue(priority, future, [fi, func]() mutable {
+
+			if (!fi.isCanceled())
+				DkThreadPool::call(fi, func);
+			fi.reportFinished();
+		});
+
+		return future;
+	}
+
+	/**
+	 * Runs func(idx) for all idx in [0 numItems[ in the priority class priority.
+	 * The future's progress value is the number of items processed.
+	 * Canceling the future stops all items that have not been started yet.
+	 * @param priority the jobs' priority class.
+	 * @param numItems the number of items.
+	 * @param func a function (or lambda) with an int argument.
+	 * @return QFuture<void> the future that reports the progress.
+	 **/
+	template <typename Function>
+	QFuture<void> map(Priority priority, int numItems, Function func) {
+
+		QFutureInterface<void> fi;
+		fi.setProgressRange(0, numItems);
+		fi.reportStarted();
+		QFuture<void> future = fi.future();
+
+		if (numItems <= 0) {
+			fi.reportFinished();
+			return future;
+		}
+
+		QSharedPointer<QAtomicInt> numProcessed(new QAtomicInt(0));
+
+		for (int idx = 0; idx < numItems; idx++) {
+
+			enqueue(priority, future, [fi, func, idx, numItems, numProcessed]() mutable {
+
+				if (!fi.isCanceled())
+					func(idx);
+
+				int cnt = numProcessed->fetchAndAddOrdered(1) + 1;
+				fi.setProgressValue(cnt);
+
+				if (cnt == numItems)
+					fi.reportFinished();
+			});
+		}
+
+		return future;
+	}
+
+	void cancel(const QFuture<void>& future);
+	bool cancelQueued(const QFuture<void>& future);
+	void waitForFinished(const QFuture<void>& future);
+	bool setPriority(const QFuture<void>& future, Priority priority);
+	int numQueued(Priority priority) const;
+	int numRunning(Priority priority) const;
+
+protected:
+	struct Job {
+		QFuture<void> future;
+		std::function<void()> work;		// runs the function, reports results & finishes the future
+	};
+
+	void enqueue(Priority priority, const QFuture<void>& future, std::function<void()> work);
+	void dispatch();
+	void jobFinished(Priority priority);
+	QList<Job> takeCanceled();
+	int maxThreads(Priority priority) const;
+
+	template <typename T, typename Function>
+	static void call(QFutureInterface<T>& fi, Function& func) {
+		T result = func();
+		fi.reportResult(result);
+	}
+
+	template <typename Function>
+	static void call(QFutureInterface<void>&, Function& func) {
+		func();
+	}
+
+	mutable QMutex mMutex;
+	QVector<QList<Job> > mQueues;
+	QVector<int> mRunning;
+	QVector<int> mLimits;		// threads per priority class
+	int mMaxTotal = 1;			// threads of all classes but priority_image
+	QThreadPool* mPool = 0;
+
+private:
+	DkThreadPool();
+
+	friend class DkThreadPoolJob;
+};
+
+}
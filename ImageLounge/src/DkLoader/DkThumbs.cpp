@@ -37,13 +37,193 @@
 #include <QStringList>
 #include <QMutex>
 #include <QImageReader>
-#include <QtConcurrentRun>
 #include <QTimer>
 #include <QBuffer>
+#include <QSaveFile>
+#include <QDirIterator>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include <algorithm>
 #pragma warning(pop)		// no warnings from includes - end
 
 namespace nmc {
 
+// DkThumbCache --------------------------------------------------------------------
+static QMutex thumbCacheMutex;
+static qint64 thumbCacheBytes = -1;	// -1 until the cache folder was scanned
+
+bool DkThumbCache::isEnabled() {
+
+	return Settings::param().resources().thumbCacheSize > 0;
+}
+
+/**
+ * Loads a cached thumbnail.
+ * The image itself is not read - just its file info.
+ * @param filePath the image's file path
+ * @param thumbSize the thumbnail's maximal side
+ * @return QImage the thumbnail or a null image if it is not cached (or outdated)
+ **/ 
+QImage DkThumbCache::load(const QString& filePath, int thumbSize) {
+
+	if (!isEnabled())
+		return QImage();
+
+	QString cPath = cacheFilePath(filePath, thumbSize);
+
+	QImage thumb;
+	if (cPath.isEmpty() || !thumb.load(cPath))
+		return QImage();
+
+#if QT_VERSION >= 0x050A00
+	// touch entries once a day so that trimming removes the least recently used ones
+	QFile cFile(cPath);
+	if (cFile.fileTime(QFileDevice::FileModificationTime).daysTo(QDateTime::currentDateTime()) > 0 && cFile.open(QIODevice::ReadWrite))
+		cFile.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+#endif
+
+	return thumb;
+}
+
+/**
+ * Adds a thumbnail to the cache.
+ * @param filePath the image's file path
+ * @param thumbSize the thumbnail's maximal side
+ * @param thumb the thumbnail
+ * @return bool true if the thumbnail was written
+ **/ 
+bool DkThumbCache::save(const QString& filePath, int thumbSize, const QImage& thumb) {
+
+	if (!isEnabled() || thumb.isNull())
+		return false;
+
+	QString cPath = cacheFilePath(filePath, thumbSize);
+
+	if (cPath.isEmpty())
+		return false;
+
+	QDir().mkpath(QFileInfo(cPath).absolutePath());
+
+	// other workers might write the same entry
+	QSaveFile file(cPath);
+
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	bool saved = thumb.hasAlphaChannel() ? thumb.save(&file, "PNG") : thumb.save(&file, "JPG", 90);
+
+	if (!saved || !file.commit()) {
+		qDebug() << "[DkThumbCache] cannot write" << cPath;
+		return false;
+	}
+
+	addBytes(QFileInfo(cPath).size());
+
+	return true;
+}
+
+/**
+ * Removes the least recently used thumbnails until the cache is smaller than maxBytes.
+ * @param maxBytes the cache's maximal size
+ **/ 
+void DkThumbCache::trim(qint64 maxBytes) {
+
+	struct CacheFile {
+		QString path;
+		qint64 size;
+		qint64 used;
+	};
+
+	QVector<CacheFile> files;
+	qint64 total = 0;
+
+	QDirIterator it(cacheDir(), QDir::Files, QDirIterator::Subdirectories);
+	while (it.hasNext()) {
+		it.next();
+		CacheFile cf;
+		cf.path = it.filePath();
+		cf.size = it.fileInfo().size();
+		cf.used = it.fileInfo().lastModified().toMSecsSinceEpoch();
+		total += cf.size;
+		files << cf;
+	}
+
+	std::sort(files.begin(), files.end(), [](const CacheFile& l, const CacheFile& r) {
+		return l.used < r.used;
+	});
+
+	int numRemoved = 0;
+	for (const CacheFile& cf : files) {
+		
+		if (total <= maxBytes)
+			break;
+
+		if (QFile::remove(cf.path)) {
+			total -= cf.size;
+			numRemoved++;
+		}
+	}
+
+	QMutexLocker lock(&thumbCacheMutex);
+	thumbCacheBytes = total;
+
+	qDebug() << "[DkThumbCache]" << numRemoved << "thumbnails removed, cache size:" << total/(1024*1024) << "MB";
+}
+
+QString DkThumbCache::cacheDir() {
+
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbs";
+}
+
+QString DkThumbCache::cacheFilePath(const QString& filePath, int thumbSize) {
+
+	QFileInfo fInfo(filePath);
+
+	// e.g. files in zips
+	if (!fInfo.exists())
+		return QString();
+
+	QString key = fInfo.absoluteFilePath() + "|" + QString::number(fInfo.size()) + "|" + 
+		QString::number(fInfo.lastModified().toMSecsSinceEpoch()) + "|" + QString::number(thumbSize);
+	QString hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5).toHex();
+
+	// shard - folders with 100k files are slow on most file systems
+	return cacheDir() + "/" + hash.left(2) + "/" + hash;
+}
+
+void DkThumbCache::addBytes(qint64 bytes) {
+
+	qint64 maxBytes = (qint64)Settings::param().resources().thumbCacheSize*1024*1024;
+	bool needsTrim = false;
+
+	{
+		QMutexLocker lock(&thumbCacheMutex);
+
+		// scan the cache once
+		if (thumbCacheBytes < 0) {
+			thumbCacheBytes = 0;
+			QDirIterator it(cacheDir(), QDir::Files, QDirIterator::Subdirectories);
+			while (it.hasNext()) {
+				it.next();
+				thumbCacheBytes += it.fileInfo().size();
+			}
+		}
+		else
+			thumbCacheBytes += bytes;
+
+		// trim to 80% so that we do not trim for every new thumbnail
+		if (thumbCacheBytes > maxBytes) {
+			thumbCacheBytes = 0;	// trim once
+			needsTrim = true;
+		}
+	}
+
+	if (needsTrim)
+		trim(qRound64(maxBytes*0.8));
+}
+
 /**
 * Default constructor.
 * @param file the corresponding file
@@ -51,6 +231,7 @@ namespace nmc {
 **/ 
 DkThumbNail::DkThumbNail(const QString& filePath, const QImage& img) {
 	mImg = DkImage::createThumb(img);
+	mMips = createMips(mImg);
 	mFile = filePath;
 	mMaxThumbSize = max_thumb_size;
 	mMinThumbSize = Settings::param().display().thumbSize;
@@ -67,7 +248,93 @@ void DkThumbNail::compute(int forceLoad) {
 	
 	// we do this that complicated to be thread-safe
 	// if we use member vars in the thread and the object gets deleted during thread execution we crash...
-	mImg = computeIntern(mFile, QSharedPointer<QByteArray>(), forceLoad, mMaxThumbSize, mMinThumbSize);
+	mMips = computeMips(mFile, QSharedPointer<QByteArray>(), forceLoad, mMaxThumbSize, mMinThumbSize);
+	mImg = mMips.empty() ? QImage() : mMips.last();
+	mLoadedThumbSize = qMax(mMaxThumbSize, qMax(mImg.width(), mImg.height()));
+}
+
+/**
+ * Returns the mip level that fits size best.
+ * That is the smallest level that is not upscaled if drawn with size.
+ * @param size the size (longest side) the thumbnail is drawn with
+ * @return QImage the thumbnail (the largest level if none is large enough)
+ **/ 
+QImage DkThumbNail::getImage(int size) const {
+
+	for (const QImage& mip : mMips) {
+		if (qMax(mip.width(), mip.height()) >= size)
+			return mip;
+	}
+
+	return mImg;
+}
+
+/**
+ * Creates all mip levels that are smaller than the thumbnail.
+ * @param thumb the thumbnail
+ * @return QVector<QImage> the levels (smallest first) - the last one is thumb
+ **/ 
+QVector<QImage> DkThumbNail::createMips(const QImage& thumb) {
+
+	QVector<QImage> mips;
+
+	if (thumb.isNull())
+		return mips;
+
+	int maxSide = qMax(thumb.width(), thumb.height());
+
+	for (int s : mipSizes()) {
+		if (s < maxSide)
+			mips << thumb.scaled(QSize(s, s), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+	}
+
+	mips << thumb;
+
+	return mips;
+}
+
+QVector<int> DkThumbNail::mipSizes() {
+
+	return QVector<int>() << mip_small << mip_medium << mip_large;
+}
+
+/**
+ * Loads the thumbnail and all of its mip levels.
+ * The levels are created from a single decode (see computeIntern).
+ * If the image is fully decoded, the large level is created too - even if maxThumbSize is smaller.
+ * Just the largest level is cached (see DkThumbCache) - smaller ones are derived from it.
+ * A cache hit neither reads nor decodes the image. The cache is not read if
+ * thumbnails are saved - computeIntern writes them to the file.
+ * @param file the file to be loaded
+ * @param ba the file buffer (can be empty)
+ * @param forceLoad the loading flag (e.g. exiv only)
+ * @param maxThumbSize the maximal thumbnail size to be loaded
+ * @param minThumbSize the minimal thumbnail size to be loaded
+ * @return QVector<QImage> the mip levels (smallest first). Empty if no image could be loaded.
+ **/ 
+QVector<QImage> DkThumbNail::computeMips(const QString& filePath, const QSharedPointer<QByteArray> ba, 
+								  int forceLoad, int maxThumbSize, int minThumbSize) {
+
+	DkTimer dt;
+	bool useCache = forceLoad == do_not_force || forceLoad == save_thumb || forceLoad == force_full_thumb;
+
+	if (forceLoad == do_not_force) {
+		
+		QImage cThumb = DkThumbCache::load(filePath, maxThumbSize);
+		
+		if (!cThumb.isNull()) {
+			qDebug() << "[thumb]" << QFileInfo(filePath).fileName() << "loaded from cache in" << dt.getTotal();
+			return createMips(cThumb);
+		}
+	}
+
+	QImage thumb = computeIntern(filePath, ba, forceLoad, maxThumbSize, minThumbSize);
+	QVector<QImage> mips = createMips(thumb);
+
+	if (useCache && !thumb.isNull())
+		DkThumbCache::save(filePath, maxThumbSize, thumb);
+
+	return mips;
 }
 
 /**
@@ -129,22 +396,16 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 	QString lFilePath = fInfo.isSymLink() ? fInfo.symLinkTarget() : filePath;
 	fInfo = lFilePath;
 
-	QImageReader* imageReader = 0;
-	
-	if (!ba || ba->isEmpty())
-		imageReader = new QImageReader(lFilePath);
-	else {
-		QBuffer buffer;
-		buffer.setData(ba->data());
-		buffer.open(QIODevice::ReadOnly);
-		imageReader = new QImageReader(&buffer, fInfo.suffix().toStdString().c_str());
-		buffer.close();
-	}
+	// we decode the whole image anyway - so we keep the large mip level too (zooming won't read the file again)
+	if ((forceLoad == do_not_force || forceLoad == force_full_thumb) && (thumb.isNull() || (thumb.width() < tS && thumb.height() < tS) || forceLoad == force_full_thumb))
+		maxThumbSize = qMax(maxThumbSize, (int)mip_large);
 
 	if (thumb.isNull() || (thumb.width() < tS && thumb.height() < tS)) {
 
-		imgW = imageReader->size().width();		// crash detected: unhandled exception at 0x66850E9A (msvcr110d.dll) in nomacs.exe: 0xC0000005: Access violation reading location 0x0000C788.
-		imgH = imageReader->size().height();	// locks the file!
+		// the header is enough to plan the decode (a QImageReader would lock the file)
+		QSize s = DkImageHeader::read(lFilePath, baZip && !baZip->isEmpty() ? baZip : ba).size();
+		imgW = s.isEmpty() ? -1 : s.width();
+		imgH = s.isEmpty() ? -1 : s.height();
 	}
 	
 	if (forceLoad != DkThumbNailT::force_exif_thumb && (imgW > maxThumbSize || imgH > maxThumbSize)) {
@@ -170,6 +431,30 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 			forceLoad == force_full_thumb || 
 			forceLoad == force_save_thumb)) { // braces
 		
+		QBuffer buffer;
+		QImageReader imageReader;
+
+		if (!ba || ba->isEmpty())
+			imageReader.setFileName(lFilePath);
+		else {
+			buffer.setData(*ba);
+			buffer.open(QIODevice::ReadOnly);
+			imageReader.setDevice(&buffer);
+			imageReader.setFormat(fInfo.suffix().toLatin1());
+		}
+
+		// formats without header support
+		if (imgW == -1 || imgH == -1) {
+
+			QSize s = imageReader.size();
+
+			if (s.width() > maxThumbSize || s.height() > maxThumbSize)
+				s.scale(maxThumbSize, maxThumbSize, Qt::KeepAspectRatio);
+
+			imgW = s.width();
+			imgH = s.height();
+		}
+
 		// flip size if the image is rotated by 90
 		if (metaData.isTiff() && abs(orientation) == 90) {
 			int tmpW = imgW;
@@ -178,10 +463,8 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 			qDebug() << "EXIF size is flipped...";
 		}
 
-		QSize initialSize = imageReader->size();
-
-		imageReader->setScaledSize(QSize(imgW, imgH));
-		thumb = imageReader->read();
+		imageReader.setScaledSize(QSize(imgW, imgH));
+		thumb = imageReader.read();
 
 		// try to read the image
 		if (thumb.isNull()) {
@@ -220,17 +503,11 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 			thumb = thumb.scaled(QSize(imgW*2, imgH*2), Qt::KeepAspectRatio, Qt::FastTransformation);
 			thumb = thumb.scaled(QSize(imgW, imgH), Qt::KeepAspectRatio, Qt::SmoothTransformation);
 		}
-
-		// is there a nice solution to do so??
-		imageReader->setFileName("josef");	// image reader locks the file -> but there should not be one so we just set it to another file...
 	}
 	else if (rescale) {
 		thumb = thumb.scaled(QSize(imgW, imgH), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
 	}
 
-	if (imageReader)
-		delete imageReader;
-
 	if (orientation != -1 && orientation != 0 && (metaData.isJpg() || metaData.isRaw())) {
 		QTransform rotationMatrix;
 		rotationMatrix.rotate((double)orientation);
@@ -335,6 +612,8 @@ void DkThumbNail::removeBlackBorder(QImage& img) {
 void DkThumbNail::setImage(const QImage img) {
 	
 	mImg = DkImage::createThumb(img);
+	mMips = createMips(mImg);
+	mLoadedThumbSize = max_thumb_size;
 }
 
 /**
@@ -358,15 +637,18 @@ DkThumbNailT::~DkThumbNailT() {
 		Settings::param().resources().numThumbsLoading--;
 
 	thumbWatcher.blockSignals(true);
-	thumbWatcher.cancel();
+	DkThreadPool::instance().cancel(thumbWatcher.future());
 }
 
-bool DkThumbNailT::fetchThumb(int forceLoad /* = false */,  QSharedPointer<QByteArray> ba) {
+bool DkThumbNailT::fetchThumb(int forceLoad /* = false */,  QSharedPointer<QByteArray> ba, DkThreadPool::Priority priority) {
 
-	if (forceLoad == force_full_thumb || forceLoad == force_save_thumb || forceLoad == save_thumb)
+	if (forceLoad == force_full_thumb || forceLoad == force_save_thumb || forceLoad == save_thumb) {
 		mImg = QImage();
+		mMips.clear();
+	}
 
-	if (!mImg.isNull() || !mImgExists || mFetching)
+	// a larger mip level might be requested - we keep the current one until it is loaded
+	if ((!mImg.isNull() && mLoadedThumbSize >= mMaxThumbSize) || !mImgExists || mFetching)
 		return false;
 
 	// we have to do our own bool here
@@ -375,8 +657,13 @@ bool DkThumbNailT::fetchThumb(int forceLoad /* = false */,  QSharedPointer<QByte
 	mForceLoad = forceLoad;
 
 	connect(&thumbWatcher, SIGNAL(finished()), this, SLOT(thumbLoaded()));
-	thumbWatcher.setFuture(QtConcurrent::run(this, 
-		&nmc::DkThumbNailT::computeCall, mFile, ba, forceLoad, mMaxThumbSize, mMinThumbSize));
+	QString filePath = mFile;
+	int maxThumbSize = mMaxThumbSize;
+	int minThumbSize = mMinThumbSize;
+
+	thumbWatcher.setFuture(DkThreadPool::instance().run(priority, [this, filePath, ba, forceLoad, maxThumbSize, minThumbSize]() {
+		return computeCall(filePath, ba, forceLoad, maxThumbSize, minThumbSize);
+	}));
 
 	Settings::param().resources().numThumbsLoading++;
 
@@ -384,16 +671,51 @@ bool DkThumbNailT::fetchThumb(int forceLoad /* = false */,  QSharedPointer<QByte
 }
 
 
-QImage DkThumbNailT::computeCall(const QString& filePath, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize) {
+/**
+ * Drops the request if it is still queued.
+ * A thumbnail that is being computed is finished (and kept).
+ **/ 
+void DkThumbNailT::cancel() {
+
+	if (mFetching)
+		DkThreadPool::instance().cancelQueued(thumbWatcher.future());
+}
+
+/**
+ * Moves a queued request to another priority class.
+ * @param priority the new priority class.
+ **/ 
+void DkThumbNailT::setPriority(DkThreadPool::Priority priority) {
+
+	if (mFetching)
+		DkThreadPool::instance().setPriority(thumbWatcher.future(), priority);
+}
+
+QVector<QImage> DkThumbNailT::computeCall(const QString& filePath, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize) {
 
-	return DkThumbNail::computeIntern(filePath, ba, forceLoad, maxThumbSize, minThumbSize);
+	return DkThumbNail::computeMips(filePath, ba, forceLoad, maxThumbSize, minThumbSize);
 }
 
 void DkThumbNailT::thumbLoaded() {
 	
-	QFuture<QImage> future = thumbWatcher.future();
+	QFuture<QVector<QImage> > future = thumbWatcher.future();
 
-	mImg = future.result();
+	// the request was dropped - it can be fetched again
+	if (future.isCanceled() && future.resultCount() == 0) {
+		mFetching = false;
+		Settings::param().resources().numThumbsLoading--;
+		return;
+	}
+
+	QVector<QImage> mips = future.result();
+
+	// keep the smaller level if the larger one failed
+	if (!mips.empty() || mImg.isNull() || mForceLoad != do_not_force) {
+		mMips = mips;
+		mImg = mips.empty() ? QImage() : mips.last();
+	}
+	// full decodes contain larger levels than requested
+	mLoadedThumbSize = qMax(mMaxThumbSize, qMax(mImg.width(), mImg.height()));
 	
 	if (mImg.isNull() && mForceLoad != force_exif_thumb)
 		mImgExists = false;
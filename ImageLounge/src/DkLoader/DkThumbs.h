@@ -36,6 +36,8 @@
 #include <QImage>
 #pragma warning(pop)		// no warnings from includes - end
 
+#include "DkThreadPool.h"
+
 #pragma warning(disable: 4251)	// TODO: remove
 
 #ifndef DllLoaderExport
@@ -52,6 +54,29 @@ namespace nmc {
 
 #define max_thumb_size 160
 
+/**
+ * Persistent thumbnail cache.
+ * Thumbnails are stored pre-scaled (jpg or png if they are transparent)
+ * in the user's cache folder. Entries are keyed by the file's path, size,
+ * modification date and the thumbnail size. Hence, a hit neither opens
+ * nor decodes the image. The cache is trimmed (least recently used first)
+ * if it exceeds DkSettings::Resources::thumbCacheSize.
+ * This class is thread-safe.
+ **/ 
+class DllLoaderExport DkThumbCache {
+
+public:
+	static bool isEnabled();
+	static QImage load(const QString& filePath, int thumbSize);
+	static bool save(const QString& filePath, int thumbSize, const QImage& thumb);
+	static void trim(qint64 maxBytes);
+
+protected:
+	static QString cacheDir();
+	static QString cacheFilePath(const QString& filePath, int thumbSize);
+	static void addBytes(qint64 bytes);
+};
+
 /**
  * This class holds thumbnails.
  **/ 
@@ -100,6 +125,8 @@ public:
 		return mImg;
 	};
 
+	QImage getImage(int size) const;
+
 	/**
 	 * Returns the file information.
 	 * @return QFileInfo the thumbnail file
@@ -156,10 +183,23 @@ public:
 		force_save_thumb,
 	};
 
+	// thumbnails are kept in these sizes (longest side)
+	enum {
+		mip_small = 64,
+		mip_medium = max_thumb_size,
+		mip_large = 400,
+	};
+
+	static QVector<int> mipSizes();
+
 protected:
 	QImage computeIntern(const QString& file, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize);
+	QVector<QImage> computeMips(const QString& file, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize);
+	static QVector<QImage> createMips(const QImage& thumb);
 
 	QImage mImg;
+	QVector<QImage> mMips;			// smallest first, the last one is mImg
+	int mLoadedThumbSize = max_thumb_size;	// the maximal size mImg was loaded with
 	QString mFile;
 	//int s;
 	bool mImgExists;
@@ -174,7 +214,13 @@ public:
 	DkThumbNailT(const QString& mFile = QString(), const QImage& mImg = QImage());
 	~DkThumbNailT();
 
-	bool fetchThumb(int forceLoad = do_not_force, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+	bool fetchThumb(int forceLoad = do_not_force, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), DkThreadPool::Priority priority = DkThreadPool::priority_thumb);
+	void cancel();
+	void setPriority(DkThreadPool::Priority priority);
+
+	bool isFetching() const {
+		return mFetching;
+	};
 
 	/**
 	 * Returns whether the thumbnail was loaded, or does not exist.
@@ -200,9 +246,9 @@ protected slots:
 	void thumbLoaded();
 
 protected:
-	QImage computeCall(const QString& filePath, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize);
+	QVector<QImage> computeCall(const QString& filePath, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize);
 
-	QFutureWatcher<QImage> thumbWatcher;
+	QFutureWatcher<QVector<QImage> > thumbWatcher;
 	bool mFetching;
 	int mForceLoad;
 };
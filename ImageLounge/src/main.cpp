@@ -62,6 +62,7 @@
 #include "DkTimer.h"
 #include "DkPong.h"
 #include "DkUtils.h"
+#include "DkThreadPool.h"
 
 //#include <iostream>
 #include <cassert>
@@ -135,6 +136,7 @@ int main(int argc, char *argv[]) {
 	QSettings& settings = nmc::Settings::instance().getSettings();
 	
 	nmc::Settings::param().load();	// load in constructor??
+	nmc::DkThreadPool::instance().updateLimits();	// the pool's threads must not read the settings
 
 	int mode = settings.value("AppSettings/appMode", nmc::Settings::param().app().appMode).toInt();
 	nmc::Settings::param().app().currentAppMode = mode;
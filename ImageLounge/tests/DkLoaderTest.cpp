@@ -0,0 +1,769 @@
+/*******************************************************************************************************
+ DkLoaderTest.cpp
+ Created on:	18.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkImageContainer.h"
+#include "DkImageLoader.h"
+#include "DkBasicLoader.h"
+#include "DkSettings.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QtTest/QtTest>
+#include <QBuffer>
+#include <QImage>
+#include <QImageWriter>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <algorithm>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmc {
+
+/**
+ * Exposes the policy of the image cache.
+ **/
+class DkImageCacheProbe : public DkImageCache {
+
+public:
+	using DkImageCache::updateDirection;
+	using DkImageCache::prefetchIndexes;
+	using DkImageCache::touch;
+	using DkImageCache::evict;
+
+	QList<QSharedPointer<DkImageContainerT> > images() const {
+		return mImages;
+	};
+
+	int direction() const {
+		return mDirection;
+	};
+};
+
+/**
+ * A slow web server - it serves one file in chunks.
+ * The request is not parsed, every connection gets the file.
+ **/
+class DkChunkServer : public QObject {
+
+public:
+	DkChunkServer(const QByteArray& data, int chunkSize, int interval) {
+		mData = data;
+		mChunkSize = chunkSize;
+		mInterval = interval;
+
+		connect(&mServer, &QTcpServer::newConnection, this, &DkChunkServer::newConnection);
+	};
+
+	bool listen() {
+		return mServer.listen(QHostAddress::LocalHost);
+	};
+
+	QUrl url(const QString& fileName) const {
+		return QUrl(QString("http://127.0.0.1:%1/%2").arg(mServer.serverPort()).arg(fileName));
+	};
+
+	qint64 bytesSent() const {
+		return mBytesSent;
+	};
+
+protected:
+	void newConnection() {
+
+		QTcpSocket* socket = mServer.nextPendingConnection();
+		connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+
+		socket->write("HTTP/1.1 200 OK\r\n"
+			"Content-Type: image/jpeg\r\n"
+			"Content-Length: " + QByteArray::number(mData.size()) + "\r\n"
+			"Connection: close\r\n\r\n");
+
+		QTimer* timer = new QTimer(socket);
+		timer->setInterval(mInterval);
+
+		QSharedPointer<int> pos(new int(0));	// bytes sent to this socket
+		connect(timer, &QTimer::timeout, socket, [this, socket, timer, pos]() {
+
+			// the client aborted
+			if (socket->state() != QAbstractSocket::ConnectedState) {
+				timer->stop();
+				return;
+			}
+
+			QByteArray chunk = mData.mid(*pos, mChunkSize);
+			socket->write(chunk);
+			*pos += chunk.size();
+			mBytesSent += chunk.size();
+
+			if (*pos >= mData.size()) {
+				timer->stop();
+				socket->disconnectFromHost();
+			}
+		});
+
+		timer->start();
+	};
+
+	QTcpServer mServer;
+	QByteArray mData;
+	int mChunkSize = 0;
+	int mInterval = 0;
+	qint64 mBytesSent = 0;
+};
+
+class DkLoaderTest : public QObject {
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+
+	// DkSortKey
+	void sortNatural();
+	void sortDescending();
+	void sortDates();
+	void sortRandom();
+
+	// DkImageCache
+	void cacheDirection();
+	void cachePrefetchIndexes();
+	void cacheTouch();
+	void cacheEvict();
+
+	// DkFolderIndexCache
+	void folderIndexRoundTrip();
+	void folderIndexFilterKey();
+	void folderIndexChangedEntries();
+
+	// DkImageHeader
+	void headerPng();
+	void headerJpg();
+	void headerInvalid();
+
+	// FileDownloader
+	void downloadPartialImages();
+	void downloadByteBudget();
+	void downloadCancel();
+
+	// benchmarks
+	void benchmarkIndexLookup_data();
+	void benchmarkIndexLookup();
+	void benchmarkKeywordFilter_data();
+	void benchmarkKeywordFilter();
+
+	// the RAW files are taken from $NOMACS_RAW_SAMPLES (e.g. CR2, NEF, ARW)
+	void benchmarkRaw_data();
+	void benchmarkRaw();
+
+private:
+	QStringList sorted(QStringList fileNames, int sortMode, int sortDir) const;
+	QSharedPointer<DkImageContainerT> loadedImage(const QString& filePath, const QSize& size) const;
+	QByteArray encode(const QImage& img, const char* format) const;
+	QStringList keywordFilterScan(QStringList fileNames, const QStringList& ignoreKeywords, const QStringList& keywords) const;
+	QByteArray progressiveJpg(const QSize& size) const;
+};
+
+void DkLoaderTest::initTestCase() {
+
+	// do not touch the user's cache & settings
+	QStandardPaths::setTestModeEnabled(true);
+}
+
+QStringList DkLoaderTest::sorted(QStringList fileNames, int sortMode, int sortDir) const {
+
+	std::sort(fileNames.begin(), fileNames.end(), [sortMode, sortDir](const QString& f1, const QString& f2) {
+		return DkSortKey(f1).lessThan(DkSortKey(f2), sortMode, sortDir);
+	});
+
+	return fileNames;
+}
+
+void DkLoaderTest::sortNatural() {
+
+	QStringList files = QStringList() << "img10.jpg" << "img2.jpg" << "img1.jpg" << "img1a.jpg";
+	QStringList expected = QStringList() << "img1.jpg" << "img1a.jpg" << "img2.jpg" << "img10.jpg";
+
+	QCOMPARE(sorted(files, DkSettings::sort_filename, DkSettings::sort_ascending), expected);
+
+	// numbers longer than qint64 are sorted by magnitude too
+	QString n20 = QString(20, '9');
+	QString n21 = "1" + QString(20, '0');
+	files = QStringList() << "img" + n21 + ".jpg" << "img" + n20 + ".jpg";
+	expected = QStringList() << "img" + n20 + ".jpg" << "img" + n21 + ".jpg";
+
+	QCOMPARE(sorted(files, DkSettings::sort_filename, DkSettings::sort_ascending), expected);
+}
+
+void DkLoaderTest::sortDescending() {
+
+	QStringList files = QStringList() << "b.jpg" << "c.jpg" << "a.jpg";
+	QStringList expected = QStringList() << "c.jpg" << "b.jpg" << "a.jpg";
+
+	QCOMPARE(sorted(files, DkSettings::sort_filename, DkSettings::sort_descending), expected);
+}
+
+void DkLoaderTest::sortDates() {
+
+	DkSortKey older("b.jpg");
+	DkSortKey newer("a.jpg");
+	older.setFileDates(1000, 5000);
+	newer.setFileDates(2000, 3000);
+
+	QVERIFY(older.lessThan(newer, DkSettings::sort_date_created, DkSettings::sort_ascending));
+	QVERIFY(newer.lessThan(older, DkSettings::sort_date_modified, DkSettings::sort_ascending));
+
+	// equal dates fall back to the file name
+	DkSortKey same("c.jpg");
+	same.setFileDates(2000, 3000);
+	QVERIFY(newer.lessThan(same, DkSettings::sort_date_created, DkSettings::sort_ascending));
+	QVERIFY(!same.lessThan(newer, DkSettings::sort_date_created, DkSettings::sort_ascending));
+}
+
+void DkLoaderTest::sortRandom() {
+
+	QStringList files;
+	for (int idx = 0; idx < 50; idx++)
+		files << QString("img%1.jpg").arg(idx);
+
+	auto shuffle = [&files](uint seed) {
+
+		QStringList s = files;
+		std::sort(s.begin(), s.end(), [seed](const QString& f1, const QString& f2) {
+			DkSortKey k1(f1), k2(f2);
+			k1.setRandomSeed(seed);
+			k2.setRandomSeed(seed);
+			return k1.lessThan(k2, DkSettings::sort_random, DkSettings::sort_ascending);
+		});
+		return s;
+	};
+
+	// stable for a seed - but not sorted by name
+	QCOMPARE(shuffle(42), shuffle(42));
+	QVERIFY(shuffle(42) != sorted(files, DkSettings::sort_filename, DkSettings::sort_ascending));
+}
+
+QSharedPointer<DkImageContainerT> DkLoaderTest::loadedImage(const QString& filePath, const QSize& size) const {
+
+	QSharedPointer<DkImageContainerT> imgC(new DkImageContainerT(filePath));
+	QImage img(size, QImage::Format_ARGB32);
+	img.fill(Qt::white);
+	imgC->getLoader()->setImage(img, "test", filePath);
+
+	return imgC;
+}
+
+void DkLoaderTest::cacheDirection() {
+
+	int sortMode = Settings::param().global().sortMode;
+	Settings::param().global().sortMode = DkSettings::sort_filename;
+
+	DkImageCacheProbe cache;
+	cache.updateDirection(10, 100);
+	QCOMPARE(cache.direction(), 1);		// default: forward
+
+	cache.updateDirection(9, 100);
+	QCOMPARE(cache.direction(), -1);	// stepped back
+
+	cache.updateDirection(50, 100);
+	QCOMPARE(cache.direction(), 0);		// jumped
+
+	cache.updateDirection(51, 100);
+	QCOMPARE(cache.direction(), 1);
+
+	cache.updateDirection(0, 100);
+	QCOMPARE(cache.direction(), 0);
+
+	cache.updateDirection(99, 100);
+	QCOMPARE(cache.direction(), -1);	// looped backwards
+
+	Settings::param().global().sortMode = sortMode;
+}
+
+void DkLoaderTest::cachePrefetchIndexes() {
+
+	int maxImages = Settings::param().resources().maxImagesCached;
+	bool loop = Settings::param().global().loop;
+	int sortMode = Settings::param().global().sortMode;
+	Settings::param().resources().maxImagesCached = 4;
+	Settings::param().global().loop = false;
+	Settings::param().global().sortMode = DkSettings::sort_filename;
+
+	DkImageCacheProbe cache;
+
+	// forward
+	QCOMPARE(cache.prefetchIndexes(5, 100), QVector<int>() << 6 << 7 << 8 << 9);
+
+	// both directions - the closest images first
+	cache.updateDirection(5, 100);
+	cache.updateDirection(50, 100);
+	QCOMPARE(cache.prefetchIndexes(50, 100), QVector<int>() << 51 << 49 << 52 << 48);
+
+	// the end of the folder
+	QCOMPARE(cache.prefetchIndexes(99, 100), QVector<int>() << 98 << 97 << 96 << 95);
+
+	Settings::param().global().loop = true;
+	QCOMPARE(cache.prefetchIndexes(99, 100), QVector<int>() << 0 << 98 << 1 << 97);
+
+	Settings::param().resources().maxImagesCached = maxImages;
+	Settings::param().global().loop = loop;
+	Settings::param().global().sortMode = sortMode;
+}
+
+void DkLoaderTest::cacheTouch() {
+
+	QSharedPointer<DkImageContainerT> a(new DkImageContainerT("a.jpg"));
+	QSharedPointer<DkImageContainerT> b(new DkImageContainerT("b.jpg"));
+	QSharedPointer<DkImageContainerT> c(new DkImageContainerT("c.jpg"));
+
+	DkImageCacheProbe cache;
+	cache.touch(a);
+	cache.touch(b);
+	cache.touch(c);
+	QCOMPARE(cache.images(), QList<QSharedPointer<DkImageContainerT> >() << c << b << a);
+
+	// used again -> most recent
+	cache.touch(a);
+	QCOMPARE(cache.images(), QList<QSharedPointer<DkImageContainerT> >() << a << c << b);
+
+	// prefetched images are inserted behind the current image
+	cache.touch(b, 1);
+	QCOMPARE(cache.images(), QList<QSharedPointer<DkImageContainerT> >() << a << b << c);
+}
+
+void DkLoaderTest::cacheEvict() {
+
+	QSize s(1000, 1000);	// ~3.8 MB
+	QSharedPointer<DkImageContainerT> current = loadedImage("current.jpg", s);
+	QSharedPointer<DkImageContainerT> recent = loadedImage("recent.jpg", s);
+	QSharedPointer<DkImageContainerT> old = loadedImage("old.jpg", s);
+
+	DkImageCacheProbe cache;
+	cache.touch(old);
+	cache.touch(recent);
+	cache.touch(current);
+
+	float imgMem = current->getMemoryUsage();
+	QVERIFY(imgMem > 0);
+
+	// the least recently used image goes first
+	cache.evict(imgMem*2.5f);
+	QCOMPARE(cache.images(), QList<QSharedPointer<DkImageContainerT> >() << current << recent);
+	QVERIFY(!old->hasImage());
+
+	// the current image is never evicted
+	cache.evict(0);
+	QCOMPARE(cache.images(), QList<QSharedPointer<DkImageContainerT> >() << current);
+	QVERIFY(current->hasImage());
+}
+
+void DkLoaderTest::folderIndexRoundTrip() {
+
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	QVector<DkFolderIndexCache::Entry> entries = DkFolderIndexCache::toEntries(QStringList() << "a.jpg" << "b.png" << "c.tif");
+	entries[1].created = 1000;
+	entries[1].modified = 2000;
+
+	qint64 dirModified = DkFolderIndexCache::dirModified(dir.path());
+	QVERIFY(DkFolderIndexCache::save(dir.path(), dirModified, "key", entries));
+
+	QVector<DkFolderIndexCache::Entry> loaded;
+	qint64 loadedModified = -1;
+	QVERIFY(DkFolderIndexCache::load(dir.path(), "key", loaded, &loadedModified));
+
+	QCOMPARE(loadedModified, dirModified);
+	QCOMPARE(DkFolderIndexCache::fileNames(loaded), DkFolderIndexCache::fileNames(entries));
+	QCOMPARE(loaded[1].created, (qint64)1000);
+	QCOMPARE(loaded[1].modified, (qint64)2000);
+	QCOMPARE(loaded[0].modified, (qint64)-1);
+
+	// an outdated index is not loaded
+	QVERIFY(DkFolderIndexCache::save(dir.path(), dirModified-1000, "key", entries));
+	QVERIFY(!DkFolderIndexCache::load(dir.path(), "key", loaded));
+}
+
+void DkLoaderTest::folderIndexFilterKey() {
+
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	QString key = DkFolderIndexCache::filterKey(QStringList() << "ignore", QStringList(), QStringList());
+	QVERIFY(key != DkFolderIndexCache::filterKey(QStringList(), QStringList(), QStringList()));
+
+	QVector<DkFolderIndexCache::Entry> entries = DkFolderIndexCache::toEntries(QStringList() << "a.jpg");
+	QVERIFY(DkFolderIndexCache::save(dir.path(), DkFolderIndexCache::dirModified(dir.path()), key, entries));
+
+	// indexed with other filters
+	QVector<DkFolderIndexCache::Entry> loaded;
+	QVERIFY(!DkFolderIndexCache::load(dir.path(), "other", loaded));
+	QVERIFY(DkFolderIndexCache::load(dir.path(), key, loaded));
+}
+
+void DkLoaderTest::folderIndexChangedEntries() {
+
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	QFile file(dir.path() + "/a.jpg");
+	QVERIFY(file.open(QIODevice::WriteOnly));
+	file.write("x");
+	file.close();
+
+	QFileInfo fInfo(file.fileName());
+	QVector<DkFolderIndexCache::Entry> entries = DkFolderIndexCache::toEntries(QStringList() << "a.jpg");
+
+	// the dates were never cached - nothing to compare
+	QVERIFY(DkFolderIndexCache::changedEntries(dir.path(), entries).isEmpty());
+
+	entries[0].created = fInfo.created().toMSecsSinceEpoch();
+	entries[0].modified = fInfo.lastModified().toMSecsSinceEpoch();
+	QVERIFY(DkFolderIndexCache::changedEntries(dir.path(), entries).isEmpty());
+
+	entries[0].modified -= 10000;
+	QVector<DkFolderIndexCache::Entry> changed = DkFolderIndexCache::changedEntries(dir.path(), entries);
+	QCOMPARE(changed.size(), 1);
+	QCOMPARE(changed[0].modified, fInfo.lastModified().toMSecsSinceEpoch());
+}
+
+QByteArray DkLoaderTest::encode(const QImage& img, const char* format) const {
+
+	QByteArray ba;
+	QBuffer buffer(&ba);
+	buffer.open(QIODevice::WriteOnly);
+	img.save(&buffer, format);
+
+	return ba;
+}
+
+void DkLoaderTest::headerPng() {
+
+	QImage img(321, 123, QImage::Format_RGB32);
+	img.fill(Qt::red);
+
+	DkImageHeader header = DkImageHeader::read(encode(img, "png"));
+
+	QVERIFY(header.isValid());
+	QCOMPARE(header.size(), QSize(321, 123));
+	QCOMPARE(header.format(), QByteArray("png"));
+}
+
+void DkLoaderTest::headerJpg() {
+
+	if (!QImageWriter::supportedImageFormats().contains("jpg"))
+		QSKIP("no jpg plugin");
+
+	QImage img(640, 480, QImage::Format_RGB32);
+	img.fill(Qt::blue);
+
+	DkImageHeader header = DkImageHeader::read(encode(img, "jpg"));
+
+	QVERIFY(header.isValid());
+	QCOMPARE(header.size(), QSize(640, 480));
+	QCOMPARE(header.orientedSize(), QSize(640, 480));
+	QCOMPARE(header.format(), QByteArray("jpg"));
+}
+
+void DkLoaderTest::headerInvalid() {
+
+	QVERIFY(!DkImageHeader::read(QByteArray()).isValid());
+	QVERIFY(!DkImageHeader::read(QByteArray("this is not an image")).isValid());
+
+	// truncated headers
+	QImage img(64, 64, QImage::Format_RGB32);
+	img.fill(Qt::green);
+	QVERIFY(!DkImageHeader::read(encode(img, "png").left(12)).isValid());
+}
+
+QByteArray DkLoaderTest::progressiveJpg(const QSize& size) const {
+
+	// noise does not compress - so the file is large enough to arrive in many chunks
+	QImage img(size, QImage::Format_RGB32);
+	quint32 seed = 42;
+
+	for (int y = 0; y < img.height(); y++) {
+
+		QRgb* pixel = reinterpret_cast<QRgb*>(img.scanLine(y));
+
+		for (int x = 0; x < img.width(); x++, pixel++) {
+			seed = seed * 1664525u + 1013904223u;
+			*pixel = qRgb(x % 256, y % 256, seed >> 24);
+		}
+	}
+
+	QByteArray ba;
+	QBuffer buffer(&ba);
+	buffer.open(QIODevice::WriteOnly);
+
+	QImageWriter writer(&buffer, "jpeg");
+	writer.setQuality(90);
+	writer.setProgressiveScanWrite(true);
+
+	if (!writer.write(img))
+		return QByteArray();
+
+	return ba;
+}
+
+void DkLoaderTest::downloadPartialImages() {
+
+	QByteArray jpg = progressiveJpg(QSize(1600, 1200));
+
+	if (jpg.isEmpty())
+		QSKIP("no jpg plugin");
+
+	bool progressiveDisplay = Settings::param().resources().progressiveDisplay;
+	int maxDownloadSize = Settings::param().resources().maxDownloadSize;
+	Settings::param().resources().progressiveDisplay = true;
+	Settings::param().resources().maxDownloadSize = 0;
+
+	DkChunkServer server(jpg, 64*1024, 50);
+	QVERIFY(server.listen());
+
+	FileDownloader downloader(server.url("progressive.jpg"));
+	QSignalSpy partialSpy(&downloader, SIGNAL(partialImageSignal()));
+	QSignalSpy downloadedSpy(&downloader, SIGNAL(downloaded()));
+
+	QVERIFY(downloadedSpy.wait(30000));
+
+	// the image was shown before it was downloaded
+	QVERIFY(partialSpy.count() > 0);
+	QVERIFY(!downloader.partialImage().isNull());
+	QVERIFY(downloader.downloadedData());
+	QCOMPARE(*downloader.downloadedData(), jpg);
+
+	Settings::param().resources().progressiveDisplay = progressiveDisplay;
+	Settings::param().resources().maxDownloadSize = maxDownloadSize;
+}
+
+void DkLoaderTest::downloadByteBudget() {
+
+	int maxDownloadSize = Settings::param().resources().maxDownloadSize;
+	Settings::param().resources().maxDownloadSize = 1;	// MB
+
+	QByteArray data(8*1024*1024, 'x');
+	DkChunkServer server(data, 256*1024, 20);
+	QVERIFY(server.listen());
+
+	FileDownloader downloader(server.url("large.jpg"));
+	QSignalSpy downloadedSpy(&downloader, SIGNAL(downloaded()));
+
+	QVERIFY(downloadedSpy.wait(30000));
+
+	// aborted - but not by the user
+	QVERIFY(!downloader.downloadedData() || downloader.downloadedData()->isEmpty());
+	QVERIFY(!downloader.isCanceled());
+	QVERIFY(server.bytesSent() < data.size());
+
+	Settings::param().resources().maxDownloadSize = maxDownloadSize;
+}
+
+void DkLoaderTest::downloadCancel() {
+
+	int maxDownloadSize = Settings::param().resources().maxDownloadSize;
+	Settings::param().resources().maxDownloadSize = 0;
+
+	QByteArray data(2*1024*1024, 'x');
+	DkChunkServer server(data, 64*1024, 50);
+	QVERIFY(server.listen());
+
+	DkImageContainerT imgC("");
+	QSignalSpy infoSpy(&imgC, SIGNAL(showInfoSignal(const QString&, int, int)));
+	QSignalSpy loadedSpy(&imgC, SIGNAL(fileLoadedSignal(bool)));
+
+	imgC.downloadFile(server.url("canceled.jpg"));
+	QTRY_VERIFY(server.bytesSent() > 0);
+
+	// e.g. the user skipped to the next image
+	imgC.cancel();
+
+	QTRY_COMPARE(loadedSpy.count(), 1);
+	QCOMPARE(loadedSpy.first().first().toBool(), false);
+	QCOMPARE(infoSpy.count(), 0);	// canceling is not an error
+
+	Settings::param().resources().maxDownloadSize = maxDownloadSize;
+}
+
+void DkLoaderTest::benchmarkIndexLookup_data() {
+
+	QTest::addColumn<int>("numImages");
+	QTest::addColumn<bool>("indexed");
+
+	for (int numImages : {10000, 100000, 500000}) {
+		QString n = QString::number(numImages/1000) + "k";
+		QTest::newRow(qPrintable(n + " indexed")) << numImages << true;
+		QTest::newRow(qPrintable(n + " scan")) << numImages << false;
+	}
+}
+
+void DkLoaderTest::benchmarkIndexLookup() {
+
+	QFETCH(int, numImages);
+	QFETCH(bool, indexed);
+
+	if (numImages > 100000 && qgetenv("NOMACS_BENCHMARK_LARGE").isEmpty())
+		QSKIP("set NOMACS_BENCHMARK_LARGE to run it (the containers need a few GB)");
+
+	// the files do not need to exist
+	QString dirPath = QDir(QDir::tempPath()).absoluteFilePath("nomacs-index-benchmark");
+	QVector<QSharedPointer<DkImageContainerT> > images;
+	images.reserve(numImages);
+
+	for (int idx = 0; idx < numImages; idx++)
+		images << QSharedPointer<DkImageContainerT>(new DkImageContainerT(QString("%1/img%2.jpg").arg(dirPath).arg(idx)));
+
+	DkImageLoader loader;
+	loader.setImages(images);
+
+	// 1000 lookups spread over the folder
+	QStringList filePaths;
+	for (int idx = 0; idx < 1000; idx++)
+		filePaths << images[(int)((qint64)idx * numImages / 1000)]->filePath();
+
+	int numFound = 0;
+
+	QBENCHMARK {
+		numFound = 0;
+
+		for (const QString& fp : filePaths) {
+
+			// findFileIdx scans lists other than the loader's own images
+			if (indexed ? !loader.findFile(fp).isNull() : loader.findFileIdx(fp, images) != -1)
+				numFound++;
+		}
+	}
+
+	QCOMPARE(numFound, filePaths.size());
+}
+
+/**
+ * The keyword filter we used before DkFileNameFilter:
+ * one regular expression (or list scan) per keyword.
+ **/
+QStringList DkLoaderTest::keywordFilterScan(QStringList fileNames, const QStringList& ignoreKeywords, const QStringList& keywords) const {
+
+	for (const QString& ik : ignoreKeywords) {
+		QRegExp exp = QRegExp("^((?!" + ik + ").)*$");
+		exp.setCaseSensitivity(Qt::CaseInsensitive);
+		fileNames = fileNames.filter(exp);
+	}
+
+	for (const QString& k : keywords)
+		fileNames = fileNames.filter(k, Qt::CaseInsensitive);
+
+	return fileNames;
+}
+
+void DkLoaderTest::benchmarkKeywordFilter_data() {
+
+	QTest::addColumn<bool>("compiled");
+
+	QTest::newRow("scan") << false;
+	QTest::newRow("compiled") << true;
+}
+
+void DkLoaderTest::benchmarkKeywordFilter() {
+
+	QFETCH(bool, compiled);
+
+	QStringList fileNames;
+	fileNames.reserve(200000);
+
+	QStringList tags = QStringList() << "holiday" << "Family" << "work" << "draft" << "export";
+
+	for (int idx = 0; idx < 200000; idx++)
+		fileNames << QString("IMG_%1_%2.%3").arg(idx, 6, 10, QChar('0')).arg(tags[idx % tags.size()]).arg(idx % 3 ? "jpg" : "cr2");
+
+	QStringList ignoreKeywords = QStringList() << "draft" << "export";
+	QStringList keywords = QStringList() << "img" << "a";
+
+	QStringList filtered;
+
+	QBENCHMARK {
+		filtered = compiled ? DkFileNameFilter(ignoreKeywords, keywords).filter(fileNames) : keywordFilterScan(fileNames, ignoreKeywords, keywords);
+	}
+
+	// both filters agree
+	QCOMPARE(filtered, keywordFilterScan(fileNames, ignoreKeywords, keywords));
+	QVERIFY(!filtered.empty());
+}
+
+void DkLoaderTest::benchmarkRaw_data() {
+
+	QString dirPath = qgetenv("NOMACS_RAW_SAMPLES");
+
+	if (dirPath.isEmpty())
+		QSKIP("set NOMACS_RAW_SAMPLES to a folder with RAW files");
+
+	QFileInfoList files = QDir(dirPath).entryInfoList(QStringList() << "*.cr2" << "*.nef" << "*.arw", QDir::Files);
+
+	if (files.empty())
+		QSKIP("no RAW files (cr2, nef, arw) found");
+
+	QTest::addColumn<QString>("filePath");
+	QTest::addColumn<int>("rawSize");
+
+	for (const QFileInfo& fInfo : files) {
+		QTest::newRow(qPrintable(fInfo.fileName() + " full")) << fInfo.absoluteFilePath() << (int)DkSettings::raw_size_full;
+		QTest::newRow(qPrintable(fInfo.fileName() + " quarter")) << fInfo.absoluteFilePath() << (int)DkSettings::raw_size_quarter;
+	}
+}
+
+void DkLoaderTest::benchmarkRaw() {
+
+	QFETCH(QString, filePath);
+	QFETCH(int, rawSize);
+
+	int loadRawThumb = Settings::param().resources().loadRawThumb;
+	int rawDecodeSize = Settings::param().resources().rawDecodeSize;
+	Settings::param().resources().loadRawThumb = DkSettings::raw_thumb_never;	// develop the RAW data
+	Settings::param().resources().rawDecodeSize = rawSize;
+
+	// measure the decoding - not the disk
+	QFile file(filePath);
+	QVERIFY(file.open(QIODevice::ReadOnly));
+	QSharedPointer<QByteArray> ba(new QByteArray(file.readAll()));
+
+	DkBasicLoader loader;
+
+	if (rawSize != DkSettings::raw_size_full)
+		loader.setTargetSize(QSize(640, 480));
+
+	QBENCHMARK {
+		QVERIFY(loader.loadGeneral(filePath, ba));
+	}
+
+	QVERIFY(!loader.image().isNull());
+
+	Settings::param().resources().loadRawThumb = loadRawThumb;
+	Settings::param().resources().rawDecodeSize = rawDecodeSize;
+}
+
+}
+
+QTEST_MAIN(nmc::DkLoaderTest)
+#include "DkLoaderTest.moc"